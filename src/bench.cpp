@@ -0,0 +1,220 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <sys/utsname.h>
+
+#include "eventlog.h"
+
+double BenchResult::get_min() const {
+    return this->samples.empty() ? 0.0 : *std::min_element(this->samples.begin(), this->samples.end());
+}
+
+double BenchResult::get_median() const {
+    return this->get_percentile(50.0);
+}
+
+/**
+ * Calculates a percentile of the samples using the nearest-rank method.
+ * @param p Percentile between 0 and 100.
+ * @return Duration in seconds.
+ */
+double BenchResult::get_percentile(double p) const {
+    if(this->samples.empty()) {
+        return 0.0;
+    }
+
+    std::vector<double> sorted(this->samples);
+    std::sort(sorted.begin(), sorted.end());
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    return sorted[std::min(sorted.size(), std::max(rank, (size_t)1)) - 1];
+}
+
+/**
+ * Calculates the throughput over all samples.
+ * @return Throughput in MB/s, or zero if there is no payload.
+ */
+double BenchResult::get_throughput() const {
+    double total = 0.0;
+    for(double t : this->samples) {
+        total += t;
+    }
+    if(this->bytes == 0 || total == 0.0) {
+        return 0.0;
+    }
+    return (double)(this->bytes * this->samples.size()) / total / 1e6;
+}
+
+/**
+ * Constructor for the Benchmark class.
+ * @param flasher Flasher of the device under test.
+ */
+Benchmark::Benchmark(Flasher& flasher) : flasher(flasher) {}
+
+/**
+ * Runs all benchmarks. The scratch bank is overwritten and the chip is
+ * erased at the end.
+ * @param scratch_bank Bank used for the sector erase and write benchmarks.
+ */
+void Benchmark::run(unsigned int scratch_bank) {
+    static const unsigned int nrpings = 200;
+    static const unsigned int nrreads = 16;
+    static const unsigned int nrrounds = 4;
+    static const unsigned int sectors_per_bank = BANKSIZE / SECTORSIZE;
+
+    Serial& serial = this->flasher.get_serial();
+    this->results.clear();
+    this->device_info = serial.read_device_info();
+    this->devid = serial.get_device_id();
+
+    // random data for the write benchmark
+    std::mt19937 gen(0);
+    std::uniform_int_distribution<unsigned int> dist(0, 255);
+    std::vector<uint8_t> data(SECTORSIZE);
+    for(auto& byte : data) {
+        byte = dist(gen);
+    }
+
+    std::cout << "Benchmarking command round trips..." << std::endl;
+    this->measure("command_echo", 0, nrpings, [&](unsigned int) {
+        serial.get_device_id();
+    });
+
+    std::cout << "Benchmarking bank reads..." << std::endl;
+    auto chunk = std::vector<uint8_t>(BANKSIZE);
+    this->measure("read_bank", BANKSIZE, nrreads, [&](unsigned int) {
+        serial.read_bank(scratch_bank, chunk);
+    });
+
+    std::cout << "Benchmarking sector erase and write on bank " << scratch_bank << "..." << std::endl;
+    for(unsigned int i=0; i<nrrounds * sectors_per_bank; i++) {
+        unsigned int sector = scratch_bank * sectors_per_bank + i % sectors_per_bank;
+        this->measure("erase_sector", SECTORSIZE, 1, [&](unsigned int) {
+            serial.erase_sector(sector);
+        });
+        this->measure("write_sector", SECTORSIZE, 1, [&](unsigned int) {
+            serial.write_sector(sector, data);
+        });
+    }
+
+    std::cout << "Benchmarking chip erase..." << std::endl;
+    this->measure("erase_chip", 0, 1, [&](unsigned int) {
+        serial.erase_chip();
+    });
+}
+
+/**
+ * Prints a table with the results.
+ */
+void Benchmark::print_results() const {
+    std::cout << "--------------------------------------------------------------" << std::endl;
+    std::cout << std::left << std::setfill(' ') << std::setw(14) << "operation" << std::right
+              << std::setw(6) << "n" << std::setw(11) << "min [ms]" << std::setw(11) << "med [ms]"
+              << std::setw(11) << "p99 [ms]" << std::setw(9) << "MB/s" << std::endl;
+    std::cout << "--------------------------------------------------------------" << std::endl;
+    for(const auto& result : this->results) {
+        std::cout << std::left << std::setw(14) << result.name << std::right << std::dec
+                  << std::setw(6) << result.samples.size() << std::fixed << std::setprecision(3)
+                  << std::setw(11) << result.get_min() * 1e3
+                  << std::setw(11) << result.get_median() * 1e3
+                  << std::setw(11) << result.get_percentile(99.0) * 1e3;
+        if(result.bytes > 0) {
+            std::cout << std::setw(9) << result.get_throughput();
+        } else {
+            std::cout << std::setw(9) << "-";
+        }
+        std::cout << std::defaultfloat << std::endl;
+    }
+    std::cout << "--------------------------------------------------------------" << std::endl;
+}
+
+/**
+ * Writes the results as JSON.
+ * @param filename Name of the file to write.
+ */
+void Benchmark::write_json(const std::string& filename) const {
+    std::ofstream outfile(filename);
+    if(!outfile) {
+        throw std::runtime_error("Error opening file.");
+    }
+
+    struct utsname host;
+    uname(&host);
+
+    // the firmware string is padded with spaces by the device
+    std::string firmware = this->device_info;
+    firmware.erase(firmware.find_last_not_of(" \t\r\n") + 1);
+
+    outfile << std::fixed << std::setprecision(9);
+    outfile << "{" << std::endl;
+    outfile << "  \"program\": \"" << PROGRAM_NAME << "\"," << std::endl;
+    outfile << "  \"version\": \"" << PROGRAM_VERSION << "\"," << std::endl;
+    outfile << "  \"git_hash\": \"" << PROGRAM_GIT_HASH << "\"," << std::endl;
+    outfile << "  \"host\": " << JsonEvent::quote(host.nodename) << "," << std::endl;
+    outfile << "  \"machine\": " << JsonEvent::quote(host.machine) << "," << std::endl;
+    outfile << "  \"kernel\": " << JsonEvent::quote(host.release) << "," << std::endl;
+    outfile << "  \"firmware\": " << JsonEvent::quote(firmware) << "," << std::endl;
+    outfile << "  \"device_id\": \"0x" << std::hex << std::uppercase << this->devid << std::dec << "\"," << std::endl;
+    outfile << "  \"results\": [" << std::endl;
+    for(size_t i=0; i<this->results.size(); i++) {
+        const BenchResult& result = this->results[i];
+        outfile << "    {\"operation\": " << JsonEvent::quote(result.name)
+                << ", \"bytes\": " << result.bytes
+                << ", \"n\": " << result.samples.size()
+                << ", \"min_s\": " << result.get_min()
+                << ", \"median_s\": " << result.get_median()
+                << ", \"p99_s\": " << result.get_percentile(99.0)
+                << ", \"mb_per_s\": " << result.get_throughput()
+                << "}" << (i + 1 < this->results.size() ? "," : "") << std::endl;
+    }
+    outfile << "  ]" << std::endl;
+    outfile << "}" << std::endl;
+
+    std::cout << "Writing " << TEXTBLUE << filename << TEXTWHITE << std::endl;
+}
+
+/**
+ * Times an operation a number of times.
+ * @param name Name of the operation.
+ * @param bytes Payload per operation in bytes.
+ * @param iterations Number of repetitions.
+ * @param op Operation to time; receives the iteration index.
+ */
+void Benchmark::measure(const std::string& name, size_t bytes, unsigned int iterations,
+                        const std::function<void(unsigned int)>& op) {
+    auto it = std::find_if(this->results.begin(), this->results.end(),
+                           [&](const BenchResult& r) { return r.name == name; });
+    if(it == this->results.end()) {
+        this->results.push_back(BenchResult{name, bytes, {}});
+        it = this->results.end() - 1;
+    }
+
+    for(unsigned int i=0; i<iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        op(i);
+        auto stop = std::chrono::steady_clock::now();
+        it->samples.push_back(std::chrono::duration<double>(stop - start).count());
+    }
+}
@@ -0,0 +1,89 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "flasher.h"
+
+// Timings of a single benchmarked operation
+struct BenchResult {
+    std::string name;               // name of the operation
+    size_t bytes = 0;               // payload per operation in bytes
+    std::vector<double> samples;    // duration per operation in seconds
+
+    double get_min() const;
+    double get_median() const;
+    double get_percentile(double p) const;
+
+    /**
+     * Calculates the throughput over all samples.
+     * @return Throughput in MB/s, or zero if there is no payload.
+     */
+    double get_throughput() const;
+};
+
+class Benchmark {
+private:
+    Flasher& flasher;                   // flasher of the device under test
+    std::vector<BenchResult> results;   // timings per operation
+    std::string device_info;            // firmware identification
+    uint16_t devid = 0;                 // device ID of the chip
+
+public:
+    /**
+     * Constructor for the Benchmark class.
+     * @param flasher Flasher of the device under test.
+     */
+    Benchmark(Flasher& flasher);
+
+    /**
+     * Runs all benchmarks. The scratch bank is overwritten and the chip is
+     * erased at the end.
+     * @param scratch_bank Bank used for the sector erase and write benchmarks.
+     */
+    void run(unsigned int scratch_bank);
+
+    /**
+     * Prints a table with the results.
+     */
+    void print_results() const;
+
+    /**
+     * Writes the results as JSON.
+     * @param filename Name of the file to write.
+     */
+    void write_json(const std::string& filename) const;
+
+private:
+    /**
+     * Times an operation a number of times.
+     * @param name Name of the operation.
+     * @param bytes Payload per operation in bytes.
+     * @param iterations Number of repetitions.
+     * @param op Operation to time; receives the iteration index.
+     */
+    void measure(const std::string& name, size_t bytes, unsigned int iterations,
+                 const std::function<void(unsigned int)>& op);
+};
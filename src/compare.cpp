@@ -0,0 +1,99 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "compare.h"
+
+#include <cstring>
+#include <algorithm>
+
+/**
+ * Finds all ranges in which two buffers differ. Matching blocks are
+ * skipped a machine word at a time; only blocks containing a difference
+ * are inspected byte by byte.
+ * @param expected Expected data.
+ * @param actual Actual data.
+ * @param size Number of bytes to compare.
+ * @param base Offset added to the reported ranges.
+ * @return Ranges of differing bytes, in ascending order.
+ */
+std::vector<MismatchRange> Compare::find_mismatches(const uint8_t* expected, const uint8_t* actual,
+                                                    size_t size, size_t base) {
+    static const size_t blocksize = 4 * sizeof(uint64_t);
+    std::vector<MismatchRange> ranges;
+
+    size_t i = 0;
+    while(i < size) {
+        // skip identical blocks; the compiler turns this into vector loads
+        if(i + blocksize <= size) {
+            uint64_t a[4], b[4];
+            std::memcpy(a, expected + i, blocksize);
+            std::memcpy(b, actual + i, blocksize);
+            if(((a[0] ^ b[0]) | (a[1] ^ b[1]) | (a[2] ^ b[2]) | (a[3] ^ b[3])) == 0) {
+                i += blocksize;
+                continue;
+            }
+        }
+
+        // inspect the block that contains a difference byte by byte
+        size_t end = std::min(i + blocksize, size);
+        for(; i < end; i++) {
+            uint8_t x = expected[i] ^ actual[i];
+            if(x == 0) {
+                continue;
+            }
+
+            if(ranges.empty() || ranges.back().offset + ranges.back().length != base + i) {
+                ranges.push_back(MismatchRange{base + i, 0, 0, {}, {}});
+            }
+
+            MismatchRange& range = ranges.back();
+            if(range.length < MISMATCH_SAMPLE) {
+                range.expected.push_back(expected[i]);
+                range.actual.push_back(actual[i]);
+            }
+            range.length++;
+            range.flipped_bits += __builtin_popcount(x);
+        }
+    }
+
+    return ranges;
+}
+
+/**
+ * Appends ranges to a list, merging ranges that touch.
+ * @param ranges List to append to.
+ * @param more Ranges to append, located after those already in the list.
+ */
+void Compare::append(std::vector<MismatchRange>& ranges, std::vector<MismatchRange>&& more) {
+    for(auto& range : more) {
+        if(!ranges.empty() && ranges.back().offset + ranges.back().length == range.offset) {
+            MismatchRange& last = ranges.back();
+            for(size_t j=0; j<range.expected.size() && last.expected.size() < MISMATCH_SAMPLE; j++) {
+                last.expected.push_back(range.expected[j]);
+                last.actual.push_back(range.actual[j]);
+            }
+            last.length += range.length;
+            last.flipped_bits += range.flipped_bits;
+        } else {
+            ranges.push_back(std::move(range));
+        }
+    }
+}
@@ -0,0 +1,60 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#define MISMATCH_SAMPLE 8
+
+// Range of consecutive bytes that differ between two buffers
+struct MismatchRange {
+    size_t offset;                  // offset of the first differing byte
+    size_t length;                  // number of consecutive differing bytes
+    unsigned int flipped_bits;      // number of bits that differ in the range
+    std::vector<uint8_t> expected;  // first expected bytes (up to MISMATCH_SAMPLE)
+    std::vector<uint8_t> actual;    // first actual bytes (up to MISMATCH_SAMPLE)
+};
+
+class Compare {
+public:
+    /**
+     * Finds all ranges in which two buffers differ. Matching blocks are
+     * skipped a machine word at a time; only blocks containing a difference
+     * are inspected byte by byte.
+     * @param expected Expected data.
+     * @param actual Actual data.
+     * @param size Number of bytes to compare.
+     * @param base Offset added to the reported ranges.
+     * @return Ranges of differing bytes, in ascending order.
+     */
+    static std::vector<MismatchRange> find_mismatches(const uint8_t* expected, const uint8_t* actual,
+                                                      size_t size, size_t base = 0);
+
+    /**
+     * Appends ranges to a list, merging ranges that touch.
+     * @param ranges List to append to.
+     * @param more Ranges to append, located after those already in the list.
+     */
+    static void append(std::vector<MismatchRange>& ranges, std::vector<MismatchRange>&& more);
+};
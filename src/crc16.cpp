@@ -0,0 +1,340 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "crc16.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace {
+    const uint16_t POLY = 0x1021;
+
+    // lookup tables; tables[k][b] is the checksum of byte b followed by k zero bytes
+    struct Tables {
+        uint16_t tables[16][256];
+
+        Tables() {
+            for(unsigned int b=0; b<256; b++) {
+                uint16_t crc = b << 8;
+                for(unsigned int j=0; j<8; j++) {
+                    crc = (crc & 0x8000) ? (crc << 1) ^ POLY : (crc << 1);
+                }
+                this->tables[0][b] = crc;
+            }
+            for(unsigned int k=1; k<16; k++) {
+                for(unsigned int b=0; b<256; b++) {
+                    uint16_t prev = this->tables[k-1][b];
+                    this->tables[k][b] = (prev << 8) ^ this->tables[0][prev >> 8];
+                }
+            }
+        }
+    };
+
+    const Tables& get_tables() {
+        static const Tables tables;
+        return tables;
+    }
+
+    /**
+     * Calculates x^n modulo the polynomial, used as folding constant.
+     * @param n Exponent.
+     * @return Remainder of x^n.
+     */
+    uint64_t xpow_mod(unsigned int n) {
+        uint32_t r = 1;
+        for(unsigned int i=0; i<n; i++) {
+            r <<= 1;
+            if(r & 0x10000) {
+                r ^= 0x10000 | POLY;
+            }
+        }
+        return r;
+    }
+}
+
+/**
+ * Calculates the checksum one bit at a time; serves as reference.
+ * @param data Pointer to the data.
+ * @param size Number of bytes.
+ * @param crc Checksum of any preceding data, to continue a calculation.
+ * @return CRC16 checksum.
+ */
+uint16_t CRC16::xmodem_bitwise(const uint8_t* data, size_t size, uint16_t crc) {
+    uint32_t value = crc;
+
+    for(size_t i=0; i<size; i++) {
+        value = value ^ (data[i] << 8);
+        for(uint8_t j=0; j<8; j++) {
+            value = value << 1;
+            if(value & 0x10000) {
+                value = (value ^ POLY) & 0xFFFF;
+            }
+        }
+    }
+
+    return (uint16_t)value;
+}
+
+/**
+ * Calculates the checksum one byte at a time using a lookup table.
+ * @param data Pointer to the data.
+ * @param size Number of bytes.
+ * @param crc Checksum of any preceding data, to continue a calculation.
+ * @return CRC16 checksum.
+ */
+uint16_t CRC16::xmodem_table(const uint8_t* data, size_t size, uint16_t crc) {
+    const uint16_t* table = get_tables().tables[0];
+    for(size_t i=0; i<size; i++) {
+        crc = (crc << 8) ^ table[(crc >> 8) ^ data[i]];
+    }
+    return crc;
+}
+
+/**
+ * Calculates the checksum eight bytes at a time using eight lookup tables.
+ * @param data Pointer to the data.
+ * @param size Number of bytes.
+ * @param crc Checksum of any preceding data, to continue a calculation.
+ * @return CRC16 checksum.
+ */
+uint16_t CRC16::xmodem_slice8(const uint8_t* data, size_t size, uint16_t crc) {
+    const auto& t = get_tables().tables;
+    for(; size >= 8; size -= 8, data += 8) {
+        crc = t[7][data[0] ^ (crc >> 8)] ^ t[6][data[1] ^ (crc & 0xFF)] ^
+              t[5][data[2]] ^ t[4][data[3]] ^ t[3][data[4]] ^ t[2][data[5]] ^
+              t[1][data[6]] ^ t[0][data[7]];
+    }
+    return xmodem_table(data, size, crc);
+}
+
+/**
+ * Calculates the checksum sixteen bytes at a time using sixteen lookup tables.
+ * @param data Pointer to the data.
+ * @param size Number of bytes.
+ * @param crc Checksum of any preceding data, to continue a calculation.
+ * @return CRC16 checksum.
+ */
+uint16_t CRC16::xmodem_slice16(const uint8_t* data, size_t size, uint16_t crc) {
+    const auto& t = get_tables().tables;
+    for(; size >= 16; size -= 16, data += 16) {
+        crc = t[15][data[0] ^ (crc >> 8)] ^ t[14][data[1] ^ (crc & 0xFF)] ^
+              t[13][data[2]] ^ t[12][data[3]] ^ t[11][data[4]] ^ t[10][data[5]] ^
+              t[9][data[6]] ^ t[8][data[7]] ^ t[7][data[8]] ^ t[6][data[9]] ^
+              t[5][data[10]] ^ t[4][data[11]] ^ t[3][data[12]] ^ t[2][data[13]] ^
+              t[1][data[14]] ^ t[0][data[15]];
+    }
+    return xmodem_table(data, size, crc);
+}
+
+/*
+ * Folding with carry-less multiplication: the data processed so far is kept
+ * as 128-bit polynomials X that are congruent to it modulo the CRC polynomial
+ * P. Appending a block B of d bits gives X * x^d + B, which is congruent to
+ * X.hi * (x^(d+64) mod P) + X.lo * (x^d mod P) + B. Both products fit in
+ * 80 bits, so the result is again a 128-bit polynomial. The checksum of the
+ * data equals the checksum of the 16 bytes of the final X.
+ */
+#if defined(__x86_64__)
+
+namespace {
+    __attribute__((target("pclmul,ssse3")))
+    inline __m128i load_block(const uint8_t* data, __m128i reverse) {
+        return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), reverse);
+    }
+
+    __attribute__((target("pclmul,ssse3")))
+    inline __m128i fold(__m128i x, __m128i k) {
+        return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00));
+    }
+
+    __attribute__((target("pclmul,ssse3")))
+    uint16_t xmodem_pclmul(const uint8_t* data, size_t size, uint16_t crc) {
+        // folding constants for distances of 512, 384, 256 and 128 bits
+        static const __m128i k512 = _mm_set_epi64x(xpow_mod(512 + 64), xpow_mod(512));
+        static const __m128i k384 = _mm_set_epi64x(xpow_mod(384 + 64), xpow_mod(384));
+        static const __m128i k256 = _mm_set_epi64x(xpow_mod(256 + 64), xpow_mod(256));
+        static const __m128i k128 = _mm_set_epi64x(xpow_mod(128 + 64), xpow_mod(128));
+        const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+        // the preceding checksum enters as the first two bytes of the data
+        __m128i init = _mm_set_epi64x((uint64_t)crc << 48, 0);
+
+        // four independent accumulators hide the latency of the multiplications
+        __m128i x0 = _mm_xor_si128(load_block(data, reverse), init);
+        __m128i x1 = load_block(data + 16, reverse);
+        __m128i x2 = load_block(data + 32, reverse);
+        __m128i x3 = load_block(data + 48, reverse);
+        data += 64;
+        size -= 64;
+        for(; size >= 64; size -= 64, data += 64) {
+            x0 = _mm_xor_si128(fold(x0, k512), load_block(data, reverse));
+            x1 = _mm_xor_si128(fold(x1, k512), load_block(data + 16, reverse));
+            x2 = _mm_xor_si128(fold(x2, k512), load_block(data + 32, reverse));
+            x3 = _mm_xor_si128(fold(x3, k512), load_block(data + 48, reverse));
+        }
+        __m128i x = _mm_xor_si128(_mm_xor_si128(fold(x0, k384), fold(x1, k256)), _mm_xor_si128(fold(x2, k128), x3));
+
+        for(; size >= 16; size -= 16, data += 16) {
+            x = _mm_xor_si128(fold(x, k128), load_block(data, reverse));
+        }
+
+        uint8_t block[16];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(block), _mm_shuffle_epi8(x, reverse));
+        return CRC16::xmodem_table(data, size, CRC16::xmodem_table(block, 16, 0));
+    }
+}
+
+/**
+ * Checks whether the CPU supports carry-less multiplication.
+ * @return True if xmodem_clmul uses carry-less multiplication.
+ */
+bool CRC16::has_clmul() {
+    static const bool supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+    return supported;
+}
+
+#elif defined(__aarch64__)
+
+namespace {
+    __attribute__((target("+crypto")))
+    inline uint64x2_t load_block(const uint8_t* data) {
+        // reverse the bytes such that the first byte becomes the most significant one
+        uint8x16_t v = vrev64q_u8(vld1q_u8(data));
+        return vreinterpretq_u64_u8(vextq_u8(v, v, 8));
+    }
+
+    __attribute__((target("+crypto")))
+    inline uint64x2_t fold(uint64x2_t x, uint64_t k_hi, uint64_t k_lo) {
+        poly128_t hi = vmull_p64((poly64_t)vgetq_lane_u64(x, 1), (poly64_t)k_hi);
+        poly128_t lo = vmull_p64((poly64_t)vgetq_lane_u64(x, 0), (poly64_t)k_lo);
+        return veorq_u64(vreinterpretq_u64_p128(hi), vreinterpretq_u64_p128(lo));
+    }
+
+    __attribute__((target("+crypto")))
+    uint16_t xmodem_pmull(const uint8_t* data, size_t size, uint16_t crc) {
+        // folding constants for distances of 512, 384, 256 and 128 bits
+        static const uint64_t k512[2] = {xpow_mod(512), xpow_mod(512 + 64)};
+        static const uint64_t k384[2] = {xpow_mod(384), xpow_mod(384 + 64)};
+        static const uint64_t k256[2] = {xpow_mod(256), xpow_mod(256 + 64)};
+        static const uint64_t k128[2] = {xpow_mod(128), xpow_mod(128 + 64)};
+
+        // the preceding checksum enters as the first two bytes of the data
+        uint64x2_t init = vcombine_u64(vcreate_u64(0), vcreate_u64((uint64_t)crc << 48));
+
+        // four independent accumulators hide the latency of the multiplications
+        uint64x2_t x0 = veorq_u64(load_block(data), init);
+        uint64x2_t x1 = load_block(data + 16);
+        uint64x2_t x2 = load_block(data + 32);
+        uint64x2_t x3 = load_block(data + 48);
+        data += 64;
+        size -= 64;
+        for(; size >= 64; size -= 64, data += 64) {
+            x0 = veorq_u64(fold(x0, k512[1], k512[0]), load_block(data));
+            x1 = veorq_u64(fold(x1, k512[1], k512[0]), load_block(data + 16));
+            x2 = veorq_u64(fold(x2, k512[1], k512[0]), load_block(data + 32));
+            x3 = veorq_u64(fold(x3, k512[1], k512[0]), load_block(data + 48));
+        }
+        uint64x2_t x = veorq_u64(veorq_u64(fold(x0, k384[1], k384[0]), fold(x1, k256[1], k256[0])),
+                                 veorq_u64(fold(x2, k128[1], k128[0]), x3));
+
+        for(; size >= 16; size -= 16, data += 16) {
+            x = veorq_u64(fold(x, k128[1], k128[0]), load_block(data));
+        }
+
+        uint8_t block[16];
+        uint8x16_t v = vrev64q_u8(vreinterpretq_u8_u64(x));
+        vst1q_u8(block, vextq_u8(v, v, 8));
+        return CRC16::xmodem_table(data, size, CRC16::xmodem_table(block, 16, 0));
+    }
+}
+
+/**
+ * Checks whether the CPU supports carry-less multiplication.
+ * @return True if xmodem_clmul uses carry-less multiplication.
+ */
+bool CRC16::has_clmul() {
+    static const bool supported = (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+    return supported;
+}
+
+#else
+
+/**
+ * Checks whether the CPU supports carry-less multiplication.
+ * @return True if xmodem_clmul uses carry-less multiplication.
+ */
+bool CRC16::has_clmul() {
+    return false;
+}
+
+#endif
+
+/**
+ * Calculates the checksum by folding 64 bytes at a time using carry-less
+ * multiplication (PCLMULQDQ on x86-64, PMULL on AArch64). Falls back to
+ * slicing-by-16 when the CPU lacks these instructions.
+ * @param data Pointer to the data.
+ * @param size Number of bytes.
+ * @param crc Checksum of any preceding data, to continue a calculation.
+ * @return CRC16 checksum.
+ */
+uint16_t CRC16::xmodem_clmul(const uint8_t* data, size_t size, uint16_t crc) {
+    // folding only pays off for at least a few blocks
+    if(size < 128 || !has_clmul()) {
+        return xmodem_slice16(data, size, crc);
+    }
+#if defined(__x86_64__)
+    return xmodem_pclmul(data, size, crc);
+#elif defined(__aarch64__)
+    return xmodem_pmull(data, size, crc);
+#else
+    return xmodem_slice16(data, size, crc);
+#endif
+}
+
+/**
+ * Gets the implementation used by xmodem().
+ * @return Function calculating the checksum.
+ */
+crc16_function CRC16::get_implementation() {
+    static const crc16_function implementation = has_clmul() ? &CRC16::xmodem_clmul : &CRC16::xmodem_slice16;
+    return implementation;
+}
+
+/**
+ * Gets the name of the implementation used by xmodem().
+ * @return Name of the implementation.
+ */
+const char* CRC16::get_implementation_name() {
+    if(!has_clmul()) {
+        return "slice16";
+    }
+#if defined(__x86_64__)
+    return "pclmul";
+#else
+    return "pmull";
+#endif
+}
@@ -0,0 +1,122 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+
+// Signature shared by all CRC16 implementations
+typedef uint16_t (*crc16_function)(const uint8_t* data, size_t size, uint16_t crc);
+
+/**
+ * CRC16-XMODEM (polynomial 0x1021, initial value 0, not reflected) as
+ * calculated by the firmware of the programmer. Several implementations
+ * are available; xmodem() uses the fastest one supported by the CPU.
+ */
+class CRC16 {
+public:
+    /**
+     * Calculates the checksum using the fastest available implementation.
+     * @param data Pointer to the data.
+     * @param size Number of bytes.
+     * @param crc Checksum of any preceding data, to continue a calculation.
+     * @return CRC16 checksum.
+     */
+    static uint16_t xmodem(const uint8_t* data, size_t size, uint16_t crc = 0) {
+        return get_implementation()(data, size, crc);
+    }
+
+    /**
+     * Calculates the checksum using the fastest available implementation.
+     * @param data Data to calculate the checksum for.
+     * @return CRC16 checksum.
+     */
+    static uint16_t xmodem(std::span<const uint8_t> data) {
+        return get_implementation()(data.data(), data.size(), 0);
+    }
+
+    /**
+     * Calculates the checksum one bit at a time; serves as reference.
+     * @param data Pointer to the data.
+     * @param size Number of bytes.
+     * @param crc Checksum of any preceding data, to continue a calculation.
+     * @return CRC16 checksum.
+     */
+    static uint16_t xmodem_bitwise(const uint8_t* data, size_t size, uint16_t crc = 0);
+
+    /**
+     * Calculates the checksum one byte at a time using a lookup table.
+     * @param data Pointer to the data.
+     * @param size Number of bytes.
+     * @param crc Checksum of any preceding data, to continue a calculation.
+     * @return CRC16 checksum.
+     */
+    static uint16_t xmodem_table(const uint8_t* data, size_t size, uint16_t crc = 0);
+
+    /**
+     * Calculates the checksum eight bytes at a time using eight lookup tables.
+     * @param data Pointer to the data.
+     * @param size Number of bytes.
+     * @param crc Checksum of any preceding data, to continue a calculation.
+     * @return CRC16 checksum.
+     */
+    static uint16_t xmodem_slice8(const uint8_t* data, size_t size, uint16_t crc = 0);
+
+    /**
+     * Calculates the checksum sixteen bytes at a time using sixteen lookup tables.
+     * @param data Pointer to the data.
+     * @param size Number of bytes.
+     * @param crc Checksum of any preceding data, to continue a calculation.
+     * @return CRC16 checksum.
+     */
+    static uint16_t xmodem_slice16(const uint8_t* data, size_t size, uint16_t crc = 0);
+
+    /**
+     * Calculates the checksum by folding 64 bytes at a time using carry-less
+     * multiplication (PCLMULQDQ on x86-64, PMULL on AArch64). Falls back to
+     * slicing-by-16 when the CPU lacks these instructions.
+     * @param data Pointer to the data.
+     * @param size Number of bytes.
+     * @param crc Checksum of any preceding data, to continue a calculation.
+     * @return CRC16 checksum.
+     */
+    static uint16_t xmodem_clmul(const uint8_t* data, size_t size, uint16_t crc = 0);
+
+    /**
+     * Checks whether the CPU supports carry-less multiplication.
+     * @return True if xmodem_clmul uses carry-less multiplication.
+     */
+    static bool has_clmul();
+
+    /**
+     * Gets the implementation used by xmodem().
+     * @return Function calculating the checksum.
+     */
+    static crc16_function get_implementation();
+
+    /**
+     * Gets the name of the implementation used by xmodem().
+     * @return Name of the implementation.
+     */
+    static const char* get_implementation_name();
+};
@@ -0,0 +1,126 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <tclap/CmdLine.h>
+
+#include "config.h"
+#include "crc16.h"
+
+// Implementation under test
+struct Candidate {
+    const char* name;
+    crc16_function function;
+};
+
+int main(int argc, char* argv[]) {
+    try {
+        TCLAP::CmdLine cmd("Validate and benchmark the CRC16-XMODEM implementations", ' ', PROGRAM_VERSION);
+        TCLAP::ValueArg<double> arg_duration("d","duration","Measurement time per implementation and size in seconds",false,0.2,"s");
+        cmd.add(arg_duration);
+        TCLAP::SwitchArg arg_check("c","check","Only validate the implementations, skipping the benchmark",false);
+        cmd.add(arg_check);
+        cmd.parse(argc, argv);
+
+        const Candidate candidates[] = {
+            {"bitwise", &CRC16::xmodem_bitwise},
+            {"table", &CRC16::xmodem_table},
+            {"slice8", &CRC16::xmodem_slice8},
+            {"slice16", &CRC16::xmodem_slice16},
+            {"clmul", &CRC16::xmodem_clmul},
+        };
+        const size_t sizes[] = {SECTORSIZE, BANKSIZE, 0x80000};
+
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<unsigned int> dist(0, 255);
+        std::vector<uint8_t> data(0x100000);
+        for(auto& byte : data) {
+            byte = dist(gen);
+        }
+
+        // validate every implementation against the bitwise reference, including
+        // odd lengths, unaligned starts, continued calculations and large buffers
+        std::cout << "Validating implementations against the bitwise reference..." << std::endl;
+        unsigned int nrfailed = 0;
+        for(const auto& candidate : candidates) {
+            for(size_t size = 0; size <= 0x100000; size = size < 300 ? size + 1 : size * 2 + 7) {
+                size_t length = std::min(size, data.size() - 3);
+                for(uint16_t crc : {0x0000, 0x1D0F, 0xFFFF}) {
+                    uint16_t expected = CRC16::xmodem_bitwise(data.data() + 3, length, crc);
+                    if(candidate.function(data.data() + 3, length, crc) != expected) {
+                        std::cout << "FAIL: " << candidate.name
+                                  << " size " << length << " initial 0x" << std::hex << crc << std::dec << std::endl;
+                        nrfailed++;
+                    }
+                }
+            }
+        }
+        const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+        if(CRC16::xmodem(check, sizeof(check)) != 0x31C3) {
+            std::cout << "FAIL: check value of \"123456789\"" << std::endl;
+            nrfailed++;
+        }
+        if(nrfailed > 0) {
+            return 1;
+        }
+        std::cout << "All implementations agree; selected implementation: "
+                  << CRC16::get_implementation_name() << std::endl;
+        if(arg_check.getValue()) {
+            return 0;
+        }
+
+        // measure the throughput for a sector, a bank and a full SST39SF040 image
+        std::cout << "--------------------------------------------------------------" << std::endl;
+        std::cout << std::left << std::setw(12) << "MB/s" << std::right;
+        for(size_t size : sizes) {
+            std::cout << std::setw(14) << (std::to_string(size / 1024) + " KiB");
+        }
+        std::cout << std::endl;
+        std::cout << "--------------------------------------------------------------" << std::endl;
+
+        volatile uint16_t sink = 0;
+        for(const auto& candidate : candidates) {
+            std::cout << std::left << std::setw(12) << candidate.name << std::right;
+            for(size_t size : sizes) {
+                size_t bytes = 0;
+                auto start = std::chrono::steady_clock::now();
+                double elapsed = 0.0;
+                do {
+                    sink = sink ^ candidate.function(data.data(), size, 0);
+                    bytes += size;
+                    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                } while(elapsed < arg_duration.getValue());
+                std::cout << std::setw(14) << std::fixed << std::setprecision(1) << (bytes / elapsed / 1e6) << std::defaultfloat;
+            }
+            std::cout << std::endl;
+        }
+        std::cout << "--------------------------------------------------------------" << std::endl;
+
+        return 0;
+    } catch (TCLAP::ArgException &e) {
+        std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+        return -1;
+    }
+}
@@ -0,0 +1,367 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "daemon.h"
+
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    // Unbuffered-per-line stream buffer writing to a socket; output is
+    // discarded once the client has gone away
+    class SocketStreamBuf : public std::streambuf {
+    private:
+        int fd;
+        char buffer[1024];
+        bool broken = false;
+
+    public:
+        SocketStreamBuf(int fd) : fd(fd) {
+            this->setp(this->buffer, this->buffer + sizeof(this->buffer));
+        }
+
+        ~SocketStreamBuf() {
+            this->sync();
+        }
+
+    protected:
+        int overflow(int c) override {
+            this->sync();
+            if(c != traits_type::eof()) {
+                *this->pptr() = traits_type::to_char_type(c);
+                this->pbump(1);
+                if(c == '\n' || c == '\r') {
+                    this->sync();
+                }
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override {
+            const char* ptr = this->pbase();
+            size_t size = this->pptr() - this->pbase();
+            while(size > 0 && !this->broken) {
+                ssize_t n = send(this->fd, ptr, size, MSG_NOSIGNAL);
+                if(n < 0) {
+                    if(errno == EINTR) {
+                        continue;
+                    }
+                    this->broken = true;
+                    break;
+                }
+                ptr += n;
+                size -= n;
+            }
+            this->setp(this->buffer, this->buffer + sizeof(this->buffer));
+            return 0;
+        }
+    };
+}
+
+/**
+ * Constructor for the Daemon class.
+ * @param socket_path Path of the Unix domain socket to listen on.
+ * @param devices Paths to the serial devices to keep open.
+ * @param transport Settings of the serial transport.
+ */
+Daemon::Daemon(const std::string& socket_path, const std::vector<std::string>& devices, const SerialConfig& transport) :
+    socket_path(socket_path),
+    transport(transport) {
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if(socket_path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Error: Socket path too long: " + socket_path);
+    }
+    std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    // refuse to take over the socket of a running daemon, but clean up a stale one
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(probe >= 0) {
+        bool running = connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        close(probe);
+        if(running) {
+            throw std::runtime_error("Error: Another daemon is listening on " + socket_path + ".");
+        }
+    }
+    unlink(socket_path.c_str());
+
+    // open all devices up front such that jobs start on a warm session
+    for(const auto& device : devices) {
+        this->sessions.emplace_back(std::make_unique<DaemonSession>());
+        this->sessions.back()->device = device;
+        try {
+            this->open_session(*this->sessions.back(), std::cout);
+        } catch(const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            std::cerr << "Retrying " << device << " on the next job." << std::endl;
+        }
+    }
+
+    this->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(this->listen_fd < 0) {
+        throw std::runtime_error(std::string("Error creating socket: ") + std::strerror(errno));
+    }
+    if(bind(this->listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+       listen(this->listen_fd, 16) != 0) {
+        std::string error = std::strerror(errno);
+        close(this->listen_fd);
+        throw std::runtime_error("Error listening on " + socket_path + ": " + error);
+    }
+}
+
+/**
+ * Destructor for the Daemon class; removes the socket.
+ */
+Daemon::~Daemon() {
+    if(this->listen_fd >= 0) {
+        close(this->listen_fd);
+        unlink(this->socket_path.c_str());
+    }
+}
+
+/**
+ * Accepts and runs jobs until stop is set.
+ * @param stop Flag that ends the loop, e.g. set from a signal handler.
+ */
+void Daemon::run(const volatile sig_atomic_t& stop) {
+    std::cout << "Listening on: " << TEXTBLUE << this->socket_path << TEXTWHITE << std::endl;
+
+    while(!stop) {
+        int fd = accept(this->listen_fd, nullptr, nullptr);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Error accepting client: ") + std::strerror(errno));
+        }
+
+        // every client is served by its own thread; jobs on the same device queue up
+        {
+            std::lock_guard<std::mutex> lock(this->clients_mtx);
+            this->active_clients++;
+        }
+        std::thread([this, fd]() {
+            this->handle_client(fd);
+            std::lock_guard<std::mutex> lock(this->clients_mtx);
+            this->active_clients--;
+            this->clients_cv.notify_all();
+        }).detach();
+    }
+
+    // let running jobs finish before the devices are closed
+    std::unique_lock<std::mutex> lock(this->clients_mtx);
+    if(this->active_clients > 0) {
+        std::cout << "Waiting for " << this->active_clients << " job(s) to finish." << std::endl;
+    }
+    this->clients_cv.wait(lock, [this] { return this->active_clients == 0; });
+}
+
+/**
+ * Opens the device of a session and caches the identity of the chip.
+ * @param session Session to open.
+ * @param out Stream to write progress to.
+ */
+void Daemon::open_session(DaemonSession& session, std::ostream& out) {
+    auto flasher = std::make_unique<Flasher>(session.device, out, this->transport);
+    session.devid = flasher->read_chip_id();
+    session.romsize = Flasher::get_rom_size(session.devid);
+    flasher->set_output(std::cout);
+    session.flasher = std::move(flasher);
+}
+
+/**
+ * Reads a job from a client, runs it and streams the output back.
+ * @param fd Connected client socket.
+ */
+void Daemon::handle_client(int fd) {
+    SocketStreamBuf buffer(fd);
+    std::ostream out(&buffer);
+
+    bool pass = false;
+    std::string message;
+    DaemonJob job;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        // a job is a single line
+        std::string line;
+        char c;
+        while(true) {
+            ssize_t n = recv(fd, &c, 1, 0);
+            if(n < 0 && errno == EINTR) {
+                continue;
+            }
+            if(n <= 0) {
+                throw std::runtime_error("Error: Connection closed before the job was received.");
+            }
+            if(c == '\n') {
+                break;
+            }
+            line.push_back(c);
+        }
+        job = DaemonJob::parse(line);
+
+        if(job.operation == "info") {
+            this->print_sessions(out);
+            pass = true;
+        } else {
+            DaemonSession& session = this->find_session(job.device);
+            std::lock_guard<std::mutex> lock(session.mtx);
+            try {
+                if(!session.flasher) {
+                    this->open_session(session, out);
+                }
+                session.flasher->set_output(out);
+                pass = this->run_job(session, job, out);
+                session.flasher->set_output(std::cout);
+            } catch(...) {
+                // the state of the device is unknown; reopen it for the next job
+                if(session.flasher) {
+                    session.flasher->set_output(std::cout);
+                }
+                session.flasher.reset();
+                throw;
+            }
+        }
+        if(!pass) {
+            message = "Verification failed.";
+        }
+    } catch(const std::exception& e) {
+        pass = false;
+        message = e.what();
+        out << TEXTRED << message << TEXTWHITE << std::endl;
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    if(pass) {
+        out << DAEMON_STATUS_OK << std::endl;
+    } else {
+        out << DAEMON_STATUS_ERROR << message << std::endl;
+    }
+    out.flush();
+    close(fd);
+
+    std::cout << "Job " << job.operation << (job.filename.empty() ? "" : " " + job.filename) << " ["
+              << (pass ? TEXTGREEN "PASS" : TEXTRED "FAIL") << TEXTWHITE << "] "
+              << std::fixed << std::setprecision(2) << std::chrono::duration<double>(stop - start).count()
+              << "s" << std::defaultfloat << std::endl;
+}
+
+/**
+ * Runs a job on a session.
+ * @param session Session to run the job on.
+ * @param job Job to run.
+ * @param out Stream to write progress to.
+ * @return True if the job succeeded, false otherwise.
+ */
+bool Daemon::run_job(DaemonSession& session, const DaemonJob& job, std::ostream& out) {
+    Flasher& flasher = *session.flasher;
+    flasher.set_pipelined(job.pipelined);
+
+    out << "Running on " << TEXTBLUE << session.device << TEXTWHITE << std::endl;
+
+    if(job.operation == "erase") {
+        flasher.erase_chip();
+        return true;
+    } else if(job.operation == "read") {
+        flasher.dump_chip(job.filename, session.romsize);
+        return true;
+    } else if(job.operation != "write" && job.operation != "verify") {
+        throw std::runtime_error("Error: Unknown operation: " + job.operation);
+    }
+
+    std::vector<uint8_t> data;
+    Flasher::read_file(job.filename, data, out);
+
+    if(job.bank >= 0) {
+        unsigned int max_bank = session.romsize / BANKSIZE;
+        if(data.size() != BANKSIZE) {
+            throw std::runtime_error("Error: Data size must be 16KB");
+        }
+        if((unsigned int)job.bank >= max_bank) {
+            throw std::runtime_error("Error: Bank number must be between 0 and " + std::to_string(max_bank-1) + ".");
+        }
+
+        if(job.operation == "write") {
+            flasher.write_bank(data, job.bank);
+        }
+        return flasher.verify_bank(data, job.bank);
+    }
+
+    if(job.operation == "verify") {
+        if(data.size() != session.romsize) {
+            throw std::runtime_error("Error: File size does not match chip size.");
+        }
+        return flasher.verify_chip(data);
+    }
+
+    if(data.size() > session.romsize) {
+        throw std::runtime_error("Error: File size too large.");
+    }
+    data.resize(session.romsize, job.pad_ff ? 0xFF : 0);
+
+    if(job.diff) {
+        flasher.write_chip_diff(data);
+    } else {
+        flasher.erase_chip();
+        flasher.write_chip(data, job.skip_blank);
+    }
+    return flasher.verify_chip(data);
+}
+
+/**
+ * Lists the sessions and the cached identity of their chips.
+ * @param out Stream to write the list to.
+ */
+void Daemon::print_sessions(std::ostream& out) {
+    unsigned int ctr = 0;
+    for(const auto& session : this->sessions) {
+        out << std::dec << (++ctr) << ". " << session->device << " ";
+        std::unique_lock<std::mutex> lock(session->mtx, std::try_to_lock);
+        if(!lock.owns_lock()) {
+            out << "[" << TEXTBLUE << "BUSY" << TEXTWHITE << "] running a job" << std::endl;
+        } else if(session->flasher) {
+            out << "[" << TEXTGREEN << "OPEN" << TEXTWHITE << "] device ID 0x" << std::hex << std::uppercase
+                << session->devid << std::dec << ", " << (session->romsize / 1024) << " KiB" << std::endl;
+        } else {
+            out << "[" << TEXTRED << "CLOSED" << TEXTWHITE << "] reopened on the next job" << std::endl;
+        }
+    }
+}
+
+/**
+ * Finds the session of a device.
+ * @param device Path to the serial device; empty selects the first session.
+ * @return Session of the device.
+ * @throws std::runtime_error if the device is not held by the daemon.
+ */
+DaemonSession& Daemon::find_session(const std::string& device) {
+    for(auto& session : this->sessions) {
+        if(device.empty() || session->device == device) {
+            return *session;
+        }
+    }
+    throw std::runtime_error("Error: Device " + device + " is not held by the daemon.");
+}
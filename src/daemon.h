@@ -0,0 +1,109 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <csignal>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "flasher.h"
+#include "daemonjob.h"
+
+// Programmer held open by the daemon
+struct DaemonSession {
+    std::string device;                 // path to the serial device
+    std::unique_ptr<Flasher> flasher;   // open flasher; empty when the device needs to be reopened
+    uint16_t devid = 0;                 // cached device ID of the chip
+    size_t romsize = 0;                 // cached size of the chip in bytes
+    std::mutex mtx;                     // serialises jobs on this device
+};
+
+class Daemon {
+private:
+    std::string socket_path;                                // path of the Unix domain socket
+    SerialConfig transport;                                 // settings of the serial transport
+    std::vector<std::unique_ptr<DaemonSession>> sessions;   // one session per programmer
+    int listen_fd = -1;                                     // listening socket
+    std::mutex clients_mtx;                                 // guards active_clients
+    std::condition_variable clients_cv;                     // signalled when a client is done
+    unsigned int active_clients = 0;                        // number of clients being served
+
+public:
+    /**
+     * Constructor for the Daemon class.
+     * @param socket_path Path of the Unix domain socket to listen on.
+     * @param devices Paths to the serial devices to keep open.
+     * @param transport Settings of the serial transport.
+     */
+    Daemon(const std::string& socket_path, const std::vector<std::string>& devices, const SerialConfig& transport);
+
+    /**
+     * Destructor for the Daemon class; removes the socket.
+     */
+    ~Daemon();
+
+    /**
+     * Accepts and runs jobs until stop is set.
+     * @param stop Flag that ends the loop, e.g. set from a signal handler.
+     */
+    void run(const volatile sig_atomic_t& stop);
+
+private:
+    /**
+     * Opens the device of a session and caches the identity of the chip.
+     * @param session Session to open.
+     * @param out Stream to write progress to.
+     */
+    void open_session(DaemonSession& session, std::ostream& out);
+
+    /**
+     * Reads a job from a client, runs it and streams the output back.
+     * @param fd Connected client socket.
+     */
+    void handle_client(int fd);
+
+    /**
+     * Runs a job on a session.
+     * @param session Session to run the job on.
+     * @param job Job to run.
+     * @param out Stream to write progress to.
+     * @return True if the job succeeded, false otherwise.
+     */
+    bool run_job(DaemonSession& session, const DaemonJob& job, std::ostream& out);
+
+    /**
+     * Lists the sessions and the cached identity of their chips.
+     * @param out Stream to write the list to.
+     */
+    void print_sessions(std::ostream& out);
+
+    /**
+     * Finds the session of a device.
+     * @param device Path to the serial device; empty selects the first session.
+     * @return Session of the device.
+     * @throws std::runtime_error if the device is not held by the daemon.
+     */
+    DaemonSession& find_session(const std::string& device);
+};
@@ -0,0 +1,88 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include <iostream>
+#include <csignal>
+#include <tclap/CmdLine.h>
+
+#include "config.h"
+#include "daemon.h"
+#include "serialport.h"
+
+static volatile sig_atomic_t stop = 0;
+
+static void handle_signal(int) {
+    stop = 1;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        TCLAP::CmdLine cmd("Keep Pico SST39SF0x0 programmers open and run jobs submitted over a socket", ' ', PROGRAM_VERSION);
+
+        TCLAP::ValueArg<std::string> arg_socket("s","socket","Unix domain socket to listen on",false,DAEMON_SOCKET,"path");
+        TCLAP::MultiArg<std::string> arg_device("","device","Serial device of a programmer, skips device discovery",false,"path");
+        TCLAP::ValueArg<std::string> arg_transport("","transport","Transport configuration file (key=value lines)",false,"","filename");
+        cmd.add(arg_socket);
+        cmd.add(arg_device);
+        cmd.add(arg_transport);
+        cmd.parse(argc, argv);
+
+        std::cout << "--------------------------------------------------------------" << std::endl;
+        std::cout << "Executing picoflashd v." << PROGRAM_VERSION << std::endl;
+        std::cout << "Author:  Ivo Filot <ivo@ivofilot.nl>" << std::endl;
+        std::cout << "Github:  https://github.com/ifilot/pico-flasher-cli" << std::endl;
+        std::cout << "--------------------------------------------------------------" << std::endl;
+
+        SerialConfig transport;
+        if(arg_transport.isSet()) {
+            transport.load(arg_transport.getValue());
+        }
+
+        std::vector<std::string> devices = arg_device.getValue();
+        if(devices.empty()) {
+            SerialPort sp;
+            for(const auto& device : sp.find_devices()) {
+                devices.push_back(device.device_path);
+            }
+        }
+        if(devices.empty()) {
+            throw std::runtime_error("Error: No valid serial device found. Did you connect the PICO Flasher?");
+        }
+
+        Daemon daemon(arg_socket.getValue(), devices, transport);
+
+        // interrupt accept on shutdown
+        struct sigaction sa = {};
+        sa.sa_handler = handle_signal;
+        sigaction(SIGINT, &sa, nullptr);
+        sigaction(SIGTERM, &sa, nullptr);
+
+        daemon.run(stop);
+
+        return 0;
+    } catch (TCLAP::ArgException &e) {
+        std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+        return -1;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,110 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "daemonclient.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Submits a job to a running daemon and relays its output.
+ * @param socket_path Path of the Unix domain socket of the daemon.
+ * @param job Job to submit.
+ * @param out Stream to relay the output of the job to.
+ * @return True if the job succeeded, false otherwise.
+ * @throws std::runtime_error if the daemon cannot be reached.
+ */
+bool DaemonClient::submit(const std::string& socket_path, const DaemonJob& job, std::ostream& out) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if(socket_path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Error: Socket path too long: " + socket_path);
+    }
+    std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        std::string error = std::strerror(errno);
+        if(fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Error: Cannot reach picoflashd on " + socket_path + ": " + error);
+    }
+
+    std::string request = job.to_string() + "\n";
+    size_t written = 0;
+    while(written < request.size()) {
+        ssize_t n = send(fd, request.data() + written, request.size() - written, MSG_NOSIGNAL);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            throw std::runtime_error(std::string("Error sending job: ") + std::strerror(errno));
+        }
+        written += n;
+    }
+
+    // relay the output as it arrives; the last line holds the status of the job
+    const std::string status_prefix = DAEMON_STATUS;
+    std::string pending;
+    std::string status;
+    char chunk[1024];
+    while(true) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            break;
+        }
+        pending.append(chunk, n);
+
+        size_t pos;
+        while((pos = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, pos + 1);
+            pending.erase(0, pos + 1);
+            if(line.compare(0, status_prefix.size(), status_prefix) == 0) {
+                status = line.substr(0, line.size() - 1);
+            } else {
+                out << line;
+            }
+        }
+
+        // partial lines such as progress indicators are relayed right away
+        if(!pending.empty() && pending[0] != '@') {
+            out << pending;
+            pending.clear();
+        }
+        out.flush();
+    }
+    close(fd);
+    out << pending;
+
+    if(status.empty()) {
+        throw std::runtime_error("Error: Connection to picoflashd lost before the job finished.");
+    }
+    return status == DAEMON_STATUS_OK;
+}
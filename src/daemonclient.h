@@ -0,0 +1,40 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "daemonjob.h"
+
+class DaemonClient {
+public:
+    /**
+     * Submits a job to a running daemon and relays its output.
+     * @param socket_path Path of the Unix domain socket of the daemon.
+     * @param job Job to submit.
+     * @param out Stream to relay the output of the job to.
+     * @return True if the job succeeded, false otherwise.
+     * @throws std::runtime_error if the daemon cannot be reached.
+     */
+    static bool submit(const std::string& socket_path, const DaemonJob& job, std::ostream& out = std::cout);
+};
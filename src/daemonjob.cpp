@@ -0,0 +1,83 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "daemonjob.h"
+
+#include <sstream>
+#include <stdexcept>
+
+/**
+ * Converts the job to its wire format.
+ * @return Job as a single line, without line terminator.
+ */
+std::string DaemonJob::to_string() const {
+    std::ostringstream str;
+    str << "operation=" << this->operation
+        << "\tfilename=" << this->filename
+        << "\tdevice=" << this->device
+        << "\tbank=" << this->bank
+        << "\tdiff=" << this->diff
+        << "\tskip_blank=" << this->skip_blank
+        << "\tpad_ff=" << this->pad_ff
+        << "\tpipelined=" << this->pipelined;
+    return str.str();
+}
+
+/**
+ * Parses a job from its wire format.
+ * @param line Job as a single line.
+ * @return Parsed job.
+ * @throws std::runtime_error on unknown keys.
+ */
+DaemonJob DaemonJob::parse(const std::string& line) {
+    DaemonJob job;
+    std::stringstream fields(line);
+    std::string field;
+    while(std::getline(fields, field, '\t')) {
+        size_t pos = field.find('=');
+        if(pos == std::string::npos) {
+            throw std::runtime_error("Error: Malformed job field: " + field);
+        }
+        std::string key = field.substr(0, pos);
+        std::string value = field.substr(pos + 1);
+
+        if(key == "operation") {
+            job.operation = value;
+        } else if(key == "filename") {
+            job.filename = value;
+        } else if(key == "device") {
+            job.device = value;
+        } else if(key == "bank") {
+            job.bank = std::stoi(value);
+        } else if(key == "diff") {
+            job.diff = (value == "1");
+        } else if(key == "skip_blank") {
+            job.skip_blank = (value == "1");
+        } else if(key == "pad_ff") {
+            job.pad_ff = (value == "1");
+        } else if(key == "pipelined") {
+            job.pipelined = (value == "1");
+        } else {
+            throw std::runtime_error("Error: Unknown job field: " + key);
+        }
+    }
+    return job;
+}
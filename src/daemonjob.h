@@ -0,0 +1,55 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <string>
+
+#define DAEMON_SOCKET       "/tmp/picoflashd.sock"
+#define DAEMON_STATUS       "@@PICOFLASHD "
+#define DAEMON_STATUS_OK    DAEMON_STATUS "OK"
+#define DAEMON_STATUS_ERROR DAEMON_STATUS "ERROR "
+
+// Job submitted to picoflashd; sent as a single line of tab-separated key=value pairs
+struct DaemonJob {
+    std::string operation;      // info, erase, write, verify or read
+    std::string filename;       // input or output file (absolute path or URL)
+    std::string device;         // serial device; empty selects the first device
+    int bank = -1;              // bank to write or verify; -1 for the whole chip
+    bool diff = false;          // differential write
+    bool skip_blank = false;    // do not transfer blank sectors
+    bool pad_ff = false;        // pad short images with 0xFF
+    bool pipelined = false;     // use the pipelined flash engine
+
+    /**
+     * Converts the job to its wire format.
+     * @return Job as a single line, without line terminator.
+     */
+    std::string to_string() const;
+
+    /**
+     * Parses a job from its wire format.
+     * @param line Job as a single line.
+     * @return Parsed job.
+     * @throws std::runtime_error on unknown keys.
+     */
+    static DaemonJob parse(const std::string& line);
+};
@@ -0,0 +1,398 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "emulator.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <termios.h>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+
+#include "config.h"
+#include "crc16.h"
+
+// typical erase and program times of the SST39SF0x0 in microseconds
+#define TIME_CHIP_ERASE     70000
+#define TIME_SECTOR_ERASE   18000
+#define TIME_BYTE_PROGRAM   14
+
+namespace {
+    // thrown when the command loop is asked to stop
+    struct EmulatorStopped {};
+
+    /**
+     * Parses the hexadecimal argument of a command.
+     * @param text Argument to parse.
+     * @param value Receives the parsed number.
+     * @return True if the argument only consists of hexadecimal digits.
+     */
+    bool parse_hex(const std::string& text, unsigned int& value) {
+        if(text.empty() || !std::all_of(text.begin(), text.end(), [](char c) { return std::isxdigit((unsigned char)c); })) {
+            return false;
+        }
+        value = std::stoul(text, nullptr, 16);
+        return true;
+    }
+}
+
+/**
+ * Constructor for the Emulator class.
+ * @param config Settings of the emulated programmer.
+ */
+Emulator::Emulator(const EmulatorConfig& config) :
+    config(config),
+    rng(config.seed) {
+
+    switch(config.devid) {
+        case 0xBFB7:
+            this->flash.assign(512 * 1024, 0xFF);
+        break;
+        case 0xBFB6:
+            this->flash.assign(256 * 1024, 0xFF);
+        break;
+        case 0xBFB5:
+            this->flash.assign(128 * 1024, 0xFF);
+        break;
+        default:
+            throw std::logic_error("Error: Unknown device ID.");
+    }
+}
+
+/**
+ * Creates the pseudo-terminal.
+ * @return Path to the slave side, to be opened by picoflash.
+ */
+const std::string& Emulator::open_pty() {
+    this->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(this->master < 0 || grantpt(this->master) != 0 || unlockpt(this->master) != 0) {
+        throw std::runtime_error(std::string("Error creating pseudo-terminal: ") + std::strerror(errno));
+    }
+    this->slave_path = ptsname(this->master);
+
+    // keep the slave side open ourselves, such that reads on the master do
+    // not fail when a client closes the port
+    this->slave = open(this->slave_path.c_str(), O_RDWR | O_NOCTTY);
+    if(this->slave < 0) {
+        throw std::runtime_error(std::string("Error opening pseudo-terminal: ") + std::strerror(errno));
+    }
+
+    struct termios tty;
+    tcgetattr(this->slave, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(this->slave, TCSANOW, &tty);
+
+    return this->slave_path;
+}
+
+/**
+ * Loads the contents of the emulated chip from a file.
+ * @param filename Name of the file to read.
+ */
+void Emulator::load_image(const std::string& filename) {
+    std::ifstream infile(filename, std::ios::binary);
+    if(!infile) {
+        throw std::runtime_error("Error opening file.");
+    }
+    infile.read(reinterpret_cast<char*>(this->flash.data()), this->flash.size());
+}
+
+/**
+ * Stores the contents of the emulated chip in a file.
+ * @param filename Name of the file to write.
+ */
+void Emulator::save_image(const std::string& filename) const {
+    std::ofstream outfile(filename, std::ios::binary);
+    if(!outfile) {
+        throw std::runtime_error("Error opening file.");
+    }
+    outfile.write(reinterpret_cast<const char*>(this->flash.data()), this->flash.size());
+}
+
+/**
+ * Processes commands until stop is set.
+ * @param stop Flag that ends the loop, e.g. set from a signal handler.
+ */
+void Emulator::run(const volatile sig_atomic_t& stop) {
+    this->stop = &stop;
+    if(this->config.link_latency_us > 0) {
+        this->courier = std::thread(&Emulator::deliver, this);
+    }
+    try {
+        while(!stop) {
+            std::vector<uint8_t> cmd = this->receive(8);
+            this->handle_command(std::string(cmd.begin(), cmd.end()));
+        }
+    } catch(const EmulatorStopped&) {
+        // regular shutdown
+    }
+    if(this->courier.joinable()) {
+        this->courier.join();
+    }
+}
+
+/**
+ * Destructor for the Emulator class.
+ */
+Emulator::~Emulator() {
+    if(this->slave >= 0) {
+        close(this->slave);
+    }
+    if(this->master >= 0) {
+        close(this->master);
+    }
+}
+
+/**********************************************************************************
+ * PRIVATE FUNCTIONS
+ **********************************************************************************/
+
+/**
+ * Processes a single command.
+ * @param cmd Eight-character command.
+ */
+void Emulator::handle_command(const std::string& cmd) {
+    if(this->config.verbose) {
+        std::cerr << "> " << cmd << std::endl;
+    }
+
+    this->delay(this->config.latency_us);
+
+    // a dropped reply is still processed, only the response is lost
+    bool drop = this->fault(this->config.drop_rate);
+    std::vector<uint8_t> reply(cmd.begin(), cmd.end());
+    unsigned int arg = 0;     // hexadecimal argument of ESST, WRSECT and RDBANK
+
+    if(cmd == "READINFO") {
+        std::string info = "PICOSST39-EMU   ";
+        reply.insert(reply.end(), info.begin(), info.end());
+    } else if(cmd == "DEVIDSST") {
+        reply.push_back(this->config.devid >> 8);
+        reply.push_back(this->config.devid & 0xFF);
+    } else if(cmd == "ERASEALL") {
+        std::fill(this->flash.begin(), this->flash.end(), 0xFF);
+        unsigned int polls = 1;
+        if(this->config.chip_timing) {
+            this->delay(TIME_CHIP_ERASE);
+            polls = TIME_CHIP_ERASE / 100;
+        }
+        reply.push_back(polls >> 8);
+        reply.push_back(polls & 0xFF);
+    } else if(cmd.compare(0, 4, "ESST") == 0 && parse_hex(cmd.substr(4), arg)) {
+        unsigned int sector = arg / 0x10;
+        if((sector + 1) * SECTORSIZE <= this->flash.size()) {
+            std::fill(this->flash.begin() + sector * SECTORSIZE, this->flash.begin() + (sector + 1) * SECTORSIZE, 0xFF);
+        }
+        unsigned int polls = 1;
+        if(this->config.chip_timing) {
+            this->delay(TIME_SECTOR_ERASE);
+            polls = TIME_SECTOR_ERASE / 100;
+        }
+        reply.push_back(polls >> 8);
+        reply.push_back(polls & 0xFF);
+    } else if(cmd.compare(0, 6, "WRSECT") == 0 && parse_hex(cmd.substr(6), arg)) {
+        // the echo is sent before the sector data is received
+        if(!drop) {
+            this->send(reply);
+        }
+        reply.clear();
+
+        unsigned int sector = arg;
+        std::vector<uint8_t> data = this->receive(SECTORSIZE);
+        uint16_t crc = CRC16::xmodem(data);
+
+        // programming can only clear bits
+        if((sector + 1) * SECTORSIZE <= this->flash.size()) {
+            if(this->fault(this->config.write_error_rate)) {
+                data[this->rng() % SECTORSIZE] |= 0x01;
+            }
+            for(unsigned int i=0; i<SECTORSIZE; i++) {
+                this->flash[sector * SECTORSIZE + i] &= data[i];
+            }
+        }
+        if(this->config.chip_timing) {
+            this->delay(SECTORSIZE * TIME_BYTE_PROGRAM);
+        }
+        if(this->fault(this->config.crc_error_rate)) {
+            crc ^= 0x0001;
+        }
+
+        // the checksum is sent least significant byte first
+        reply.push_back(crc & 0xFF);
+        reply.push_back(crc >> 8);
+    } else if(cmd.compare(0, 6, "RDBANK") == 0 && parse_hex(cmd.substr(6), arg)) {
+        unsigned int bank = arg;
+        if((bank + 1) * BANKSIZE <= this->flash.size()) {
+            reply.insert(reply.end(), this->flash.begin() + bank * BANKSIZE, this->flash.begin() + (bank + 1) * BANKSIZE);
+        } else {
+            reply.insert(reply.end(), BANKSIZE, 0xFF);
+        }
+        if(this->fault(this->config.read_error_rate)) {
+            reply[8 + this->rng() % BANKSIZE] ^= 1 << (this->rng() % 8);
+        }
+    } else if(this->config.verbose) {
+        // unknown and malformed commands are only echoed
+        std::cerr << "Unknown command: " << cmd << std::endl;
+    }
+
+    if(drop) {
+        if(this->config.verbose) {
+            std::cerr << "Dropping reply to " << cmd << std::endl;
+        }
+        return;
+    }
+    this->send(reply);
+}
+
+/**
+ * Receives a number of bytes from the client.
+ * @param size Number of bytes.
+ * @return Received bytes.
+ */
+std::vector<uint8_t> Emulator::receive(size_t size) {
+    uint8_t chunk[4096];
+    while(this->buffer.size() < size) {
+        this->wait_ready(POLLIN);
+        ssize_t n = read(this->master, chunk, sizeof(chunk));
+        if(n < 0) {
+            if(errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Error reading from pseudo-terminal: ") + std::strerror(errno));
+        }
+        this->buffer.insert(this->buffer.end(), chunk, chunk + n);
+    }
+
+    this->delay(this->config.bandwidth > 0.0 ? size / this->config.bandwidth * 1e6 : 0.0);
+
+    std::vector<uint8_t> data(this->buffer.begin(), this->buffer.begin() + size);
+    this->buffer.erase(this->buffer.begin(), this->buffer.begin() + size);
+    return data;
+}
+
+/**
+ * Sends bytes to the client, honouring the configured bandwidth.
+ * @param data Bytes to send.
+ */
+void Emulator::send(const std::vector<uint8_t>& data) {
+    this->delay(this->config.bandwidth > 0.0 ? data.size() / this->config.bandwidth * 1e6 : 0.0);
+
+    // with a link latency the reply travels on its own, such that the next
+    // command can be processed while it is underway, as on a USB link
+    if(this->config.link_latency_us > 0) {
+        std::lock_guard<std::mutex> lock(this->outbox_mutex);
+        this->outbox.emplace_back(std::chrono::steady_clock::now() + std::chrono::microseconds(this->config.link_latency_us), data);
+        this->outbox_cv.notify_one();
+        return;
+    }
+
+    this->write_all(data);
+}
+
+/**
+ * Writes bytes to the pseudo-terminal.
+ * @param data Bytes to write.
+ */
+void Emulator::write_all(const std::vector<uint8_t>& data) const {
+    size_t written = 0;
+    while(written < data.size()) {
+        this->wait_ready(POLLOUT);
+        ssize_t n = write(this->master, data.data() + written, data.size() - written);
+        if(n < 0) {
+            if(errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Error writing to pseudo-terminal: ") + std::strerror(errno));
+        }
+        written += n;
+    }
+}
+
+/**
+ * Delivers the replies in the outbox once their link latency has passed;
+ * runs on the courier thread.
+ */
+void Emulator::deliver() {
+    try {
+        while(!*this->stop) {
+            std::unique_lock<std::mutex> lock(this->outbox_mutex);
+            // the stop flag is set from a signal handler, so poll it regularly
+            if(!this->outbox_cv.wait_for(lock, std::chrono::milliseconds(100), [this] { return !this->outbox.empty(); })) {
+                continue;
+            }
+            auto [arrival, data] = std::move(this->outbox.front());
+            this->outbox.pop_front();
+            lock.unlock();
+
+            std::this_thread::sleep_until(arrival);
+            this->write_all(data);
+        }
+    } catch(const EmulatorStopped&) {
+        // regular shutdown
+    }
+}
+
+/**
+ * Waits until the pseudo-terminal is ready, checking the stop flag
+ * regularly such that a client that went away cannot block shutdown.
+ * @param events Events to wait for, POLLIN or POLLOUT.
+ */
+void Emulator::wait_ready(short events) const {
+    while(true) {
+        if(*this->stop) {
+            throw EmulatorStopped();
+        }
+        struct pollfd pfd = {this->master, events, 0};
+        if(poll(&pfd, 1, 100) > 0) {
+            return;
+        }
+    }
+}
+
+/**
+ * Delays for a number of microseconds.
+ * @param us Delay in microseconds.
+ */
+void Emulator::delay(double us) const {
+    if(us > 0.0) {
+        std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(us));
+    }
+}
+
+/**
+ * Draws whether a fault with the given probability occurs.
+ * @param rate Probability of the fault.
+ * @return True if the fault occurs.
+ */
+bool Emulator::fault(double rate) {
+    if(rate <= 0.0) {
+        return false;
+    }
+    return std::uniform_real_distribution<double>(0.0, 1.0)(this->rng) < rate;
+}
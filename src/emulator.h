@@ -0,0 +1,154 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <csignal>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Settings of the emulated programmer
+struct EmulatorConfig {
+    uint16_t devid = 0xBFB7;            // device ID of the emulated chip
+    unsigned int latency_us = 0;        // delay before answering a command
+    unsigned int link_latency_us = 0;   // delay of replies in transit, not holding up further commands
+    double bandwidth = 0.0;             // transfer rate in bytes per second; 0 is unlimited
+    bool chip_timing = false;           // simulate erase and program times of the chip
+    double drop_rate = 0.0;             // probability that the reply to a command is lost
+    double crc_error_rate = 0.0;        // probability that a sector write reports a wrong checksum
+    double read_error_rate = 0.0;       // probability that a bank read contains a flipped bit
+    double write_error_rate = 0.0;      // probability that a sector is programmed incorrectly
+    unsigned int seed = 0;              // seed for fault injection
+    bool verbose = false;               // log every command
+};
+
+class Emulator {
+private:
+    EmulatorConfig config;              // settings of the emulated programmer
+    std::vector<uint8_t> flash;         // contents of the emulated chip
+    int master = -1;                    // master side of the pseudo-terminal
+    int slave = -1;                     // slave side, kept open to survive client disconnects
+    std::string slave_path;             // path to the slave side
+    std::vector<uint8_t> buffer;        // received bytes not yet processed
+    std::mt19937 rng;                   // random number generator for fault injection
+    const volatile sig_atomic_t* stop = nullptr;    // flag that ends the command loop
+
+    // replies in transit when a link latency is set, with their time of arrival
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::vector<uint8_t>>> outbox;
+    std::mutex outbox_mutex;            // guards outbox
+    std::condition_variable outbox_cv;  // signals a new reply in the outbox
+    std::thread courier;                // delivers the replies in the outbox
+
+public:
+    /**
+     * Constructor for the Emulator class.
+     * @param config Settings of the emulated programmer.
+     */
+    Emulator(const EmulatorConfig& config);
+
+    /**
+     * Creates the pseudo-terminal.
+     * @return Path to the slave side, to be opened by picoflash.
+     */
+    const std::string& open_pty();
+
+    /**
+     * Loads the contents of the emulated chip from a file.
+     * @param filename Name of the file to read.
+     */
+    void load_image(const std::string& filename);
+
+    /**
+     * Stores the contents of the emulated chip in a file.
+     * @param filename Name of the file to write.
+     */
+    void save_image(const std::string& filename) const;
+
+    /**
+     * Processes commands until stop is set.
+     * @param stop Flag that ends the loop, e.g. set from a signal handler.
+     */
+    void run(const volatile sig_atomic_t& stop);
+
+    /**
+     * Destructor for the Emulator class.
+     */
+    ~Emulator();
+
+private:
+    /**
+     * Processes a single command.
+     * @param cmd Eight-character command.
+     */
+    void handle_command(const std::string& cmd);
+
+    /**
+     * Receives a number of bytes from the client.
+     * @param size Number of bytes.
+     * @return Received bytes.
+     */
+    std::vector<uint8_t> receive(size_t size);
+
+    /**
+     * Sends bytes to the client, honouring the configured bandwidth.
+     * @param data Bytes to send.
+     */
+    void send(const std::vector<uint8_t>& data);
+
+    /**
+     * Writes bytes to the pseudo-terminal.
+     * @param data Bytes to write.
+     */
+    void write_all(const std::vector<uint8_t>& data) const;
+
+    /**
+     * Delivers the replies in the outbox once their link latency has passed;
+     * runs on the courier thread.
+     */
+    void deliver();
+
+    /**
+     * Waits until the pseudo-terminal is ready, checking the stop flag
+     * regularly such that a client that went away cannot block shutdown.
+     * @param events Events to wait for, POLLIN or POLLOUT.
+     */
+    void wait_ready(short events) const;
+
+    /**
+     * Delays for a number of microseconds.
+     * @param us Delay in microseconds.
+     */
+    void delay(double us) const;
+
+    /**
+     * Draws whether a fault with the given probability occurs.
+     * @param rate Probability of the fault.
+     * @return True if the fault occurs.
+     */
+    bool fault(double rate);
+};
@@ -0,0 +1,130 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include <iostream>
+#include <csignal>
+#include <tclap/CmdLine.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "emulator.h"
+
+static volatile sig_atomic_t stop = 0;
+
+static void handle_signal(int) {
+    stop = 1;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        TCLAP::CmdLine cmd("Emulate a Pico SST39SF0x0 programmer on a pseudo-terminal", ' ', PROGRAM_VERSION);
+
+        TCLAP::ValueArg<std::string> arg_chip("c","chip","Emulated chip: 010, 020 or 040",false,"040","chip");
+        TCLAP::ValueArg<std::string> arg_image("i","image","File to load the chip contents from",false,"","filename");
+        TCLAP::ValueArg<std::string> arg_save("o","output","File to store the chip contents in on exit",false,"","filename");
+        TCLAP::ValueArg<std::string> arg_link("l","link","Create a symbolic link to the pseudo-terminal",false,"","path");
+        TCLAP::ValueArg<unsigned int> arg_latency("","latency","Delay before answering a command in microseconds",false,0,"us");
+        TCLAP::ValueArg<unsigned int> arg_link_latency("","link-latency","Delay of replies in transit in microseconds, without holding up further commands",false,0,"us");
+        TCLAP::ValueArg<double> arg_bandwidth("","bandwidth","Transfer rate in bytes per second (0 is unlimited)",false,0.0,"bytes/s");
+        TCLAP::SwitchArg arg_chip_timing("t","chip-timing","Simulate typical erase and program times of the chip",false);
+        TCLAP::ValueArg<double> arg_drop_rate("","drop-rate","Probability that the reply to a command is lost",false,0.0,"p");
+        TCLAP::ValueArg<double> arg_crc_error_rate("","crc-error-rate","Probability that a sector write returns a wrong checksum",false,0.0,"p");
+        TCLAP::ValueArg<double> arg_read_error_rate("","read-error-rate","Probability that a bank read contains a flipped bit",false,0.0,"p");
+        TCLAP::ValueArg<double> arg_write_error_rate("","write-error-rate","Probability that a sector is programmed incorrectly",false,0.0,"p");
+        TCLAP::ValueArg<unsigned int> arg_seed("","seed","Seed for fault injection",false,0,"seed");
+        TCLAP::SwitchArg arg_verbose("v","verbose","Log every command",false);
+        cmd.add(arg_chip);
+        cmd.add(arg_image);
+        cmd.add(arg_save);
+        cmd.add(arg_link);
+        cmd.add(arg_latency);
+        cmd.add(arg_link_latency);
+        cmd.add(arg_bandwidth);
+        cmd.add(arg_chip_timing);
+        cmd.add(arg_drop_rate);
+        cmd.add(arg_crc_error_rate);
+        cmd.add(arg_read_error_rate);
+        cmd.add(arg_write_error_rate);
+        cmd.add(arg_seed);
+        cmd.add(arg_verbose);
+        cmd.parse(argc, argv);
+
+        EmulatorConfig config;
+        if(arg_chip.getValue() == "010") {
+            config.devid = 0xBFB5;
+        } else if(arg_chip.getValue() == "020") {
+            config.devid = 0xBFB6;
+        } else if(arg_chip.getValue() == "040") {
+            config.devid = 0xBFB7;
+        } else {
+            throw std::runtime_error("Error: Chip must be one of 010, 020 or 040.");
+        }
+        config.latency_us = arg_latency.getValue();
+        config.link_latency_us = arg_link_latency.getValue();
+        config.bandwidth = arg_bandwidth.getValue();
+        config.chip_timing = arg_chip_timing.getValue();
+        config.drop_rate = arg_drop_rate.getValue();
+        config.crc_error_rate = arg_crc_error_rate.getValue();
+        config.read_error_rate = arg_read_error_rate.getValue();
+        config.write_error_rate = arg_write_error_rate.getValue();
+        config.seed = arg_seed.getValue();
+        config.verbose = arg_verbose.getValue();
+
+        Emulator emulator(config);
+        if(arg_image.isSet()) {
+            emulator.load_image(arg_image.getValue());
+        }
+        const std::string& path = emulator.open_pty();
+
+        if(arg_link.isSet()) {
+            unlink(arg_link.getValue().c_str());
+            if(symlink(path.c_str(), arg_link.getValue().c_str()) != 0) {
+                throw std::runtime_error("Error creating link " + arg_link.getValue() + ".");
+            }
+        }
+
+        // interrupt blocking reads on shutdown
+        struct sigaction sa = {};
+        sa.sa_handler = handle_signal;
+        sigaction(SIGINT, &sa, nullptr);
+        sigaction(SIGTERM, &sa, nullptr);
+
+        std::cout << "Emulating SST39SF" << arg_chip.getValue() << " on: " << path << std::endl;
+        std::cout << "Connect using: picoflash --device " << (arg_link.isSet() ? arg_link.getValue() : path) << std::endl;
+
+        emulator.run(stop);
+
+        if(arg_link.isSet()) {
+            unlink(arg_link.getValue().c_str());
+        }
+        if(arg_save.isSet()) {
+            emulator.save_image(arg_save.getValue());
+        }
+
+        return 0;
+    } catch (TCLAP::ArgException &e) {
+        std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+        return -1;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,250 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "eventlog.h"
+
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+/**
+ * Constructor for the JsonEvent class.
+ * @param event Type of the event, stored in the "event" field.
+ */
+JsonEvent::JsonEvent(const std::string& event) {
+    this->field("event", event);
+}
+
+/**
+ * Adds a string field.
+ * @param key Name of the field.
+ * @param value Value of the field.
+ * @return This event.
+ */
+JsonEvent& JsonEvent::field(const std::string& key, const std::string& value) {
+    this->append(key, quote(value));
+    return *this;
+}
+
+/**
+ * Quotes a string for use in JSON, escaping all special characters.
+ * @param value String to quote.
+ * @return JSON string literal.
+ */
+std::string JsonEvent::quote(const std::string& value) {
+    std::string escaped = "\"";
+    for(char c : value) {
+        switch(c) {
+            case '"':  escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if((unsigned char)c < 0x20) {
+                    char buffer[8];
+                    snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    escaped += buffer;
+                } else {
+                    escaped += c;
+                }
+        }
+    }
+    escaped += "\"";
+    return escaped;
+}
+
+/**
+ * Adds an integer field.
+ * @param key Name of the field.
+ * @param value Value of the field.
+ * @return This event.
+ */
+JsonEvent& JsonEvent::field(const std::string& key, uint64_t value) {
+    this->append(key, std::to_string(value));
+    return *this;
+}
+
+/**
+ * Adds a floating point field.
+ * @param key Name of the field.
+ * @param value Value of the field.
+ * @return This event.
+ */
+JsonEvent& JsonEvent::field(const std::string& key, double value) {
+    // JSON has no representation for infinity or NaN
+    if(!std::isfinite(value)) {
+        this->append(key, "null");
+        return *this;
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.1f", value);
+    this->append(key, buffer);
+    return *this;
+}
+
+/**
+ * Adds a boolean field.
+ * @param key Name of the field.
+ * @param value Value of the field.
+ * @return This event.
+ */
+JsonEvent& JsonEvent::field(const std::string& key, bool value) {
+    this->append(key, value ? "true" : "false");
+    return *this;
+}
+
+/**
+ * Adds a 16-bit checksum as hexadecimal string.
+ * @param key Name of the field.
+ * @param value Checksum.
+ * @return This event.
+ */
+JsonEvent& JsonEvent::crc(const std::string& key, uint16_t value) {
+    char buffer[8];
+    snprintf(buffer, sizeof(buffer), "%04X", value);
+    return this->field(key, std::string(buffer));
+}
+
+/**
+ * Appends a key with an already formatted value.
+ * @param key Name of the field.
+ * @param value JSON representation of the value.
+ */
+void JsonEvent::append(const std::string& key, const std::string& value) {
+    if(!this->fields.empty()) {
+        this->fields += ",";
+    }
+    this->fields += "\"" + key + "\":" + value;
+}
+
+/**
+ * Constructor for the EventLog class.
+ * @param out Stream to write the events to.
+ */
+EventLog::EventLog(std::ostream& out) :
+    out(&out),
+    start(std::chrono::steady_clock::now()) {}
+
+/**
+ * Writes an event as is.
+ * @param event Event to write.
+ */
+void EventLog::emit(const JsonEvent& event) {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    *this->out << event.str() << std::endl;
+}
+
+/**
+ * Opens a phase of an operation.
+ * @param phase Name of the phase, e.g. "write".
+ * @param nritems Number of sectors or banks processed in the phase.
+ */
+void EventLog::begin_phase(const std::string& phase, unsigned int nritems) {
+    {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        this->phase = phase;
+        this->phase_start = std::chrono::steady_clock::now();
+        this->phase_items = 0;
+        this->phase_bytes = 0;
+    }
+    this->emit(JsonEvent("phase_begin").field("phase", phase).field("items", nritems));
+}
+
+/**
+ * Writes the event of a sector or bank within the current phase,
+ * adding the phase, size, duration and cumulative throughput.
+ * @param event Event holding the item specific fields.
+ * @param bytes Number of bytes transferred for the item.
+ * @param duration_us Duration of the serial transaction in microseconds.
+ */
+void EventLog::item(JsonEvent event, uint64_t bytes, double duration_us) {
+    std::lock_guard<std::mutex> lock(this->mtx);
+    this->phase_items++;
+    this->phase_bytes += bytes;
+    this->total_bytes += bytes;
+    uint64_t elapsed = elapsed_us(this->phase_start);
+    event.field("phase", this->phase)
+         .field("bytes", bytes)
+         .field("duration_us", (uint64_t)std::llround(duration_us))
+         .field("elapsed_us", elapsed)
+         .field("throughput", throughput(this->phase_bytes, elapsed));
+    *this->out << event.str() << std::endl;
+}
+
+/**
+ * Closes the current phase.
+ */
+void EventLog::end_phase() {
+    JsonEvent event("phase_end");
+    {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        uint64_t elapsed = elapsed_us(this->phase_start);
+        event.field("phase", this->phase)
+             .field("items", this->phase_items)
+             .field("bytes", this->phase_bytes)
+             .field("duration_us", elapsed)
+             .field("throughput", throughput(this->phase_bytes, elapsed));
+    }
+    this->emit(event);
+}
+
+/**
+ * Writes the final summary of the run.
+ * @param operation Operation that was run.
+ * @param result Outcome: "pass", "fail" or "error".
+ * @param message Error message, if any.
+ */
+void EventLog::summary(const std::string& operation, const std::string& result, const std::string& message) {
+    JsonEvent event("summary");
+    {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        uint64_t elapsed = elapsed_us(this->start);
+        event.field("operation", operation)
+             .field("result", result)
+             .field("bytes", this->total_bytes)
+             .field("duration_us", elapsed)
+             .field("throughput", throughput(this->total_bytes, elapsed));
+    }
+    if(!message.empty()) {
+        event.field("message", message);
+    }
+    this->emit(event);
+}
+
+/**
+ * Gets the time since a given moment in microseconds.
+ * @param since Moment to measure from.
+ * @return Elapsed time in microseconds.
+ */
+uint64_t EventLog::elapsed_us(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+/**
+ * Calculates a throughput in bytes per second.
+ * @param bytes Number of bytes.
+ * @param us Duration in microseconds.
+ * @return Throughput in bytes per second.
+ */
+double EventLog::throughput(uint64_t bytes, uint64_t us) {
+    return us > 0 ? bytes * 1e6 / us : 0.0;
+}
@@ -0,0 +1,203 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+/**
+ * Single JSON object, built field by field and written as one line.
+ */
+class JsonEvent {
+private:
+    std::string fields;         // comma-separated key/value pairs
+
+public:
+    /**
+     * Constructor for the JsonEvent class.
+     * @param event Type of the event, stored in the "event" field.
+     */
+    JsonEvent(const std::string& event);
+
+    /**
+     * Adds a string field.
+     * @param key Name of the field.
+     * @param value Value of the field.
+     * @return This event.
+     */
+    JsonEvent& field(const std::string& key, const std::string& value);
+
+    /**
+     * Adds a string field.
+     * @param key Name of the field.
+     * @param value Value of the field.
+     * @return This event.
+     */
+    JsonEvent& field(const std::string& key, const char* value) {
+        return this->field(key, std::string(value));
+    }
+
+    /**
+     * Adds an integer field.
+     * @param key Name of the field.
+     * @param value Value of the field.
+     * @return This event.
+     */
+    JsonEvent& field(const std::string& key, uint64_t value);
+
+    /**
+     * Adds an integer field.
+     * @param key Name of the field.
+     * @param value Value of the field.
+     * @return This event.
+     */
+    JsonEvent& field(const std::string& key, unsigned int value) {
+        return this->field(key, (uint64_t)value);
+    }
+
+    /**
+     * Adds a floating point field.
+     * @param key Name of the field.
+     * @param value Value of the field.
+     * @return This event.
+     */
+    JsonEvent& field(const std::string& key, double value);
+
+    /**
+     * Adds a boolean field.
+     * @param key Name of the field.
+     * @param value Value of the field.
+     * @return This event.
+     */
+    JsonEvent& field(const std::string& key, bool value);
+
+    /**
+     * Adds a 16-bit checksum as hexadecimal string.
+     * @param key Name of the field.
+     * @param value Checksum.
+     * @return This event.
+     */
+    JsonEvent& crc(const std::string& key, uint16_t value);
+
+    /**
+     * Quotes a string for use in JSON, escaping all special characters.
+     * @param value String to quote.
+     * @return JSON string literal.
+     */
+    static std::string quote(const std::string& value);
+
+    /**
+     * Converts the event to a JSON object.
+     * @return JSON object on a single line.
+     */
+    std::string str() const {
+        return "{" + this->fields + "}";
+    }
+
+private:
+    /**
+     * Appends a key with an already formatted value.
+     * @param key Name of the field.
+     * @param value JSON representation of the value.
+     */
+    void append(const std::string& key, const std::string& value);
+};
+
+/**
+ * Stream of machine-readable events in the JSON lines format. Every phase
+ * of an operation (erase, write, verify, ...) is opened and closed by an
+ * event, and every sector or bank within a phase produces an event that
+ * carries the duration of its serial transaction and the throughput of
+ * the phase so far.
+ */
+class EventLog {
+private:
+    std::ostream* out;                                  // stream to write the events to
+    std::mutex mtx;                                     // serializes writes from the pipeline threads
+    std::chrono::steady_clock::time_point start;        // creation of the log
+    std::chrono::steady_clock::time_point phase_start;  // start of the current phase
+    std::string phase;                                  // name of the current phase
+    unsigned int phase_items = 0;                       // items completed in the current phase
+    uint64_t phase_bytes = 0;                           // bytes transferred in the current phase
+    uint64_t total_bytes = 0;                           // bytes transferred in all phases
+
+public:
+    /**
+     * Constructor for the EventLog class.
+     * @param out Stream to write the events to.
+     */
+    EventLog(std::ostream& out);
+
+    /**
+     * Writes an event as is.
+     * @param event Event to write.
+     */
+    void emit(const JsonEvent& event);
+
+    /**
+     * Opens a phase of an operation.
+     * @param phase Name of the phase, e.g. "write".
+     * @param nritems Number of sectors or banks processed in the phase.
+     */
+    void begin_phase(const std::string& phase, unsigned int nritems);
+
+    /**
+     * Writes the event of a sector or bank within the current phase,
+     * adding the phase, size, duration and cumulative throughput.
+     * @param event Event holding the item specific fields.
+     * @param bytes Number of bytes transferred for the item.
+     * @param duration_us Duration of the serial transaction in microseconds.
+     */
+    void item(JsonEvent event, uint64_t bytes, double duration_us);
+
+    /**
+     * Closes the current phase.
+     */
+    void end_phase();
+
+    /**
+     * Writes the final summary of the run.
+     * @param operation Operation that was run.
+     * @param result Outcome: "pass", "fail" or "error".
+     * @param message Error message, if any.
+     */
+    void summary(const std::string& operation, const std::string& result, const std::string& message = "");
+
+private:
+    /**
+     * Gets the time since a given moment in microseconds.
+     * @param since Moment to measure from.
+     * @return Elapsed time in microseconds.
+     */
+    static uint64_t elapsed_us(std::chrono::steady_clock::time_point since);
+
+    /**
+     * Calculates a throughput in bytes per second.
+     * @param bytes Number of bytes.
+     * @param us Duration in microseconds.
+     * @return Throughput in bytes per second.
+     */
+    static double throughput(uint64_t bytes, uint64_t us);
+};
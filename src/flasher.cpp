@@ -20,17 +20,229 @@
 
 #include "flasher.h"
 
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "workqueue.h"
+#include "urlcache.h"
+#include "crc16.h"
+#include "mappedfile.h"
+#include "trace.h"
+
+namespace {
+    // sector prepared for transfer by the staging step
+    struct SectorJob {
+        unsigned int sector;
+        std::span<const uint8_t> chunk;                     // view into the caller's data
+        uint16_t crc16;
+        bool blank;
+    };
+
+    // outcome of a sector transfer
+    struct SectorResult {
+        unsigned int sector;
+        uint16_t crc16;
+        uint16_t checksum;
+        bool blank;
+        double duration;                                    // duration of the transfer in microseconds
+    };
+
+    // bank to be read back from the chip
+    struct BankJob {
+        unsigned int index;                                 // position of the bank in the operation
+        unsigned int bank;
+        std::span<uint8_t> chunk;                           // receives the bank, assigned when it is sent
+    };
+
+    // bank read back from the chip
+    struct BankResult {
+        unsigned int bank;
+        std::span<const uint8_t> chunk;                     // view into a caller-owned buffer
+        double duration;                                    // duration of the transfer in microseconds
+    };
+
+    // bank buffers in use by a pipelined read: window being transferred, PIPELINE_DEPTH
+    // queued and one being handled by the sink; bank i can thus reuse slot i % nrslots
+    unsigned int get_bank_slots(unsigned int window) {
+        return PIPELINE_DEPTH + 1 + window;
+    }
+
+    // reports the outcome of a sector transfer on the event stream
+    void emit_sector(EventLog* events, const SectorResult& result) {
+        if(!events) {
+            return;
+        }
+        JsonEvent event("sector");
+        event.field("index", result.sector).field("skipped", result.blank);
+        if(!result.blank) {
+            event.crc("crc_expected", result.crc16)
+                 .crc("crc_actual", result.checksum)
+                 .field("ok", result.checksum == result.crc16);
+        }
+        events->item(event, result.blank ? 0 : SECTORSIZE, result.duration);
+    }
+
+    // reports the outcome of a bank comparison on the event stream
+    void emit_verify(EventLog* events, const BankResult& result, const std::vector<MismatchRange>& ranges) {
+        if(!events) {
+            return;
+        }
+        events->item(JsonEvent("bank").field("index", result.bank)
+                                      .field("ok", ranges.empty())
+                                      .field("mismatches", (uint64_t)ranges.size()),
+                     BANKSIZE, result.duration);
+    }
+
+    // download in progress, shared between the download thread and the flasher
+    struct StreamBuffer {
+        std::span<uint8_t> data;
+        CURL* curl = nullptr;       // transfer, to query the announced size
+        size_t received = 0;
+        bool done = false;
+        bool aborted = false;       // set by the flasher to end the transfer
+        std::string error;
+        std::mutex mtx;
+        std::condition_variable cv;
+    };
+
+    /**
+     * Reads a file descriptor until its end, e.g. a pipe.
+     * @param fd File descriptor to read.
+     * @param data Receives the data.
+     */
+    void read_all(int fd, std::vector<uint8_t>& data) {
+        data.clear();
+        uint8_t chunk[0x10000];
+        while(true) {
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if(n < 0 && errno == EINTR) {
+                continue;
+            } else if(n < 0) {
+                throw std::runtime_error("Error reading file.");
+            } else if(n == 0) {
+                return;
+            }
+            data.insert(data.end(), chunk, chunk + n);
+        }
+    }
+
+    /**
+     * Writes all data to a file descriptor, e.g. standard output.
+     * @param fd File descriptor to write to.
+     * @param data Data to write.
+     */
+    void write_all(int fd, std::span<const uint8_t> data) {
+        while(!data.empty()) {
+            ssize_t n = write(fd, data.data(), data.size());
+            if(n < 0 && errno == EINTR) {
+                continue;
+            } else if(n < 0) {
+                throw std::runtime_error("Error writing file.");
+            }
+            data = data.subspan(n);
+        }
+    }
+}
+
 /**
  * Constructor for the Flasher class.
+ * @param path Path to the serial device.
+ * @param out Stream to write progress to.
  */
-Flasher::Flasher(const std::string& path) {
-    this->serial = std::make_unique<Serial>();
-    this->serial->open_serial_port(path.c_str());
+Flasher::Flasher(const std::string& path, std::ostream& out, const SerialConfig& config) {
+    this->out = &out;
+    this->path = path;
+    this->open_port(config, out);
+}
 
-    // configure port
-    if (!this->serial->configure_serial_port(B19200)) {
-        this->serial->close_serial_port();
-        throw std::runtime_error("Error configuring serial port.");
+/**
+ * Tries a number of transport settings against the device and keeps
+ * the fastest one that reliably reads back the same data.
+ * @return Selected transport settings.
+ */
+SerialConfig Flasher::probe_transport() {
+    TraceSpan span("probe_transport", "flasher");
+    static const unsigned int nrpings = 8;
+    static const unsigned int nrreads = 3;
+
+    *this->out << "Probing transport settings:" << std::endl;
+
+    // reference read with the current settings
+    auto reference = std::vector<uint8_t>(BANKSIZE);
+    this->serial->read_bank(0, reference);
+    uint16_t devid = this->serial->get_device_id();
+    SerialConfig initial = this->config;
+
+    // the port is reopened for every candidate, silence its status messages
+    std::ostream silent(nullptr);
+    SerialConfig best = initial;
+    double best_time = -1.0;
+    auto chunk = std::vector<uint8_t>(BANKSIZE);
+    for(const auto& candidate : initial.get_probe_candidates()) {
+        *this->out << "  " << candidate.to_string() << ": " << std::flush;
+        double elapsed = 0.0;
+        try {
+            this->serial.reset();
+            this->open_port(candidate, silent);
+
+            // command round trips and bank reads must all return the reference data
+            auto start = std::chrono::steady_clock::now();
+            for(unsigned int i=0; i<nrpings; i++) {
+                if(this->serial->get_device_id() != devid) {
+                    throw std::runtime_error("device ID mismatch");
+                }
+            }
+            for(unsigned int i=0; i<nrreads; i++) {
+                this->serial->read_bank(0, chunk);
+                if(chunk != reference) {
+                    throw std::runtime_error("data mismatch");
+                }
+            }
+            auto stop = std::chrono::steady_clock::now();
+            elapsed = std::chrono::duration<double>(stop - start).count();
+        } catch(const std::exception& e) {
+            *this->out << TEXTRED << "UNRELIABLE" << TEXTWHITE << " (" << e.what() << ")" << std::endl;
+            continue;
+        }
+
+        *this->out << TEXTGREEN << std::fixed << std::setprecision(1) << (elapsed * 1e3) << " ms"
+                   << TEXTWHITE << std::defaultfloat << std::endl;
+        if(best_time < 0.0 || elapsed < best_time) {
+            best = candidate;
+            best_time = elapsed;
+        }
+    }
+
+    this->serial.reset();
+    this->open_port(best, *this->out);
+    *this->out << "Selected transport: " << TEXTBLUE << best.to_string() << TEXTWHITE << std::endl;
+
+    return best;
+}
+
+/**
+ * Gets the size of the chip for a given device ID.
+ * @param devid Device ID of the chip.
+ * @return Size of the chip in bytes.
+ * @throws std::logic_error if the device ID is unknown.
+ */
+size_t Flasher::get_rom_size(uint16_t devid) {
+    switch(devid) {
+        case 0xBFB7:
+            return 512 * 1024;
+        case 0xBFB6:
+            return 256 * 1024;
+        case 0xBFB5:
+            return 128 * 1024;
+        default:
+            throw std::logic_error("Error: Unknown device ID.");
     }
 }
 
@@ -39,7 +251,7 @@ Flasher::Flasher(const std::string& path) {
  * @return Device ID of the chip -if valid-.
  */
 uint16_t Flasher::read_chip_id() {
-    std::cout << "Interfacing with: " << this->serial->read_device_info() << std::endl;
+    *this->out << "Interfacing with: " << this->serial->read_device_info() << std::endl;
     uint16_t devid = this->serial->get_device_id();
 
     std::string devname;
@@ -60,8 +272,8 @@ uint16_t Flasher::read_chip_id() {
                                     + "): Cannot recognize SST39SF0x0 chip.");
         break;
     }
-    std::cout << "Device ID: " << TEXTGREEN << "0x" << std::hex << std::uppercase
-              << devid << TEXTWHITE << " (" << devname << ")" << std::endl;
+    *this->out << "Device ID: " << TEXTGREEN << "0x" << std::hex << std::uppercase
+               << devid << TEXTWHITE << " (" << devname << ")" << std::endl;
     
     return devid;
 }
@@ -70,69 +282,516 @@ uint16_t Flasher::read_chip_id() {
  * Erases the chip.
  */
 void Flasher::erase_chip() {
-    std::cout << "Clearing chip";
+    TraceSpan span("erase_chip", "flasher");
+    *this->out << "Clearing chip";
+    if(this->events) {
+        this->events->begin_phase("erase", 1);
+    }
+    this->io_begin();
     unsigned int nriter = this->serial->erase_chip();
-    std::cout << " - Done (" << nriter << " polls)" << std::endl;
+    double duration = this->io_end();
+    *this->out << " - Done (" << std::dec << nriter << " polls)" << std::endl;
+    if(this->events) {
+        this->events->item(JsonEvent("chip").field("polls", nriter), 0, duration);
+        this->events->end_phase();
+    }
 }
 
 /**
- * Reads data from the chip.
- * @param data Data read from the chip.
+ * Reads data from the chip. Every bank is read directly into the
+ * caller's buffer.
+ * @param data Buffer of the size of the chip that receives the data.
+ * @param on_bank If set, called in order for every bank once it is stored in data.
  */
-void Flasher::read_chip(std::vector<uint8_t>& data) {
-    std::cout << "Reading data:" << std::endl;
+void Flasher::read_chip(std::span<uint8_t> data, const std::function<void(unsigned int)>& on_bank) {
+    TraceSpan span("read_chip", "flasher");
+    this->read_banks(0, data, on_bank);
+}
+
+/**
+ * Reads a number of consecutive banks from the chip, directly into the
+ * caller's buffer.
+ * @param first First bank to read.
+ * @param data Buffer that receives the banks, a multiple of the bank size.
+ * @param on_bank If set, called in order for every bank once it is stored in data.
+ */
+void Flasher::read_banks(unsigned int first, std::span<uint8_t> data, const std::function<void(unsigned int)>& on_bank) {
+    TraceSpan span("read_banks", "flasher");
+    span.arg("first", first);
+    *this->out << "Reading data:" << std::endl;
 
     // read data
-    auto chunk = std::vector<uint8_t>(BANKSIZE);
     unsigned int nrbanks = data.size() / (BANKSIZE);
-    for(unsigned int i=0; i<nrbanks; i++) {
-        std::vector<uint8_t> read_chunk(BANKSIZE);
-        this->serial->read_bank(i, read_chunk);
+    unsigned int last = first + nrbanks - 1;
+    if(this->events) {
+        this->events->begin_phase("read", nrbanks);
+    }
+    this->run_pipeline<BankJob, BankResult>(nrbanks,
+        [first](unsigned int i) {
+            return BankJob{i, first + i, {}};
+        },
+        [this, data, first](BankJob& job) {
+            auto chunk = data.subspan((job.bank - first) * BANKSIZE, BANKSIZE);
+            this->io_begin();
+            this->serial->read_bank(job.bank, chunk);
+            return BankResult{job.bank, chunk, this->io_end()};
+        },
+        [&](BankResult& result) {
+            unsigned int i = result.bank;
+            uint16_t crc16 = CRC16::xmodem(result.chunk);
+            *this->out << std::dec << std::setw(2) << std::setfill('0') << (i+1) << " [" << TEXTBLUE;
+            *this->out << std::hex << std::setw(4) << std::setfill('0') << crc16 << TEXTWHITE << "] " << std::flush;
 
-        std::cout << std::dec << std::setw(2) << std::setfill('0') << (i+1) << " [" << TEXTBLUE;
-        std::cout << std::hex << std::setw(4) << std::setfill('0') << this->crc16_xmodem(read_chunk) << TEXTWHITE << "] " << std::flush;
+            if(this->events) {
+                this->events->item(JsonEvent("bank").field("index", i).crc("crc", crc16), BANKSIZE, result.duration);
+            }
 
-        if((i+1) % 8 == 0) {
-            std::cout << std::endl;
-        } else if(i == nrbanks - 1) {
-            std::cout << std::endl;
-        }
-        std::copy(read_chunk.begin(), read_chunk.end(), data.begin() + (i * BANKSIZE));
+            if((i+1) % 8 == 0) {
+                *this->out << std::endl;
+            } else if(i == last) {
+                *this->out << std::endl;
+            }
+
+            if(on_bank) {
+                on_bank(i);
+            }
+        },
+        [this, data, first](BankJob& job, SerialCommand& command) {
+            job.chunk = data.subspan((job.bank - first) * BANKSIZE, BANKSIZE);
+            this->io_begin();
+            this->serial->prepare_read_bank(job.bank, job.chunk, command);
+            return true;
+        },
+        [this](BankJob& job, const SerialCommand& command) {
+            return BankResult{job.bank, job.chunk, this->io_end(command.issued)};
+        });
+    if(this->events) {
+        this->events->end_phase();
     }
+    this->print_io_gap();
+}
+
+/**
+ * Reads an arbitrary range of bytes from the chip, only reading the
+ * banks that hold part of it.
+ * @param address Chip address of the first byte.
+ * @param data Buffer that receives the bytes.
+ */
+void Flasher::read_range(uint32_t address, std::span<uint8_t> data) {
+    TraceSpan span("read_range", "flasher");
+    span.arg("address", address);
+    span.arg("size", data.size());
+    if(data.empty()) {
+        return;
+    }
+    unsigned int first = address / BANKSIZE;
+    unsigned int last = (address + data.size() - 1) / BANKSIZE;
+
+    // a range of whole banks is read straight into the caller's buffer
+    if(address % BANKSIZE == 0 && data.size() % BANKSIZE == 0) {
+        this->read_banks(first, data);
+        return;
+    }
+
+    std::vector<uint8_t> banks((last - first + 1) * BANKSIZE);
+    this->read_banks(first, banks);
+    auto slice = std::span<const uint8_t>(banks).subspan(address - first * BANKSIZE, data.size());
+    std::copy(slice.begin(), slice.end(), data.begin());
+}
+
+/**
+ * Reads the chip into a file. Every bank is stored in the file as soon
+ * as it has been read, such that an interrupted dump keeps the banks
+ * read so far. A filename of "-" writes the dump to standard output.
+ * @param filename Name of the file to write.
+ * @param romsize Size of the chip in bytes.
+ */
+void Flasher::dump_chip(const std::string& filename, size_t romsize) {
+    TraceSpan span("dump_chip", "flasher");
+    span.arg("filename", filename);
+    if(filename == "-") {
+        std::vector<uint8_t> data(romsize);
+        this->read_chip(data, [&data](unsigned int bank) {
+            write_all(STDOUT_FILENO, std::span<const uint8_t>(data).subspan(bank * BANKSIZE, BANKSIZE));
+        });
+        *this->out << "Writing " << TEXTBLUE << "<stdout>" << TEXTWHITE << " (" << std::dec << romsize << " bytes)" << std::endl;
+        *this->out << "MD5: " << TEXTBLUE << calculate_md5(data) << TEXTWHITE << std::endl;
+        return;
+    }
+
+    // the banks are read straight into the pages of the output file
+    MappedFile file(filename, romsize);
+    size_t nrbytes = 0;
+    try {
+        this->read_chip(file.data(), [&nrbytes](unsigned int bank) {
+            nrbytes = (bank + 1) * BANKSIZE;
+        });
+    } catch(...) {
+        // keep the banks that have been read completely
+        file.truncate(nrbytes);
+        *this->out << TEXTRED << "Dump interrupted" << TEXTWHITE << ", kept " << std::dec << nrbytes
+                   << " bytes in " << TEXTBLUE << filename << TEXTWHITE << std::endl;
+        throw;
+    }
+    file.sync();
+
+    *this->out << "Writing " << TEXTBLUE << filename << TEXTWHITE << " (" << std::dec << romsize << " bytes)" << std::endl;
+    *this->out << "MD5: " << TEXTBLUE << calculate_md5(file.data()) << TEXTWHITE << std::endl;
 }
 
 /**
  * Writes data to the chip.
  * @param data Data to write to the chip.
+ * @param skip_blank Do not transfer sectors consisting solely of 0xFF;
+ *                   only valid directly after a full-chip erase.
+ * @param crcs If set, precomputed CRC16 checksum per sector of the data.
+ * @param journal If set, receives every acknowledged sector.
  */
-void Flasher::write_chip(const std::vector<uint8_t>& data) {
+void Flasher::write_chip(std::span<const uint8_t> data, bool skip_blank, const std::vector<uint16_t>* crcs, Journal* journal) {
+    TraceSpan span("write_chip", "flasher");
     unsigned int nrsectors = std::min((size_t)128, data.size() / 4096);
-    std::cout << "Flashing " << nrsectors << " sectors, please wait..." << std::endl;
-    auto chunk = std::vector<uint8_t>(SECTORSIZE);
-    for (unsigned int i = 0; i < nrsectors; i++) {
-        std::copy(data.begin() + (i * SECTORSIZE), data.begin() + ((i + 1) * SECTORSIZE), chunk.begin());
+    *this->out << "Flashing " << std::dec << nrsectors << " sectors, please wait..." << std::endl;
+    if(this->events) {
+        this->events->begin_phase("write", nrsectors);
+    }
+    unsigned int nrskipped = 0;
+    this->run_pipeline<SectorJob, SectorResult>(nrsectors,
+        [&](unsigned int i) {
+            TraceSpan span("prepare_sector", "flasher");
+            span.arg("sector", i);
+            SectorJob job{i, data.subspan(i * SECTORSIZE, SECTORSIZE), 0, false};
+
+            // an erased sector already reads as 0xFF, no need to send it
+            job.blank = skip_blank && std::all_of(job.chunk.begin(), job.chunk.end(), [](uint8_t b) { return b == 0xFF; });
+
+            // calculate checksum
+            if(!job.blank) {
+                job.crc16 = crcs ? (*crcs)[i] : CRC16::xmodem(job.chunk);
+            }
+            return job;
+        },
+        [this](SectorJob& job) {
+            SectorResult result{job.sector, job.crc16, 0, job.blank, 0.0};
+
+            // perform transfer
+            if(!job.blank) {
+                this->io_begin();
+                result.checksum = this->serial->write_sector(job.sector, job.chunk);
+                result.duration = this->io_end();
+            }
+            return result;
+        },
+        [&](SectorResult& result) {
+            unsigned int i = result.sector;
+            *this->out << std::hex << std::setw(2) << std::setfill('0') << (i+1) << " [";
+            if(result.blank) {
+                nrskipped++;
+                *this->out << TEXTBLUE << "----";
+            } else {
+                if(result.checksum == result.crc16) {
+                    *this->out << TEXTGREEN;
+                } else {
+                    *this->out << TEXTRED;
+                }
+                *this->out << std::hex << std::setw(4) << std::setfill('0') << result.checksum;
+            }
+            *this->out << TEXTWHITE << "] " << std::flush;
+
+            if(journal && (result.blank || result.checksum == result.crc16)) {
+                journal->record(i);
+            }
+            emit_sector(this->events, result);
+
+            if((i+1) % 8 == 0) {
+                *this->out << std::endl;
+            } else if(i == nrsectors - 1) {
+                *this->out << std::endl;
+            }
+        },
+        [this](SectorJob& job, SerialCommand& command) {
+            if(job.blank) {
+                return false;
+            }
+            this->io_begin();
+            this->serial->prepare_write_sector(job.sector, job.chunk, command);
+            return true;
+        },
+        [this](SectorJob& job, const SerialCommand& command) {
+            return SectorResult{job.sector, job.crc16, Serial::get_checksum(command), job.blank, this->io_end(command.issued)};
+        });
+    if(this->events) {
+        this->events->end_phase();
+    }
+
+    if(skip_blank) {
+        *this->out << "Skipped " << TEXTGREEN << std::dec << nrskipped << TEXTWHITE << " blank sectors ("
+                   << (nrskipped * SECTORSIZE / 1024) << " KiB not transferred)" << std::endl;
+    }
+    this->print_io_gap();
+}
+
+/**
+ * Calculates the CRC16 checksum of every sector of the data, such that
+ * repeated writes of the same image do not need to recalculate them.
+ * @param data Data to calculate the checksums for.
+ * @return CRC16 checksum per sector.
+ */
+std::vector<uint16_t> Flasher::calculate_sector_crcs(std::span<const uint8_t> data) {
+    std::vector<uint16_t> crcs(data.size() / SECTORSIZE);
+    for(unsigned int i=0; i<crcs.size(); i++) {
+        crcs[i] = CRC16::xmodem(data.data() + i * SECTORSIZE, SECTORSIZE);
+    }
+    return crcs;
+}
+
+/**
+ * Writes data to the chip, only erasing and rewriting those sectors
+ * whose contents differ from the data already on the chip.
+ * @param data Data to write to the chip.
+ */
+void Flasher::write_chip_diff(std::span<const uint8_t> data) {
+    TraceSpan span("write_chip_diff", "flasher");
+    auto start = std::chrono::steady_clock::now();
+
+    // read back the chip and collect the sectors that differ from the image
+    *this->out << "Comparing chip contents:" << std::endl;
+    unsigned int nrbanks = data.size() / BANKSIZE;
+    unsigned int sectors_per_bank = BANKSIZE / SECTORSIZE;
+    std::vector<unsigned int> sectors;
+    auto read_chunk = std::vector<uint8_t>(BANKSIZE);
+    if(this->events) {
+        this->events->begin_phase("compare", nrbanks);
+    }
+    for(unsigned int i=0; i<nrbanks; i++) {
+        this->io_begin();
+        this->serial->read_bank(i, read_chunk);
+        double duration = this->io_end();
+
+        unsigned int nrchanged = 0;
+        for(unsigned int j=0; j<sectors_per_bank; j++) {
+            auto sector_begin = data.begin() + i * BANKSIZE + j * SECTORSIZE;
+            if(!std::equal(sector_begin, sector_begin + SECTORSIZE, read_chunk.begin() + j * SECTORSIZE)) {
+                sectors.push_back(i * sectors_per_bank + j);
+                nrchanged++;
+            }
+        }
+
+        *this->out << std::dec << std::setw(2) << std::setfill('0') << (i+1) << " [";
+        *this->out << (nrchanged == 0 ? TEXTGREEN : TEXTBLUE) << nrchanged << "/" << sectors_per_bank;
+        *this->out << TEXTWHITE << "] " << std::flush;
+
+        if(this->events) {
+            this->events->item(JsonEvent("bank").field("index", i).field("changed", nrchanged), BANKSIZE, duration);
+        }
+
+        if((i+1) % 8 == 0) {
+            *this->out << std::endl;
+        } else if(i == nrbanks - 1) {
+            *this->out << std::endl;
+        }
+    }
+    if(this->events) {
+        this->events->end_phase();
+    }
+
+    unsigned int nrsectors = nrbanks * sectors_per_bank;
+    unsigned int nrskipped = nrsectors - sectors.size();
+    if(sectors.empty()) {
+        *this->out << "Chip contents already match the image, nothing to write." << std::endl;
+        return;
+    }
+
+    // erase and rewrite only the differing sectors
+    *this->out << "Flashing " << std::dec << sectors.size() << " changed sectors, please wait..." << std::endl;
+    auto write_start = std::chrono::steady_clock::now();
+    if(this->events) {
+        this->events->begin_phase("write", sectors.size());
+    }
+    for(unsigned int i=0; i<sectors.size(); i++) {
+        unsigned int sector = sectors[i];
+        auto chunk = data.subspan(sector * SECTORSIZE, SECTORSIZE);
 
         // calculate checksum
-        uint16_t crc16 = this->crc16_xmodem(chunk);
+        uint16_t crc16 = CRC16::xmodem(chunk);
 
-        // perform transfer
-        uint16_t checksum = this->serial->write_sector(i, chunk);
+        // erase sector and perform transfer
+        this->io_begin();
+        this->serial->erase_sector(sector);
+        uint16_t checksum = this->serial->write_sector(sector, chunk);
+        emit_sector(this->events, SectorResult{sector, crc16, checksum, false, this->io_end()});
 
-        std::cout << std::hex << std::setw(2) << std::setfill('0') << (i+1) << " [";
+        *this->out << std::hex << std::setw(2) << std::setfill('0') << (sector+1) << " [";
         if(checksum  == crc16) {
-            std::cout << TEXTGREEN;
+            *this->out << TEXTGREEN;
         } else {
-            std::cout << TEXTRED;
+            *this->out << TEXTRED;
         }
-        std::cout << std::hex << std::setw(4) << std::setfill('0') << checksum << TEXTWHITE;
-        std::cout << "] " << std::flush;
+        *this->out << std::hex << std::setw(4) << std::setfill('0') << checksum << TEXTWHITE;
+        *this->out << "] " << std::flush;
 
         if((i+1) % 8 == 0) {
-            std::cout << std::endl;
-        } else if(i == nrsectors - 1) {
-            std::cout << std::endl;
+            *this->out << std::endl;
+        } else if(i == sectors.size() - 1) {
+            *this->out << std::endl;
         }
     }
+    if(this->events) {
+        this->events->end_phase();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    // estimate the time a full rewrite would have taken from the average
+    // erase-and-write time of the sectors that were actually rewritten
+    double elapsed = std::chrono::duration<double>(stop - start).count();
+    double per_sector = std::chrono::duration<double>(stop - write_start).count() / sectors.size();
+    double saved = std::max(0.0, per_sector * nrsectors - elapsed);
+    *this->out << "Skipped " << TEXTGREEN << std::dec << nrskipped << TEXTWHITE << " of "
+               << nrsectors << " sectors in " << std::fixed << std::setprecision(2) << elapsed
+               << "s (estimated " << saved << "s saved)" << std::defaultfloat << std::endl;
+}
+
+/**
+ * Downloads data from a URL and writes it to the chip while the download
+ * is still in progress. The chip is erased while the first bytes arrive
+ * and every sector is written as soon as it has been received.
+ * @param url URL to download the data from.
+ * @param data Buffer of the size of the chip, pre-filled with the padding
+ *             byte; receives the downloaded data.
+ * @param skip_blank Do not transfer sectors consisting solely of 0xFF.
+ */
+void Flasher::stream_chip(const std::string& url, std::span<uint8_t> data, bool skip_blank) {
+    TraceSpan span("stream_chip", "flasher");
+    span.arg("url", url);
+    auto start = std::chrono::steady_clock::now();
+    *this->out << "Streaming " << TEXTBLUE << url << TEXTWHITE << std::endl;
+
+    // start the download; the buffer is never resized, so received bytes can
+    // be read without holding the lock
+    StreamBuffer stream;
+    stream.data = data;
+    std::thread downloader([&stream, &url]() {
+        Tracer::name_thread("download");
+        TraceSpan span("download", "flasher");
+        std::string error;
+        CURL* curl = curl_easy_init();
+        if(curl) {
+            stream.curl = curl;
+            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &Flasher::curl_stream_callback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &stream);
+            curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, &Flasher::curl_stream_progress);
+            curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &stream);
+            curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+            curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+            curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+
+            CURLcode res = curl_easy_perform(curl);
+            if(res == CURLE_WRITE_ERROR) {
+                error = "Error: File size too large.";
+            } else if(res == CURLE_ABORTED_BY_CALLBACK) {
+                error = "Download aborted.";
+            } else if(res != CURLE_OK) {
+                error = curl_easy_strerror(res);
+            }
+            curl_easy_cleanup(curl);
+        } else {
+            error = "Error initializing CURL.";
+        }
+
+        std::lock_guard<std::mutex> lock(stream.mtx);
+        if(error.empty() && stream.received == 0) {
+            error = "Error retrieving file.";
+        }
+        // an oversized image is already reported by the write callback
+        if(stream.error.empty()) {
+            stream.error = error;
+        }
+        stream.done = true;
+        stream.cv.notify_all();
+    });
+
+    try {
+        // the first data reveals the announced size of the image; only then
+        // is the chip erased, while the remainder is in flight
+        {
+            std::unique_lock<std::mutex> lock(stream.mtx);
+            stream.cv.wait(lock, [&]() { return stream.done || stream.received > 0 || !stream.error.empty(); });
+            if(!stream.error.empty()) {
+                throw std::runtime_error(stream.error);
+            }
+        }
+        this->erase_chip();
+
+        unsigned int nrsectors = std::min((size_t)128, data.size() / SECTORSIZE);
+        *this->out << "Flashing " << std::dec << nrsectors << " sectors as they arrive..." << std::endl;
+        if(this->events) {
+            this->events->begin_phase("write", nrsectors);
+        }
+        unsigned int nrskipped = 0;
+        for(unsigned int i = 0; i < nrsectors; i++) {
+            // wait until the sector has been received or the download has ended
+            {
+                std::unique_lock<std::mutex> lock(stream.mtx);
+                stream.cv.wait(lock, [&]() { return stream.done || !stream.error.empty() || stream.received >= (i + 1) * SECTORSIZE; });
+                if(!stream.error.empty()) {
+                    throw std::runtime_error(stream.error);
+                }
+            }
+
+            std::span<const uint8_t> chunk = data.subspan(i * SECTORSIZE, SECTORSIZE);
+
+            *this->out << std::hex << std::setw(2) << std::setfill('0') << (i+1) << " [";
+            if(skip_blank && std::all_of(chunk.begin(), chunk.end(), [](uint8_t b) { return b == 0xFF; })) {
+                nrskipped++;
+                *this->out << TEXTBLUE << "----";
+                emit_sector(this->events, SectorResult{i, 0, 0, true, 0.0});
+            } else {
+                uint16_t crc16 = CRC16::xmodem(chunk);
+                this->io_begin();
+                uint16_t checksum = this->serial->write_sector(i, chunk);
+                emit_sector(this->events, SectorResult{i, crc16, checksum, false, this->io_end()});
+                *this->out << (checksum == crc16 ? TEXTGREEN : TEXTRED);
+                *this->out << std::hex << std::setw(4) << std::setfill('0') << checksum;
+            }
+            *this->out << TEXTWHITE << "] " << std::flush;
+
+            if((i+1) % 8 == 0) {
+                *this->out << std::endl;
+            } else if(i == nrsectors - 1) {
+                *this->out << std::endl;
+            }
+        }
+        if(this->events) {
+            this->events->end_phase();
+        }
+
+        if(skip_blank) {
+            *this->out << "Skipped " << TEXTGREEN << std::dec << nrskipped << TEXTWHITE << " blank sectors ("
+                       << (nrskipped * SECTORSIZE / 1024) << " KiB not transferred)" << std::endl;
+        }
+    } catch(...) {
+        // stop the download rather than waiting for it to complete
+        {
+            std::lock_guard<std::mutex> lock(stream.mtx);
+            stream.aborted = true;
+        }
+        downloader.join();
+        throw;
+    }
+    downloader.join();
+
+    // the download may still fail after the last sector has been written
+    if(!stream.error.empty()) {
+        throw std::runtime_error(stream.error);
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    *this->out << "Retrieved " << TEXTBLUE << url << TEXTWHITE << " (" << std::dec << stream.received
+               << " bytes) in " << std::fixed << std::setprecision(2)
+               << std::chrono::duration<double>(stop - start).count() << "s" << std::defaultfloat << std::endl;
+    *this->out << "MD5: " << TEXTBLUE
+               << calculate_md5(data.first(stream.received))
+               << TEXTWHITE << std::endl;
 }
 
 /**
@@ -140,192 +799,903 @@ void Flasher::write_chip(const std::vector<uint8_t>& data) {
  * @param data Data to write to the chip.
  * @param bank Bank to write the data to.
  */
-void Flasher::write_bank(const std::vector<uint8_t>& data, unsigned int bank) {
+void Flasher::write_bank(std::span<const uint8_t> data, unsigned int bank) {
+    TraceSpan span("write_bank", "flasher");
+    span.arg("bank", bank);
     unsigned int nrsectors = 4;
-    auto chunk = std::vector<uint8_t>(SECTORSIZE);
+    if(this->events) {
+        this->events->begin_phase("write", nrsectors);
+    }
     for (unsigned int i = 0; i < nrsectors; i++) {
-        std::copy(data.begin() + (i * SECTORSIZE), data.begin() + ((i + 1) * SECTORSIZE), chunk.begin());
+        auto chunk = data.subspan(i * SECTORSIZE, SECTORSIZE);
 
         // calculate checksum
-        uint16_t crc16 = this->crc16_xmodem(chunk);
+        uint16_t crc16 = CRC16::xmodem(chunk);
 
         // erase sector
+        this->io_begin();
         this->serial->erase_sector(bank * 4 + i);
 
         // perform transfer
         uint16_t checksum = this->serial->write_sector(bank * 4 + i, chunk);
+        emit_sector(this->events, SectorResult{bank * 4 + i, crc16, checksum, false, this->io_end()});
 
-        std::cout << std::hex << std::setw(2) << std::setfill('0') << (i+1) << " [";
+        *this->out << std::hex << std::setw(2) << std::setfill('0') << (i+1) << " [";
         if(checksum  == crc16) {
-            std::cout << TEXTGREEN;
+            *this->out << TEXTGREEN;
         } else {
-            std::cout << TEXTRED;
+            *this->out << TEXTRED;
         }
-        std::cout << std::hex << std::setw(4) << std::setfill('0') << checksum << TEXTWHITE;
-        std::cout << "] " << std::flush;
+        *this->out << std::hex << std::setw(4) << std::setfill('0') << checksum << TEXTWHITE;
+        *this->out << "] " << std::flush;
 
         if((i+1) % 8 == 0) {
-            std::cout << std::endl;
+            *this->out << std::endl;
         } else if(i == nrsectors - 1) {
-            std::cout << std::endl;
+            *this->out << std::endl;
         }
     }
+    if(this->events) {
+        this->events->end_phase();
+    }
 }
 
 /**
- * Verifies the data on the chip.
- * @param data Data to verify on the chip.
+ * Writes a number of segments to the chip in a single pass. Only the
+ * sectors covered by the segments are erased and written; the remainder
+ * of partially covered sectors is read back and preserved.
+ * @param segments Segments to write, sorted by address and not overlapping.
+ * @param skip_blank Do not transfer sectors consisting solely of 0xFF.
  */
-void Flasher::verify_chip(const std::vector<uint8_t>& data) {
-    std::cout << "Verifying data:" << std::endl;
+void Flasher::write_segments(const std::vector<Segment>& segments, bool skip_blank) {
+    TraceSpan span("write_segments", "flasher");
+    auto sectors = this->compose_sectors(segments);
+    std::vector<unsigned int> order;
+    for(const auto& sector : sectors) {
+        order.push_back(sector.first);
+    }
 
-    // verify integrity
-    auto chunk = std::vector<uint8_t>(BANKSIZE);
+    this->program_sectors(order, [&sectors](unsigned int sector) {
+        return std::span<const uint8_t>(sectors.at(sector));
+    }, skip_blank);
+}
+
+/**
+ * Resumes an interrupted write of the chip. The sectors recorded in the
+ * journal are read back and compared with the data; all other sectors
+ * are erased individually and written, such that the chip is not erased
+ * again.
+ * @param data Data to write to the chip.
+ * @param journal Journal of the interrupted write; receives the rewritten sectors.
+ * @param skip_blank Do not transfer sectors consisting solely of 0xFF.
+ */
+void Flasher::resume_chip(std::span<const uint8_t> data, Journal& journal, bool skip_blank) {
+    TraceSpan span("resume_chip", "flasher");
+    const auto& confirmed = journal.get_confirmed();
     unsigned int nrbanks = data.size() / BANKSIZE;
-    for(unsigned int i=0; i<nrbanks; i++) {
-        std::vector<uint8_t> read_chunk(BANKSIZE);
-        this->serial->read_bank(i, read_chunk);
+    unsigned int sectors_per_bank = BANKSIZE / SECTORSIZE;
 
-        std::cout << std::dec << std::setw(2) << std::setfill('0') << (i+1) << " [";
+    // quick readback of the banks holding acknowledged sectors
+    *this->out << "Checking " << std::dec << confirmed.size() << " journalled sectors:" << std::endl;
+    std::vector<unsigned int> sectors;
+    auto chunk = std::vector<uint8_t>(BANKSIZE);
+    if(this->events) {
+        this->events->begin_phase("check", nrbanks);
+    }
+    for(unsigned int i=0; i<nrbanks; i++) {
+        unsigned int first = i * sectors_per_bank;
+        bool journalled = confirmed.lower_bound(first) != confirmed.lower_bound(first + sectors_per_bank);
+        double duration = 0.0;
+        if(journalled) {
+            this->io_begin();
+            this->serial->read_bank(i, chunk);
+            duration = this->io_end();
+        }
 
-        if (std::equal(data.begin() + (i * BANKSIZE), data.begin() + ((i + 1) * BANKSIZE), read_chunk.begin())) {
-            std::cout << TEXTGREEN << "PASS";
-        } else {
-            std::cout << TEXTRED << "FAIL";
+        unsigned int nrvalid = 0;
+        for(unsigned int j=0; j<sectors_per_bank; j++) {
+            auto expected = data.subspan((first + j) * SECTORSIZE, SECTORSIZE);
+            if(confirmed.count(first + j) && std::equal(expected.begin(), expected.end(), chunk.begin() + j * SECTORSIZE)) {
+                nrvalid++;
+            } else {
+                sectors.push_back(first + j);
+            }
         }
 
-        std::cout << TEXTWHITE << "] " << std::flush;
+        *this->out << std::dec << std::setw(2) << std::setfill('0') << (i+1) << " [";
+        *this->out << (nrvalid == sectors_per_bank ? TEXTGREEN : TEXTBLUE) << nrvalid << "/" << sectors_per_bank;
+        *this->out << TEXTWHITE << "] " << std::flush;
+
+        if(this->events) {
+            this->events->item(JsonEvent("bank").field("index", i).field("valid", nrvalid),
+                               journalled ? BANKSIZE : 0, duration);
+        }
 
         if((i+1) % 8 == 0) {
-            std::cout << std::endl;
+            *this->out << std::endl;
         } else if(i == nrbanks - 1) {
-            std::cout << std::endl;
+            *this->out << std::endl;
         }
     }
+    if(this->events) {
+        this->events->end_phase();
+    }
+
+    if(sectors.empty()) {
+        *this->out << "All sectors have already been written." << std::endl;
+        return;
+    }
+    *this->out << "Resuming at sector " << std::dec << sectors.front() << ", "
+               << (nrbanks * sectors_per_bank - sectors.size()) << " sectors are kept." << std::endl;
+
+    this->program_sectors(sectors, [&data](unsigned int sector) {
+        return data.subspan(sector * SECTORSIZE, SECTORSIZE);
+    }, skip_blank, &journal);
+}
+
+/**
+ * Verifies a number of segments on the chip, reading every bank that
+ * holds part of a segment once.
+ * @param segments Segments to verify.
+ * @return True if all segments match, false otherwise.
+ */
+bool Flasher::verify_segments(const std::vector<Segment>& segments) {
+    TraceSpan span("verify_segments", "flasher");
+    *this->out << "Verifying data:" << std::endl;
+
+    // collect the banks that hold part of a segment
+    std::vector<unsigned int> banks;
+    for(const auto& segment : segments) {
+        for(unsigned int bank = segment.offset / BANKSIZE; bank <= (segment.offset + segment.data.size() - 1) / BANKSIZE; bank++) {
+            if(banks.empty() || banks.back() < bank) {
+                banks.push_back(bank);
+            }
+        }
+    }
+
+    std::vector<MismatchRange> mismatches;
+    unsigned int ctr = 0;
+    unsigned int nrslots = get_bank_slots(this->config.window);
+    std::vector<uint8_t> ring(nrslots * BANKSIZE);
+    if(this->events) {
+        this->events->begin_phase("verify", banks.size());
+    }
+    this->run_pipeline<BankJob, BankResult>(banks.size(),
+        [&](unsigned int i) {
+            return BankJob{i, banks[i], {}};
+        },
+        [&](BankJob& job) {
+            auto chunk = std::span<uint8_t>(ring).subspan((job.index % nrslots) * BANKSIZE, BANKSIZE);
+            this->io_begin();
+            this->serial->read_bank(job.bank, chunk);
+            return BankResult{job.bank, chunk, this->io_end()};
+        },
+        [&](BankResult& result) {
+            TraceSpan span("compare_bank", "flasher");
+            span.arg("bank", result.bank);
+
+            // only compare the bytes covered by the segments
+            uint32_t bank_begin = result.bank * BANKSIZE;
+            uint32_t bank_end = bank_begin + BANKSIZE;
+            std::vector<MismatchRange> ranges;
+            for(const auto& segment : segments) {
+                uint32_t begin = std::max(bank_begin, segment.offset);
+                uint32_t end = std::min(bank_end, (uint32_t)(segment.offset + segment.data.size()));
+                if(begin < end) {
+                    Compare::append(ranges, Compare::find_mismatches(segment.data.data() + (begin - segment.offset),
+                                                                     result.chunk.data() + (begin - bank_begin),
+                                                                     end - begin, begin));
+                }
+            }
+
+            *this->out << std::dec << std::setw(2) << std::setfill('0') << (result.bank+1) << " [";
+            emit_verify(this->events, result, ranges);
+            if(ranges.empty()) {
+                *this->out << TEXTGREEN << "PASS";
+            } else {
+                *this->out << TEXTRED << "FAIL";
+                Compare::append(mismatches, std::move(ranges));
+            }
+            *this->out << TEXTWHITE << "] " << std::flush;
+
+            if(++ctr % 8 == 0 || ctr == banks.size()) {
+                *this->out << std::endl;
+            }
+        },
+        [&](BankJob& job, SerialCommand& command) {
+            job.chunk = std::span<uint8_t>(ring).subspan((job.index % nrslots) * BANKSIZE, BANKSIZE);
+            this->io_begin();
+            this->serial->prepare_read_bank(job.bank, job.chunk, command);
+            return true;
+        },
+        [this](BankJob& job, const SerialCommand& command) {
+            return BankResult{job.bank, job.chunk, this->io_end(command.issued)};
+        });
+    if(this->events) {
+        this->events->end_phase();
+    }
+    this->print_io_gap();
+    this->print_mismatches(mismatches);
+
+    return mismatches.empty();
+}
+
+/**
+ * Verifies the data on the chip.
+ * @param data Data to verify on the chip.
+ * @param mismatch_map If set, receives the XOR of the data and the chip contents.
+ * @return True if all banks match, false otherwise.
+ */
+bool Flasher::verify_chip(std::span<const uint8_t> data, std::vector<uint8_t>* mismatch_map) {
+    TraceSpan span("verify_chip", "flasher");
+    *this->out << "Verifying data:" << std::endl;
+
+    if(mismatch_map) {
+        mismatch_map->assign(data.size(), 0);
+    }
+
+    // verify integrity
+    unsigned int nrbanks = data.size() / BANKSIZE;
+    std::vector<MismatchRange> mismatches;
+    unsigned int nrslots = get_bank_slots(this->config.window);
+    std::vector<uint8_t> ring(nrslots * BANKSIZE);
+    if(this->events) {
+        this->events->begin_phase("verify", nrbanks);
+    }
+    this->run_pipeline<BankJob, BankResult>(nrbanks,
+        [](unsigned int i) {
+            return BankJob{i, i, {}};
+        },
+        [&](BankJob& job) {
+            auto chunk = std::span<uint8_t>(ring).subspan((job.index % nrslots) * BANKSIZE, BANKSIZE);
+            this->io_begin();
+            this->serial->read_bank(job.bank, chunk);
+            return BankResult{job.bank, chunk, this->io_end()};
+        },
+        [&](BankResult& result) {
+            TraceSpan span("compare_bank", "flasher");
+            span.arg("bank", result.bank);
+            unsigned int i = result.bank;
+            *this->out << std::dec << std::setw(2) << std::setfill('0') << (i+1) << " [";
+
+            auto ranges = Compare::find_mismatches(data.data() + i * BANKSIZE, result.chunk.data(), BANKSIZE, i * BANKSIZE);
+            emit_verify(this->events, result, ranges);
+            if (ranges.empty()) {
+                *this->out << TEXTGREEN << "PASS";
+            } else {
+                *this->out << TEXTRED << "FAIL";
+                if(mismatch_map) {
+                    std::transform(result.chunk.begin(), result.chunk.end(), data.begin() + i * BANKSIZE,
+                                   mismatch_map->begin() + i * BANKSIZE, std::bit_xor<uint8_t>());
+                }
+                Compare::append(mismatches, std::move(ranges));
+            }
+
+            *this->out << TEXTWHITE << "] " << std::flush;
+
+            if((i+1) % 8 == 0) {
+                *this->out << std::endl;
+            } else if(i == nrbanks - 1) {
+                *this->out << std::endl;
+            }
+        },
+        [&](BankJob& job, SerialCommand& command) {
+            job.chunk = std::span<uint8_t>(ring).subspan((job.index % nrslots) * BANKSIZE, BANKSIZE);
+            this->io_begin();
+            this->serial->prepare_read_bank(job.bank, job.chunk, command);
+            return true;
+        },
+        [this](BankJob& job, const SerialCommand& command) {
+            return BankResult{job.bank, job.chunk, this->io_end(command.issued)};
+        });
+    if(this->events) {
+        this->events->end_phase();
+    }
+    this->print_io_gap();
+    this->print_mismatches(mismatches);
+
+    return mismatches.empty();
 }
 
 /**
  * Verifies the data on a bank of the chip.
  * @param data Data to verify on the chip.
  * @param bank Bank to verify the data on.
- * @throws std::runtime_error if the data does not match the chip.
+ * @param mismatch_map If set, receives the XOR of the data and the bank contents.
+ * @return True if the bank matches, false otherwise.
  */
-void Flasher::verify_bank(const std::vector<uint8_t>& data, unsigned int bank) {
-    std::cout << "Verifying data: " << TEXTBLUE;
+bool Flasher::verify_bank(std::span<const uint8_t> data, unsigned int bank, std::vector<uint8_t>* mismatch_map) {
+    TraceSpan span("verify_bank", "flasher");
+    span.arg("bank", bank);
+    *this->out << "Verifying data: " << TEXTBLUE;
 
     // verify integrity
     auto chunk = std::vector<uint8_t>(BANKSIZE);
+    if(this->events) {
+        this->events->begin_phase("verify", 1);
+    }
+    this->io_begin();
     this->serial->read_bank(bank, chunk);
+    double duration = this->io_end();
 
-    std::cout << "Bank " << std::dec << std::setw(2) << std::setfill('0') << bank << TEXTWHITE << " [";
+    *this->out << "Bank " << std::dec << std::setw(2) << std::setfill('0') << bank << TEXTWHITE << " [";
 
-    if (std::equal(data.begin(), data.begin() + BANKSIZE, chunk.begin())) {
-        std::cout << TEXTGREEN << "PASS";
+    auto mismatches = Compare::find_mismatches(data.data(), chunk.data(), BANKSIZE, bank * BANKSIZE);
+    if(this->events) {
+        emit_verify(this->events, BankResult{bank, chunk, duration}, mismatches);
+        this->events->end_phase();
+    }
+    if (mismatches.empty()) {
+        *this->out << TEXTGREEN << "PASS";
     } else {
-        std::cout << TEXTRED << "FAIL";
+        *this->out << TEXTRED << "FAIL";
+    }
+
+    *this->out << TEXTWHITE << "] " << std::endl;
+
+    if(mismatch_map) {
+        mismatch_map->resize(BANKSIZE);
+        std::transform(chunk.begin(), chunk.end(), data.begin(), mismatch_map->begin(), std::bit_xor<uint8_t>());
     }
+    this->print_mismatches(mismatches);
 
-    std::cout << TEXTWHITE << "] " << std::endl;
+    return mismatches.empty();
 }
 
 /**
- * Reads data from a file.
+ * Reads data from a file. Regular files are mapped into memory; a
+ * filename of "-" reads from standard input.
  * @param filename Name of the file to read.
  * @param data Data read from the file.
+ * @param out Stream to write progress to.
  */
-void Flasher::read_file(const std::string& filename, std::vector<uint8_t>& data) {
+void Flasher::read_file(const std::string& filename, std::vector<uint8_t>& data, std::ostream& out) {
+    TraceSpan span("read_file", "flasher");
+    span.arg("filename", filename);
     if(filename.find("https://") == 0 || filename.find("http://") == 0) {
-        CURL* curl;
-        CURLcode res;
-
-        curl = curl_easy_init();
-        if(curl) {
-            curl_easy_setopt(curl, CURLOPT_URL, filename.c_str());
-            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &this->curl_write_callback);
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
-            curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-            //curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-
-            res = curl_easy_perform(curl);
-            if(res != CURLE_OK) {
-                throw std::runtime_error(std::string(curl_easy_strerror(res)));
-            } else {
-                std::cout << "Retrieving " << TEXTBLUE << filename << TEXTWHITE << " (" 
-                            << std::dec << data.size() << " bytes)" << std::endl;
-            }
-            curl_easy_cleanup(curl);
-        }
-
-        if(data.size() == 0) {
-            throw std::runtime_error("Error retrieving file.");
-        } else {
-
-        }
-
+        // downloads are kept in a local cache and only repeated when the image has changed
+        UrlCache().fetch(filename, data, out);
+    } else if(filename == "-") {
+        read_all(STDIN_FILENO, data);
+        out << "Reading " << TEXTBLUE << "<stdin>" << TEXTWHITE << " ("
+                    << std::dec << data.size() << " bytes)" << std::endl;
     } else {
-        std::ifstream infile(filename, std::ios::binary);
-        if (infile) {
-            infile.seekg(0, std::ios::end);
-            std::streamsize size = infile.tellg();
-            infile.seekg(0, std::ios::beg);
-
-            // Resize the vector to fit the file content
-            data.resize(size);
-
-            // Read the file content into the vector
-            if (infile.read(reinterpret_cast<char*>(data.data()), size)) {
-                std::cout << "Reading " << TEXTBLUE << filename << TEXTWHITE << " (" 
-                            << std::dec << data.size() << " bytes)" << std::endl;
-            } else {
-                throw std::runtime_error("Error reading file.");
+        struct stat st;
+        if(stat(filename.c_str(), &st) == 0 && !S_ISREG(st.st_mode)) {
+            // pipes and devices cannot be mapped, e.g. process substitution
+            int fd = open(filename.c_str(), O_RDONLY);
+            if(fd < 0) {
+                throw std::runtime_error("Error opening file.");
             }
+            try {
+                read_all(fd, data);
+            } catch(...) {
+                close(fd);
+                throw;
+            }
+            close(fd);
         } else {
-            throw std::runtime_error("Error opening file.");
+            // copy the image straight from the page cache
+            const MappedFile file(filename);
+            data.assign(file.data().begin(), file.data().end());
         }
+        out << "Reading " << TEXTBLUE << filename << TEXTWHITE << " ("
+                    << std::dec << data.size() << " bytes)" << std::endl;
     }
 
     // calculate md5 checksum and output it
-    std::string md5sum = this->calculate_md5(data);
-    std::cout << "MD5: " << TEXTBLUE << md5sum << TEXTWHITE << std::endl;
+    std::string md5sum = calculate_md5(data);
+    out << "MD5: " << TEXTBLUE << md5sum << TEXTWHITE << std::endl;
 }
 
 /**
- * Writes data to a file.
+ * Writes data to a file. A filename of "-" writes to standard output.
  * @param filename Name of the file to write.
  * @param data Data to write to the file.
+ * @param out Stream to write progress to.
  */
-void Flasher::write_file(const std::string& filename, const std::vector<uint8_t>& data) {
+void Flasher::write_file(const std::string& filename, std::span<const uint8_t> data, std::ostream& out) {
+    TraceSpan span("write_file", "flasher");
+    span.arg("filename", filename);
+    if(filename == "-") {
+        write_all(STDOUT_FILENO, data);
+        out << "Writing " << TEXTBLUE << "<stdout>" << TEXTWHITE << " ("
+                    << std::dec << data.size() << " bytes)" << std::endl;
+        out << "MD5: " << TEXTBLUE << calculate_md5(data) << TEXTWHITE << std::endl;
+        return;
+    }
+
     std::ofstream outfile(filename, std::ios::binary);
     if (outfile) {
         outfile.write(reinterpret_cast<const char*>(data.data()), data.size());
-        std::cout << "Writing " << TEXTBLUE << filename << TEXTWHITE << " (" 
+        out << "Writing " << TEXTBLUE << filename << TEXTWHITE << " (" 
                     << std::dec << data.size() << " bytes)" << std::endl;
-        std::cout << "MD5: " << TEXTBLUE << this->calculate_md5(data) << TEXTWHITE << std::endl;
+        out << "MD5: " << TEXTBLUE << calculate_md5(data) << TEXTWHITE << std::endl;
     } else {
         throw std::runtime_error("Error opening file.");
     }
 }
 
 /**
- * Calculates the CRC16 checksum of the given data.
- * @param data Data to calculate the checksum for.
- * @return CRC16 checksum of the data.
+ * Prints data as a hexdump, sixteen bytes per line, each line starting
+ * with its chip address and ending with the printable characters.
+ * @param out Stream to write the hexdump to.
+ * @param data Data to print.
+ * @param address Chip address of the first byte.
  */
-uint16_t Flasher::crc16_xmodem(const std::vector<uint8_t>& data) {
-    uint32_t crc = 0;
-    static const uint16_t poly = 0x1021;
+void Flasher::write_hexdump(std::ostream& out, std::span<const uint8_t> data, uint32_t address) {
+    auto flags = out.flags();
+    char fill = out.fill();
+    out << std::hex << std::uppercase << std::setfill('0');
+    for(size_t i=0; i<data.size(); i+=16) {
+        auto line = data.subspan(i, std::min<size_t>(16, data.size() - i));
+        out << std::setw(5) << (address + i) << "  ";
+        for(size_t j=0; j<16; j++) {
+            if(j < line.size()) {
+                out << std::setw(2) << (unsigned int)line[j] << ' ';
+            } else {
+                out << "   ";
+            }
+            if(j == 7) {
+                out << ' ';
+            }
+        }
+        out << " |";
+        for(uint8_t c : line) {
+            out << (char)(std::isprint(c) ? c : '.');
+        }
+        out << "|\n";
+    }
+    out.flush();
+    out.flags(flags);
+    out.fill(fill);
+}
+
+/**
+ * Opens and configures the serial port.
+ * @param config Settings of the serial transport.
+ * @param out Stream to write status messages of the port to.
+ */
+void Flasher::open_port(const SerialConfig& config, std::ostream& out) {
+    this->config = config;
+    this->serial = std::make_unique<Serial>(out, config);
+    this->serial->set_stats(this->stats);
+    this->serial->open_serial_port(this->path.c_str());
+
+    // configure port
+    if (!this->serial->configure_serial_port()) {
+        this->serial->close_serial_port();
+        throw std::runtime_error("Error configuring serial port.");
+    }
+}
+
+/**
+ * Runs a staged operation over a number of items. Each item is prepared
+ * by the stage function, transferred by the transfer function and the
+ * result is handled by the sink function. In pipelined mode, staging and
+ * sinking run on their own threads such that the calling thread only
+ * performs the serial transfers.
+ * @param nritems Number of items to process.
+ * @param stage Prepares the job for an item.
+ * @param transfer Performs the serial transaction for a job.
+ * @param sink Handles the result of a transaction.
+ */
+template <typename Job, typename Result>
+void Flasher::run_pipeline(unsigned int nritems,
+                           const std::function<Job(unsigned int)>& stage,
+                           const std::function<Result(Job&)>& transfer,
+                           const std::function<void(Result&)>& sink,
+                           const std::function<bool(Job&, SerialCommand&)>& command,
+                           const std::function<Result(Job&, const SerialCommand&)>& complete) {
+    this->io_gap_total = 0.0;
+    this->io_transactions = 0;
+    this->io_inflight = 0;
+    this->io_recovery = 0.0;
+    this->io_last_end = std::chrono::steady_clock::now();
+
+    if(!this->pipelined) {
+        unsigned int i = 0;
+        this->transfer_jobs<Job, Result>(
+            [&]() -> std::optional<Job> {
+                if(i == nritems) {
+                    return std::nullopt;
+                }
+                return stage(i++);
+            },
+            [&](Result&& result) {
+                sink(result);
+                return true;
+            },
+            transfer, command, complete);
+        return;
+    }
 
-    for(uint16_t i=0; i<data.size(); i++) {
-      crc = crc ^ (data[i] << 8);
-      for (uint8_t j=0; j<8; j++) {
-        crc = crc << 1;
-        if (crc & 0x10000) {
-            crc = (crc ^ poly) & 0xFFFF;
+    WorkQueue<Job> jobs(PIPELINE_DEPTH);
+    WorkQueue<Result> results(PIPELINE_DEPTH);
+    std::exception_ptr stage_error, transfer_error, sink_error;
+
+    // staging thread: prepares upcoming jobs
+    std::thread stager([&]() {
+        Tracer::name_thread("stage");
+        try {
+            for(unsigned int i=0; i<nritems; i++) {
+                if(!jobs.push(stage(i))) {
+                    break;
+                }
+            }
+        } catch(...) {
+            stage_error = std::current_exception();
+        }
+        jobs.close();
+    });
+
+    // sink thread: handles the results of completed transactions
+    std::thread sinker([&]() {
+        Tracer::name_thread("sink");
+        try {
+            while(auto result = results.pop()) {
+                sink(*result);
+            }
+        } catch(...) {
+            sink_error = std::current_exception();
+            results.close();
         }
-      }
+    });
+
+    // the calling thread only performs the serial transactions
+    try {
+        this->transfer_jobs<Job, Result>(
+            [&jobs]() {
+                return jobs.pop();
+            },
+            [&results](Result&& result) {
+                return results.push(std::move(result));
+            },
+            transfer, command, complete);
+    } catch(...) {
+        transfer_error = std::current_exception();
     }
+    jobs.close();
+    results.close();
+    stager.join();
+    sinker.join();
 
-    return (uint16_t)crc;
+    for(const auto& error : {transfer_error, stage_error, sink_error}) {
+        if(error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+/**
+ * Transfers jobs until none are left, keeping up to the window of the
+ * transport in flight. If the programmer does not keep up, it is brought
+ * back in step and the remaining jobs are transferred one at a time.
+ * @param pop Gets the next job; returns nothing if there are none left.
+ * @param push Hands on a result; returns false if no further results are accepted.
+ * @param transfer Performs the serial transaction for a job.
+ * @param command If set, fills in the serial command of a job.
+ * @param complete Converts a job and its completed command into a result.
+ */
+template <typename Job, typename Result>
+void Flasher::transfer_jobs(const std::function<std::optional<Job>()>& pop,
+                            const std::function<bool(Result&&)>& push,
+                            const std::function<Result(Job&)>& transfer,
+                            const std::function<bool(Job&, SerialCommand&)>& command,
+                            const std::function<Result(Job&, const SerialCommand&)>& complete) {
+    if(command && this->config.window > 1) {
+        // jobs whose result has not been handed on yet, in order, and whether
+        // their command is in flight; jobs without a command wait for their predecessors
+        std::deque<std::pair<Job, bool>> waiting;
+        bool accepted = true;
+        auto flush = [&]() {
+            while(accepted && !waiting.empty() && !waiting.front().second) {
+                accepted = push(transfer(waiting.front().first));
+                waiting.pop_front();
+            }
+            return accepted;
+        };
+
+        std::string error;
+        try {
+            this->serial->transact(this->config.window,
+                [&](SerialCommand& cmd) {
+                    while(accepted) {
+                        auto job = pop();
+                        if(!job) {
+                            return false;
+                        }
+                        waiting.emplace_back(std::move(*job), false);
+                        waiting.back().second = command(waiting.back().first, cmd);
+                        if(waiting.back().second) {
+                            return true;
+                        }
+                        flush();
+                    }
+                    return false;
+                },
+                [&](SerialCommand& cmd) {
+                    accepted = push(complete(waiting.front().first, cmd));
+                    waiting.pop_front();
+                    return flush();
+                });
+            flush();
+            return;
+        } catch(const SerialTimeout& e) {
+            error = e.what();
+        } catch(const SerialProtocolError& e) {
+            error = e.what();
+        }
+
+        // continue with the proven one-command-at-a-time protocol for the rest of the session
+        unsigned int nrlost = this->serial->recover();
+        *this->out << std::endl << TEXTRED << "Warning" << TEXTWHITE << ": " << error << std::endl
+                   << "The programmer did not keep up with " << std::dec << this->config.window
+                   << " commands in flight; repeating " << nrlost << " commands one at a time." << std::endl;
+        this->config.window = 1;
+
+        // the wait for the lost reply and the recovery are not host idle time
+        auto recovered = std::chrono::steady_clock::now();
+        this->io_recovery += std::chrono::duration<double>(recovered - this->io_last_end).count();
+        this->io_last_end = recovered;
+        this->io_inflight = 0;
+        for(auto& job : waiting) {
+            if(!accepted) {
+                return;
+            }
+            accepted = push(transfer(job.first));
+        }
+        if(!accepted) {
+            return;
+        }
+    }
+
+    while(auto job = pop()) {
+        if(!push(transfer(*job))) {
+            break;
+        }
+    }
+}
+
+/**
+ * Composes the contents of every sector covered by the segments.
+ * @param segments Segments to compose.
+ * @return Contents per sector.
+ */
+std::map<unsigned int, std::vector<uint8_t>> Flasher::compose_sectors(const std::vector<Segment>& segments) {
+    TraceSpan span("compose_sectors", "flasher");
+    // count the bytes each sector receives from the segments
+    std::map<unsigned int, size_t> coverage;
+    for(const auto& segment : segments) {
+        for(uint32_t addr = segment.offset; addr < segment.offset + segment.data.size(); ) {
+            uint32_t next = std::min((uint32_t)((addr / SECTORSIZE + 1) * SECTORSIZE), (uint32_t)(segment.offset + segment.data.size()));
+            coverage[addr / SECTORSIZE] += next - addr;
+            addr = next;
+        }
+    }
+
+    // sectors that are only partially covered keep their current contents
+    std::map<unsigned int, std::vector<uint8_t>> sectors;
+    std::vector<uint8_t> bank_data;
+    int current_bank = -1;
+    for(const auto& sector : coverage) {
+        std::vector<uint8_t>& chunk = sectors[sector.first];
+        if(sector.second == SECTORSIZE) {
+            chunk.assign(SECTORSIZE, 0xFF);
+            continue;
+        }
+
+        // sectors are visited in order, such that every bank is read at most once
+        int bank = sector.first * SECTORSIZE / BANKSIZE;
+        if(bank != current_bank) {
+            *this->out << "Reading bank " << std::dec << bank << " to preserve partially covered sectors" << std::endl;
+            bank_data.resize(BANKSIZE);
+            this->serial->read_bank(bank, bank_data);
+            current_bank = bank;
+        }
+        auto begin = bank_data.begin() + (sector.first * SECTORSIZE) % BANKSIZE;
+        chunk.assign(begin, begin + SECTORSIZE);
+    }
+
+    for(const auto& segment : segments) {
+        for(uint32_t i=0; i<segment.data.size(); i++) {
+            uint32_t addr = segment.offset + i;
+            sectors[addr / SECTORSIZE][addr % SECTORSIZE] = segment.data[i];
+        }
+    }
+
+    return sectors;
+}
+
+/**
+ * Erases a number of sectors and writes them. All sectors are erased up
+ * front such that the writes can be streamed back to back.
+ * @param order Sectors to write, in the order in which they are written.
+ * @param sector_data Gets the data of a sector.
+ * @param skip_blank Do not transfer sectors consisting solely of 0xFF.
+ * @param journal If set, receives every acknowledged sector.
+ */
+void Flasher::program_sectors(const std::vector<unsigned int>& order,
+                              const std::function<std::span<const uint8_t>(unsigned int)>& sector_data,
+                              bool skip_blank, Journal* journal) {
+    TraceSpan span("program_sectors", "flasher");
+    *this->out << "Erasing " << std::dec << order.size() << " sectors";
+    if(this->events) {
+        this->events->begin_phase("erase", order.size());
+    }
+    for(unsigned int sector : order) {
+        this->io_begin();
+        this->serial->erase_sector(sector);
+        double duration = this->io_end();
+        if(this->events) {
+            this->events->item(JsonEvent("sector").field("index", sector), 0, duration);
+        }
+    }
+    if(this->events) {
+        this->events->end_phase();
+    }
+    *this->out << " - Done" << std::endl;
+
+    *this->out << "Flashing " << std::dec << order.size() << " sectors, please wait..." << std::endl;
+    if(this->events) {
+        this->events->begin_phase("write", order.size());
+    }
+    unsigned int nrskipped = 0;
+    unsigned int ctr = 0;
+    this->run_pipeline<SectorJob, SectorResult>(order.size(),
+        [&](unsigned int i) {
+            TraceSpan span("prepare_sector", "flasher");
+            span.arg("sector", order[i]);
+            SectorJob job{order[i], sector_data(order[i]), 0, false};
+            job.blank = skip_blank && std::all_of(job.chunk.begin(), job.chunk.end(), [](uint8_t b) { return b == 0xFF; });
+            if(!job.blank) {
+                job.crc16 = CRC16::xmodem(job.chunk);
+            }
+            return job;
+        },
+        [this](SectorJob& job) {
+            SectorResult result{job.sector, job.crc16, 0, job.blank, 0.0};
+            if(!job.blank) {
+                this->io_begin();
+                result.checksum = this->serial->write_sector(job.sector, job.chunk);
+                result.duration = this->io_end();
+            }
+            return result;
+        },
+        [&](SectorResult& result) {
+            *this->out << std::hex << std::setw(2) << std::setfill('0') << (result.sector+1) << " [";
+            if(result.blank) {
+                nrskipped++;
+                *this->out << TEXTBLUE << "----";
+            } else {
+                *this->out << (result.checksum == result.crc16 ? TEXTGREEN : TEXTRED);
+                *this->out << std::hex << std::setw(4) << std::setfill('0') << result.checksum;
+            }
+            *this->out << TEXTWHITE << "] " << std::flush;
+
+            if(journal && (result.blank || result.checksum == result.crc16)) {
+                journal->record(result.sector);
+            }
+            emit_sector(this->events, result);
+
+            if(++ctr % 8 == 0 || ctr == order.size()) {
+                *this->out << std::endl;
+            }
+        },
+        [this](SectorJob& job, SerialCommand& command) {
+            if(job.blank) {
+                return false;
+            }
+            this->io_begin();
+            this->serial->prepare_write_sector(job.sector, job.chunk, command);
+            return true;
+        },
+        [this](SectorJob& job, const SerialCommand& command) {
+            return SectorResult{job.sector, job.crc16, Serial::get_checksum(command), job.blank, this->io_end(command.issued)};
+        });
+    if(this->events) {
+        this->events->end_phase();
+    }
+
+    if(skip_blank) {
+        *this->out << "Skipped " << TEXTGREEN << std::dec << nrskipped << TEXTWHITE << " blank sectors ("
+                   << (nrskipped * SECTORSIZE / 1024) << " KiB not transferred)" << std::endl;
+    }
+    this->print_io_gap();
+}
+
+/**
+ * Marks the start of a serial transaction for idle gap accounting.
+ */
+void Flasher::io_begin() {
+    auto now = std::chrono::steady_clock::now();
+    this->io_last_begin = now;
+    // with a window of commands, the port is only idle when none is in flight
+    if(this->io_transactions > 0 && this->io_inflight == 0) {
+        this->io_gap_total += std::chrono::duration<double>(now - this->io_last_end).count();
+    }
+    this->io_transactions++;
+    this->io_inflight++;
+}
+
+/**
+ * Marks the end of a serial transaction for idle gap accounting.
+ * @return Duration of the transaction in microseconds.
+ */
+double Flasher::io_end() {
+    this->io_last_end = std::chrono::steady_clock::now();
+    this->io_inflight = this->io_inflight > 0 ? this->io_inflight - 1 : 0;
+    return std::chrono::duration<double, std::micro>(this->io_last_end - this->io_last_begin).count();
+}
+
+/**
+ * Marks the end of a serial transaction that was kept in flight with
+ * others for idle gap accounting.
+ * @param issued Moment the transaction was issued.
+ * @return Duration of the transaction in microseconds.
+ */
+double Flasher::io_end(std::chrono::steady_clock::time_point issued) {
+    this->io_last_end = std::chrono::steady_clock::now();
+    this->io_inflight = this->io_inflight > 0 ? this->io_inflight - 1 : 0;
+    return std::chrono::duration<double, std::micro>(this->io_last_end - issued).count();
+}
+
+/**
+ * Prints the mean idle gap between serial transactions.
+ */
+void Flasher::print_io_gap() {
+    if(this->io_transactions < 2) {
+        return;
+    }
+
+    double gap = this->io_gap_total / (this->io_transactions - 1) * 1e6;
+    *this->out << "Mean host idle gap: " << std::dec << std::fixed << std::setprecision(1) << gap
+               << " us per transaction (" << (this->pipelined ? "pipelined" : "serial") << ")";
+    if(this->io_recovery > 0.0) {
+        *this->out << ", excluding " << this->io_recovery * 1e3 << " ms of window recovery";
+    }
+    *this->out << std::defaultfloat << std::endl;
+}
+
+/**
+ * Prints a report of the ranges in which the chip differs from the data.
+ * @param mismatches Ranges of differing bytes, using chip addresses.
+ */
+void Flasher::print_mismatches(const std::vector<MismatchRange>& mismatches) {
+    if(mismatches.empty()) {
+        return;
+    }
+
+    static const unsigned int maxlines = 32;
+    size_t nrbytes = 0;
+    unsigned int nrbits = 0;
+    for(const auto& range : mismatches) {
+        nrbytes += range.length;
+        nrbits += range.flipped_bits;
+    }
+    *this->out << TEXTRED << "Mismatch report" << TEXTWHITE << ": " << std::dec << mismatches.size() << " ranges, "
+               << nrbytes << " bytes, " << nrbits << " flipped bits" << std::endl;
+
+    for(unsigned int i=0; i<mismatches.size() && i<maxlines; i++) {
+        const MismatchRange& range = mismatches[i];
+        *this->out << "  Sector " << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << (range.offset / SECTORSIZE)
+                   << " +0x" << std::setw(3) << (range.offset % SECTORSIZE)
+                   << " (0x" << std::setw(5) << range.offset << ") " << std::dec << range.length << " bytes, "
+                   << range.flipped_bits << " bits:" << std::hex;
+        *this->out << " expected" << TEXTGREEN;
+        for(uint8_t b : range.expected) {
+            *this->out << " " << std::setw(2) << (unsigned int)b;
+        }
+        *this->out << TEXTWHITE << " actual" << TEXTRED;
+        for(uint8_t b : range.actual) {
+            *this->out << " " << std::setw(2) << (unsigned int)b;
+        }
+        *this->out << TEXTWHITE << (range.length > range.expected.size() ? " ..." : "") << std::dec << std::endl;
+    }
+
+    if(mismatches.size() > maxlines) {
+        *this->out << "  ... and " << (mismatches.size() - maxlines) << " more ranges" << std::endl;
+    }
 }
 
 /**
@@ -333,7 +1703,9 @@ uint16_t Flasher::crc16_xmodem(const std::vector<uint8_t>& data) {
  * @param data Data to calculate the checksum for.
  * @return MD5 checksum of the data.
  */
-std::string Flasher::calculate_md5(const std::vector<uint8_t>& data) {
+std::string Flasher::calculate_md5(std::span<const uint8_t> data) {
+    TraceSpan span("md5", "flasher");
+    span.arg("bytes", data.size());
     // Create an EVP context
     EVP_MD_CTX* ctx = EVP_MD_CTX_new();
     if (!ctx) {
@@ -373,15 +1745,47 @@ std::string Flasher::calculate_md5(const std::vector<uint8_t>& data) {
 }
 
 /**
- * Write callback function of CURL
+ * Write callback function of CURL for streamed downloads
  * @param ptr Pointer to the data to write.
  * @param size Size of the data to write.
  * @param nmemb Number of members to write.
  * @param userdata Userdata to pass to the callback.
  */
-size_t Flasher::curl_write_callback(void* ptr, size_t size, size_t nmemb, void* userdata) {
+size_t Flasher::curl_stream_callback(void* ptr, size_t size, size_t nmemb, void* userdata) {
     size_t total_size = size * nmemb;
-    std::vector<uint8_t>* data = reinterpret_cast<std::vector<uint8_t>*>(userdata);
-    data->insert(data->end(), reinterpret_cast<uint8_t*>(ptr), reinterpret_cast<uint8_t*>(ptr) + total_size);
+    StreamBuffer* stream = reinterpret_cast<StreamBuffer*>(userdata);
+
+    std::lock_guard<std::mutex> lock(stream->mtx);
+    if(stream->aborted) {
+        return 0;   // aborts the transfer
+    }
+
+    // reject an image that is announced or turns out to be larger than the
+    // chip before any further sector is written
+    curl_off_t length = -1;
+    if(stream->received == 0) {
+        curl_easy_getinfo(stream->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+    }
+    if((length > 0 && (size_t)length > stream->data.size()) || stream->received + total_size > stream->data.size()) {
+        stream->error = "Error: File size too large.";
+        stream->cv.notify_all();
+        return 0;
+    }
+    std::copy(reinterpret_cast<uint8_t*>(ptr), reinterpret_cast<uint8_t*>(ptr) + total_size,
+              stream->data.begin() + stream->received);
+    stream->received += total_size;
+    stream->cv.notify_all();
     return total_size;
+}
+
+/**
+ * Progress callback function of CURL for streamed downloads, which ends
+ * a download that the flasher has given up on while no data arrives.
+ * @param userdata Userdata to pass to the callback.
+ * @return Non-zero to abort the transfer.
+ */
+int Flasher::curl_stream_progress(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    StreamBuffer* stream = reinterpret_cast<StreamBuffer*>(userdata);
+    std::lock_guard<std::mutex> lock(stream->mtx);
+    return stream->aborted ? 1 : 0;
 }
\ No newline at end of file
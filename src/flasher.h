@@ -25,11 +25,20 @@
 #include <iostream>
 #include <iomanip>
 #include <exception>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <optional>
+#include <span>
 #include <openssl/evp.h>
 #include <curl/curl.h>
 
 #include "config.h"
 #include "serial.h"
+#include "compare.h"
+#include "manifest.h"
+#include "journal.h"
+#include "eventlog.h"
 
 #define TEXTGREEN "\033[1;92m"
 #define TEXTWHITE "\033[0m"
@@ -39,12 +48,88 @@
 class Flasher {
 private:
     std::unique_ptr<Serial> serial;
+    std::string path;                                       // path to the serial device
+    SerialConfig config;                                    // settings of the serial transport
+    std::ostream* out;                                      // stream to write progress to
+    EventLog* events = nullptr;                             // stream of machine-readable events, if any
+    SerialStats* stats = nullptr;                           // counters of the serial transport, if collected
+
+    bool pipelined = false;                                 // overlap host work with serial transfers
+    std::chrono::steady_clock::time_point io_last_begin;    // start of the current serial transaction
+    std::chrono::steady_clock::time_point io_last_end;      // end of the previous serial transaction
+    double io_gap_total = 0.0;                              // accumulated idle time between transactions (s)
+    unsigned int io_transactions = 0;                       // number of timed serial transactions
+    unsigned int io_inflight = 0;                           // number of timed transactions not yet completed
+    double io_recovery = 0.0;                               // time spent recovering from a failed window (s)
 
 public:
     /**
      * Constructor for the Flasher class.
+     * @param path Path to the serial device.
+     * @param out Stream to write progress to.
+     * @param config Settings of the serial transport.
+     */
+    Flasher(const std::string& path, std::ostream& out = std::cout, const SerialConfig& config = SerialConfig());
+
+    /**
+     * Tries a number of transport settings against the device and keeps
+     * the fastest one that reliably reads back the same data.
+     * @return Selected transport settings.
+     */
+    SerialConfig probe_transport();
+
+    /**
+     * Gets the size of the chip for a given device ID.
+     * @param devid Device ID of the chip.
+     * @return Size of the chip in bytes.
+     * @throws std::logic_error if the device ID is unknown.
+     */
+    static size_t get_rom_size(uint16_t devid);
+
+    /**
+     * Enables or disables the pipelined flash engine.
+     * @param pipelined Whether to prepare and process sectors on worker threads.
+     */
+    void set_pipelined(bool pipelined) {
+        this->pipelined = pipelined;
+    }
+
+    /**
+     * Redirects the progress output, e.g. to the client of a daemon job,
+     * together with the status messages of the serial port.
+     * @param out Stream to write progress to.
+     */
+    void set_output(std::ostream& out) {
+        this->out = &out;
+        this->serial->set_output(out);
+    }
+
+    /**
+     * Sets the stream of machine-readable events that receives every phase,
+     * sector and bank of the following operations.
+     * @param events Event stream, or nullptr to disable events.
+     */
+    void set_events(EventLog* events) {
+        this->events = events;
+    }
+
+    /**
+     * Sets the counters that receive the latency of every serial operation,
+     * also after the port has been reopened.
+     * @param stats Counters, or nullptr to disable collection.
+     */
+    void set_stats(SerialStats* stats) {
+        this->stats = stats;
+        this->serial->set_stats(stats);
+    }
+
+    /**
+     * Gets the serial interface of the device.
+     * @return Serial interface.
      */
-    Flasher(const std::string& path);
+    Serial& get_serial() {
+        return *this->serial;
+    }
 
     /**
      * Reads the device ID from the serial port.
@@ -58,73 +143,275 @@ public:
     void erase_chip();
 
     /**
-     * Reads data from the chip.
-     * @param data Data read from the chip.
+     * Reads data from the chip. Every bank is read directly into the
+     * caller's buffer.
+     * @param data Buffer of the size of the chip that receives the data.
+     * @param on_bank If set, called in order for every bank once it is stored in data.
      */
-    void read_chip(std::vector<uint8_t>& data);
+    void read_chip(std::span<uint8_t> data, const std::function<void(unsigned int)>& on_bank = nullptr);
+
+    /**
+     * Reads a number of consecutive banks from the chip, directly into the
+     * caller's buffer.
+     * @param first First bank to read.
+     * @param data Buffer that receives the banks, a multiple of the bank size.
+     * @param on_bank If set, called in order for every bank once it is stored in data.
+     */
+    void read_banks(unsigned int first, std::span<uint8_t> data, const std::function<void(unsigned int)>& on_bank = nullptr);
+
+    /**
+     * Reads an arbitrary range of bytes from the chip, only reading the
+     * banks that hold part of it.
+     * @param address Chip address of the first byte.
+     * @param data Buffer that receives the bytes.
+     */
+    void read_range(uint32_t address, std::span<uint8_t> data);
+
+    /**
+     * Reads the chip into a file. Every bank is stored in the file as soon
+     * as it has been read, such that an interrupted dump keeps the banks
+     * read so far. A filename of "-" writes the dump to standard output.
+     * @param filename Name of the file to write.
+     * @param romsize Size of the chip in bytes.
+     */
+    void dump_chip(const std::string& filename, size_t romsize);
 
     /**
      * Writes data to the chip.
      * @param data Data to write to the chip.
+     * @param skip_blank Do not transfer sectors consisting solely of 0xFF;
+     *                   only valid directly after a full-chip erase.
+     * @param crcs If set, precomputed CRC16 checksum per sector of the data.
+     * @param journal If set, receives every acknowledged sector.
+     */
+    void write_chip(std::span<const uint8_t> data, bool skip_blank = false, const std::vector<uint16_t>* crcs = nullptr,
+                    Journal* journal = nullptr);
+
+    /**
+     * Calculates the CRC16 checksum of every sector of the data, such that
+     * repeated writes of the same image do not need to recalculate them.
+     * @param data Data to calculate the checksums for.
+     * @return CRC16 checksum per sector.
+     */
+    static std::vector<uint16_t> calculate_sector_crcs(std::span<const uint8_t> data);
+
+    /**
+     * Writes data to the chip, only erasing and rewriting those sectors
+     * whose contents differ from the data already on the chip.
+     * @param data Data to write to the chip.
      */
-    void write_chip(const std::vector<uint8_t>& data);
+    void write_chip_diff(std::span<const uint8_t> data);
+
+    /**
+     * Downloads data from a URL and writes it to the chip while the download
+     * is still in progress. The chip is erased while the first bytes arrive
+     * and every sector is written as soon as it has been received.
+     * @param url URL to download the data from.
+     * @param data Buffer of the size of the chip, pre-filled with the padding
+     *             byte; receives the downloaded data.
+     * @param skip_blank Do not transfer sectors consisting solely of 0xFF.
+     */
+    void stream_chip(const std::string& url, std::span<uint8_t> data, bool skip_blank = false);
 
     /**
      * Writes data to a bank of the chip.
      * @param data Data to write to the chip.
      * @param bank Bank to write the data to.
      */
-    void write_bank(const std::vector<uint8_t>& data, unsigned int bank);
+    void write_bank(std::span<const uint8_t> data, unsigned int bank);
 
     /**
-     * Verifies the data on the chip.
+     * Writes a number of segments to the chip in a single pass. Only the
+     * sectors covered by the segments are erased and written; the remainder
+     * of partially covered sectors is read back and preserved.
+     * @param segments Segments to write, sorted by address and not overlapping.
+     * @param skip_blank Do not transfer sectors consisting solely of 0xFF.
+     */
+    void write_segments(const std::vector<Segment>& segments, bool skip_blank = false);
+
+    /**
+     * Resumes an interrupted write of the chip. The sectors recorded in the
+     * journal are read back and compared with the data; all other sectors
+     * are erased individually and written, such that the chip is not erased
+     * again.
+     * @param data Data to write to the chip.
+     * @param journal Journal of the interrupted write; receives the rewritten sectors.
+     * @param skip_blank Do not transfer sectors consisting solely of 0xFF.
+     */
+    void resume_chip(std::span<const uint8_t> data, Journal& journal, bool skip_blank = false);
+
+    /**
+     * Verifies a number of segments on the chip, reading every bank that
+     * holds part of a segment once.
+     * @param segments Segments to verify.
+     * @return True if all segments match, false otherwise.
+     */
+    bool verify_segments(const std::vector<Segment>& segments);
+
+    /**
+     * Verifies the data on the chip. Any differences are reported per
+     * range of differing bytes.
      * @param data Data to verify on the chip.
+     * @param mismatch_map If set, receives the XOR of the data and the chip contents.
+     * @return True if all banks match, false otherwise.
      */
-    void verify_chip(const std::vector<uint8_t>& data);
+    bool verify_chip(std::span<const uint8_t> data, std::vector<uint8_t>* mismatch_map = nullptr);
 
     /**
-     * Verifies the data on a bank of the chip.
+     * Verifies the data on a bank of the chip. Any differences are reported
+     * per range of differing bytes.
      * @param data Data to verify on the chip.
      * @param bank Bank to verify the data on.
-     * @throws std::runtime_error if the data does not match the chip.
+     * @param mismatch_map If set, receives the XOR of the data and the bank contents.
+     * @return True if the bank matches, false otherwise.
      */
-    void verify_bank(const std::vector<uint8_t>& data, unsigned int bank);
+    bool verify_bank(std::span<const uint8_t> data, unsigned int bank, std::vector<uint8_t>* mismatch_map = nullptr);
 
     /**
-     * Reads data from a file.
+     * Reads data from a file. Regular files are mapped into memory; a
+     * filename of "-" reads from standard input.
      * @param filename Name of the file to read.
      * @param data Data read from the file.
+     * @param out Stream to write progress to.
      */
-    void read_file(const std::string& filename, std::vector<uint8_t>& data);
+    static void read_file(const std::string& filename, std::vector<uint8_t>& data, std::ostream& out = std::cout);
 
     /**
-     * Writes data to a file.
+     * Writes data to a file. A filename of "-" writes to standard output.
      * @param filename Name of the file to write.
      * @param data Data to write to the file.
+     * @param out Stream to write progress to.
+     */
+    static void write_file(const std::string& filename, std::span<const uint8_t> data, std::ostream& out = std::cout);
+
+    /**
+     * Prints data as a hexdump, sixteen bytes per line, each line starting
+     * with its chip address and ending with the printable characters.
+     * @param out Stream to write the hexdump to.
+     * @param data Data to print.
+     * @param address Chip address of the first byte.
      */
-    void write_file(const std::string& filename, const std::vector<uint8_t>& data);
+    static void write_hexdump(std::ostream& out, std::span<const uint8_t> data, uint32_t address);
 
 private:
     /**
-     * Calculates the CRC16 checksum of the given data.
-     * @param data Data to calculate the checksum for.
-     * @return CRC16 checksum of the data.
+     * Opens and configures the serial port.
+     * @param config Settings of the serial transport.
+     * @param out Stream to write status messages of the port to.
+     */
+    void open_port(const SerialConfig& config, std::ostream& out);
+
+    /**
+     * Composes the contents of every sector covered by the segments.
+     * @param segments Segments to compose.
+     * @return Contents per sector.
      */
-    uint16_t crc16_xmodem(const std::vector<uint8_t>& data);
+    std::map<unsigned int, std::vector<uint8_t>> compose_sectors(const std::vector<Segment>& segments);
+
+    /**
+     * Erases a number of sectors and writes them. All sectors are erased up
+     * front such that the writes can be streamed back to back.
+     * @param order Sectors to write, in the order in which they are written.
+     * @param sector_data Gets the data of a sector.
+     * @param skip_blank Do not transfer sectors consisting solely of 0xFF.
+     * @param journal If set, receives every acknowledged sector.
+     */
+    void program_sectors(const std::vector<unsigned int>& order,
+                         const std::function<std::span<const uint8_t>(unsigned int)>& sector_data,
+                         bool skip_blank = false, Journal* journal = nullptr);
+
+    /**
+     * Runs a staged operation over a number of items. Each item is prepared
+     * by the stage function, transferred by the transfer function and the
+     * result is handled by the sink function. In pipelined mode, staging and
+     * sinking run on their own threads such that the calling thread only
+     * performs the serial transfers. If the transport keeps more than one
+     * command in flight, jobs are transferred through the command and
+     * complete functions instead.
+     * @param nritems Number of items to process.
+     * @param stage Prepares the job for an item.
+     * @param transfer Performs the serial transaction for a job.
+     * @param sink Handles the result of a transaction.
+     * @param command If set, fills in the serial command of a job; returns false if
+     *                the job needs no serial transaction.
+     * @param complete Converts a job and its completed command into a result.
+     */
+    template <typename Job, typename Result>
+    void run_pipeline(unsigned int nritems,
+                      const std::function<Job(unsigned int)>& stage,
+                      const std::function<Result(Job&)>& transfer,
+                      const std::function<void(Result&)>& sink,
+                      const std::function<bool(Job&, SerialCommand&)>& command = nullptr,
+                      const std::function<Result(Job&, const SerialCommand&)>& complete = nullptr);
+
+    /**
+     * Transfers jobs until none are left, keeping up to the window of the
+     * transport in flight. If the programmer does not keep up, it is brought
+     * back in step and the remaining jobs are transferred one at a time.
+     * @param pop Gets the next job; returns nothing if there are none left.
+     * @param push Hands on a result; returns false if no further results are accepted.
+     * @param transfer Performs the serial transaction for a job.
+     * @param command If set, fills in the serial command of a job.
+     * @param complete Converts a job and its completed command into a result.
+     */
+    template <typename Job, typename Result>
+    void transfer_jobs(const std::function<std::optional<Job>()>& pop,
+                       const std::function<bool(Result&&)>& push,
+                       const std::function<Result(Job&)>& transfer,
+                       const std::function<bool(Job&, SerialCommand&)>& command,
+                       const std::function<Result(Job&, const SerialCommand&)>& complete);
+
+    /**
+     * Marks the start of a serial transaction for idle gap accounting.
+     */
+    void io_begin();
+
+    /**
+     * Marks the end of a serial transaction for idle gap accounting.
+     * @return Duration of the transaction in microseconds.
+     */
+    double io_end();
+
+    /**
+     * Marks the end of a serial transaction that was kept in flight with
+     * others for idle gap accounting.
+     * @param issued Moment the transaction was issued.
+     * @return Duration of the transaction in microseconds.
+     */
+    double io_end(std::chrono::steady_clock::time_point issued);
+
+    /**
+     * Prints the mean idle gap between serial transactions.
+     */
+    void print_io_gap();
+
+    /**
+     * Prints a report of the ranges in which the chip differs from the data.
+     * @param mismatches Ranges of differing bytes, using chip addresses.
+     */
+    void print_mismatches(const std::vector<MismatchRange>& mismatches);
 
     /**
      * Calculates the MD5 checksum of the given data.
      * @param data Data to calculate the checksum for.
      * @return MD5 checksum of the data.
      */
-    std::string calculate_md5(const std::vector<uint8_t>& data);
+    static std::string calculate_md5(std::span<const uint8_t> data);
 
     /**
-     * Write callback function of CURL
+     * Write callback function of CURL for streamed downloads
      * @param ptr Pointer to the data to write.
      * @param size Size of the data to write.
      * @param nmemb Number of members to write.
      * @param userdata Userdata to pass to the callback.
      */
-    static size_t curl_write_callback(void* ptr, size_t size, size_t nmemb, void* userdata);
+    static size_t curl_stream_callback(void* ptr, size_t size, size_t nmemb, void* userdata);
+
+    /**
+     * Progress callback function of CURL for streamed downloads, which ends
+     * a download that the flasher has given up on while no data arrives.
+     * @param userdata Userdata to pass to the callback.
+     * @return Non-zero to abort the transfer.
+     */
+    static int curl_stream_progress(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t);
 };
\ No newline at end of file
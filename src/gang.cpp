@@ -0,0 +1,166 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "gang.h"
+#include "trace.h"
+
+#include <thread>
+
+/**
+ * Constructor for the Gang class.
+ * @param devices Paths to the serial devices.
+ * @param options Options applied to every device.
+ */
+Gang::Gang(const std::vector<std::string>& devices, const GangOptions& options) :
+    devices(devices),
+    options(options) {}
+
+/**
+ * Runs an operation concurrently on all devices.
+ * @param operation Operation to perform.
+ * @param images Either a single image shared by all devices or one image per device.
+ * @return Outcome per device.
+ */
+std::vector<GangResult> Gang::run(GangOperation operation, const std::vector<std::vector<uint8_t>>& images) {
+    if(operation != GangOperation::ERASE && images.size() != 1 && images.size() != this->devices.size()) {
+        throw std::runtime_error("Error: Supply either a single image or one image per device ("
+                                 + std::to_string(this->devices.size()) + ").");
+    }
+
+    std::cout << "Running on " << TEXTBLUE << this->devices.size() << TEXTWHITE << " devices, please wait..." << std::endl;
+
+    // every device is driven by its own thread and flasher
+    std::vector<GangResult> results(this->devices.size());
+    std::vector<std::thread> threads;
+    static const std::vector<uint8_t> empty;
+    for(unsigned int i=0; i<this->devices.size(); i++) {
+        const std::vector<uint8_t>& image = images.empty() ? empty : images[images.size() == 1 ? 0 : i];
+        threads.emplace_back([this, &results, operation, &image, i]() {
+            Tracer::name_thread(this->devices[i]);
+            results[i] = this->run_device(this->devices[i], operation, image);
+        });
+    }
+
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    return results;
+}
+
+/**
+ * Prints a pass/fail summary, including the output of failed devices.
+ * @param results Outcome per device.
+ * @return True if all devices passed, false otherwise.
+ */
+bool Gang::print_summary(const std::vector<GangResult>& results) {
+    unsigned int nrpass = 0;
+    for(const auto& result : results) {
+        if(!result.pass) {
+            std::cout << "--------------------------------------------------------------" << std::endl;
+            std::cout << "Output of " << TEXTBLUE << result.device << TEXTWHITE << ":" << std::endl;
+            std::cout << result.log;
+        }
+    }
+
+    std::cout << "--------------------------------------------------------------" << std::endl;
+    std::cout << "Gang summary:" << std::endl;
+    unsigned int ctr = 0;
+    for(const auto& result : results) {
+        std::cout << std::dec << (++ctr) << ". " << result.device << " [";
+        if(result.pass) {
+            std::cout << TEXTGREEN << "PASS";
+            nrpass++;
+        } else {
+            std::cout << TEXTRED << "FAIL";
+        }
+        std::cout << TEXTWHITE << "] " << std::fixed << std::setprecision(2) << result.duration << "s" << std::defaultfloat;
+        if(!result.message.empty()) {
+            std::cout << " - " << result.message;
+        }
+        std::cout << std::endl;
+    }
+    std::cout << nrpass << " of " << results.size() << " devices passed." << std::endl;
+
+    return nrpass == results.size();
+}
+
+/**
+ * Runs an operation on a single device.
+ * @param device Path to the serial device.
+ * @param operation Operation to perform.
+ * @param image Image for this device.
+ * @return Outcome for this device.
+ */
+GangResult Gang::run_device(const std::string& device, GangOperation operation, const std::vector<uint8_t>& image) const {
+    GangResult result;
+    result.device = device;
+    std::ostringstream log;
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        Flasher flasher(device, log, this->options.transport);
+        flasher.set_pipelined(this->options.pipelined);
+        size_t romsize = Flasher::get_rom_size(flasher.read_chip_id());
+
+        switch(operation) {
+            case GangOperation::ERASE:
+                flasher.erase_chip();
+                result.pass = true;
+            break;
+            case GangOperation::WRITE: {
+                if(image.size() > romsize) {
+                    throw std::runtime_error("Error: File size too large.");
+                }
+
+                std::vector<uint8_t> data(image);
+                data.resize(romsize, this->options.pad_ff ? 0xFF : 0);
+
+                if(this->options.diff) {
+                    flasher.write_chip_diff(data);
+                } else {
+                    flasher.erase_chip();
+                    flasher.write_chip(data, this->options.skip_blank);
+                }
+                result.pass = flasher.verify_chip(data);
+            }
+            break;
+            case GangOperation::VERIFY:
+                if(image.size() != romsize) {
+                    throw std::runtime_error("Error: File size does not match chip size.");
+                }
+                result.pass = flasher.verify_chip(image);
+            break;
+        }
+
+        if(!result.pass) {
+            result.message = "Verification failed.";
+        }
+    } catch(const std::exception& e) {
+        result.pass = false;
+        result.message = e.what();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    result.duration = std::chrono::duration<double>(stop - start).count();
+    result.log = log.str();
+    return result;
+}
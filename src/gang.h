@@ -0,0 +1,91 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include "flasher.h"
+
+enum class GangOperation {
+    ERASE,
+    WRITE,
+    VERIFY
+};
+
+// Options applied to every device of the gang
+struct GangOptions {
+    bool diff = false;          // differential write
+    bool skip_blank = false;    // do not transfer blank sectors
+    bool pad_ff = false;        // pad short images with 0xFF
+    bool pipelined = false;     // use the pipelined flash engine
+    SerialConfig transport;     // settings of the serial transport
+};
+
+// Outcome of the operation on a single device
+struct GangResult {
+    std::string device;         // path to the serial device
+    bool pass = false;          // whether the operation succeeded
+    std::string message;        // reason of failure
+    double duration = 0.0;      // duration of the operation in seconds
+    std::string log;            // captured output of the flasher
+};
+
+class Gang {
+private:
+    std::vector<std::string> devices;   // paths to the serial devices
+    GangOptions options;                // options applied to every device
+
+public:
+    /**
+     * Constructor for the Gang class.
+     * @param devices Paths to the serial devices.
+     * @param options Options applied to every device.
+     */
+    Gang(const std::vector<std::string>& devices, const GangOptions& options);
+
+    /**
+     * Runs an operation concurrently on all devices.
+     * @param operation Operation to perform.
+     * @param images Either a single image shared by all devices or one image per device.
+     * @return Outcome per device.
+     */
+    std::vector<GangResult> run(GangOperation operation, const std::vector<std::vector<uint8_t>>& images);
+
+    /**
+     * Prints a pass/fail summary, including the output of failed devices.
+     * @param results Outcome per device.
+     * @return True if all devices passed, false otherwise.
+     */
+    static bool print_summary(const std::vector<GangResult>& results);
+
+private:
+    /**
+     * Runs an operation on a single device.
+     * @param device Path to the serial device.
+     * @param operation Operation to perform.
+     * @param image Image for this device.
+     * @return Outcome for this device.
+     */
+    GangResult run_device(const std::string& device, GangOperation operation, const std::vector<uint8_t>& image) const;
+};
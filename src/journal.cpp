@@ -0,0 +1,187 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "journal.h"
+#include "urlcache.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Constructor for the Journal class.
+ * @param device Identity of the programmer, e.g. its USB serial number.
+ * @param image SHA-256 of the image.
+ * @param romsize Size of the chip in bytes.
+ * @param directory Directory holding the journals.
+ */
+Journal::Journal(const std::string& device, const std::string& image, size_t romsize, const std::string& directory) :
+    device(device),
+    image(image),
+    romsize(romsize) {
+
+    // one journal per programmer, such that writing another image discards it
+    this->path = directory + "/" + UrlCache::calculate_sha256(device.data(), device.size());
+}
+
+/**
+ * Gets the default journal directory, following the XDG base directory
+ * specification.
+ * @return Path to the journal directory.
+ */
+std::string Journal::get_default_directory() {
+    const char* xdg = std::getenv("XDG_STATE_HOME");
+    if(xdg && xdg[0] == '/') {
+        return std::string(xdg) + "/picoflash/journal";
+    }
+    const char* home = std::getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/.local/state/picoflash/journal";
+}
+
+/**
+ * Loads the journal of an earlier write of the same image to the same
+ * programmer and continues appending to it.
+ * @return True if such a journal exists, false otherwise.
+ */
+bool Journal::resume() {
+    std::ifstream infile(this->path);
+    if(!infile) {
+        return false;
+    }
+
+    std::string device, image;
+    size_t romsize = 0;
+    std::set<unsigned int> confirmed;
+    std::string line;
+    while(std::getline(infile, line)) {
+        size_t pos = line.find('=');
+        if(pos == std::string::npos) {
+            continue;
+        }
+        std::string field = line.substr(0, pos);
+        std::string value = line.substr(pos + 1);
+        try {
+            if(field == "device") {
+                device = value;
+            } else if(field == "image") {
+                image = value;
+            } else if(field == "romsize") {
+                romsize = std::stoul(value);
+            } else if(field == "sector") {
+                confirmed.insert(std::stoul(value));
+            }
+        } catch(const std::exception&) {
+            // a line cut short by a crash is ignored
+        }
+    }
+
+    if(device != this->device || image != this->image || romsize != this->romsize) {
+        return false;
+    }
+
+    this->confirmed = confirmed;
+    this->open_file(false);
+    return true;
+}
+
+/**
+ * Starts a new, empty journal, discarding any earlier one.
+ */
+void Journal::start() {
+    this->confirmed.clear();
+    this->open_file(true);
+    this->append("device=" + this->device);
+    this->append("image=" + this->image);
+    this->append("romsize=" + std::to_string(this->romsize));
+}
+
+/**
+ * Records that a sector has been written and acknowledged.
+ * @param sector Sector number.
+ */
+void Journal::record(unsigned int sector) {
+    if(this->confirmed.insert(sector).second) {
+        this->append("sector=" + std::to_string(sector));
+    }
+}
+
+/**
+ * Removes the journal once the write has been verified.
+ */
+void Journal::finish() {
+    if(this->fd >= 0) {
+        close(this->fd);
+        this->fd = -1;
+    }
+    std::filesystem::remove(this->path);
+}
+
+/**
+ * Destructor for the Journal class.
+ */
+Journal::~Journal() {
+    if(this->fd >= 0) {
+        close(this->fd);
+    }
+}
+
+/**********************************************************************************
+ * PRIVATE FUNCTIONS
+ **********************************************************************************/
+
+/**
+ * Opens the journal file for appending.
+ * @param truncate Discard the current contents.
+ */
+void Journal::open_file(bool truncate) {
+    if(this->fd >= 0) {
+        close(this->fd);
+    }
+    std::filesystem::create_directories(std::filesystem::path(this->path).parent_path());
+    this->fd = open(this->path.c_str(), O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0644);
+    if(this->fd < 0) {
+        throw std::runtime_error("Error opening journal " + this->path + ": " + std::strerror(errno));
+    }
+}
+
+/**
+ * Appends a line to the journal file. A journal that cannot be written
+ * is closed, such that the write it records is not affected.
+ * @param line Line to append, without newline.
+ */
+void Journal::append(const std::string& line) {
+    if(this->fd < 0) {
+        return;
+    }
+
+    // a single write per line, such that a crash cannot interleave two lines;
+    // a journal that cannot be written is dropped rather than failing the write
+    std::string data = line + "\n";
+    if(write(this->fd, data.data(), data.size()) != (ssize_t)data.size()) {
+        close(this->fd);
+        this->fd = -1;
+    }
+}
@@ -0,0 +1,121 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+
+/**
+ * Progress journal of a whole-chip write, keyed by the programmer and the
+ * SHA-256 of the image. Every sector that the programmer has acknowledged
+ * with the correct checksum is appended to the journal, such that an
+ * interrupted write can be resumed without erasing the chip again.
+ */
+class Journal {
+private:
+    std::string path;                   // journal file
+    std::string device;                 // identity of the programmer
+    std::string image;                  // SHA-256 of the image
+    size_t romsize;                     // size of the chip in bytes
+    std::set<unsigned int> confirmed;   // acknowledged sectors
+    int fd = -1;                        // journal file, open for appending
+
+public:
+    /**
+     * Constructor for the Journal class.
+     * @param device Identity of the programmer, e.g. its USB serial number.
+     * @param image SHA-256 of the image.
+     * @param romsize Size of the chip in bytes.
+     * @param directory Directory holding the journals.
+     */
+    Journal(const std::string& device, const std::string& image, size_t romsize,
+            const std::string& directory = get_default_directory());
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    /**
+     * Gets the default journal directory, following the XDG base directory
+     * specification.
+     * @return Path to the journal directory.
+     */
+    static std::string get_default_directory();
+
+    /**
+     * Loads the journal of an earlier write of the same image to the same
+     * programmer and continues appending to it.
+     * @return True if such a journal exists, false otherwise.
+     */
+    bool resume();
+
+    /**
+     * Starts a new, empty journal, discarding any earlier one.
+     */
+    void start();
+
+    /**
+     * Records that a sector has been written and acknowledged.
+     * @param sector Sector number.
+     */
+    void record(unsigned int sector);
+
+    /**
+     * Removes the journal once the write has been verified.
+     */
+    void finish();
+
+    /**
+     * Gets the acknowledged sectors.
+     * @return Acknowledged sectors.
+     */
+    const std::set<unsigned int>& get_confirmed() const {
+        return this->confirmed;
+    }
+
+    /**
+     * Gets the path of the journal file.
+     * @return Path of the journal file.
+     */
+    const std::string& get_path() const {
+        return this->path;
+    }
+
+    /**
+     * Destructor for the Journal class.
+     */
+    ~Journal();
+
+private:
+    /**
+     * Opens the journal file for appending.
+     * @param truncate Discard the current contents.
+     */
+    void open_file(bool truncate);
+
+    /**
+     * Appends a line to the journal file. A journal that cannot be written
+     * is closed, such that the write it records is not affected.
+     * @param line Line to append, without newline.
+     */
+    void append(const std::string& line);
+};
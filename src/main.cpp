@@ -20,23 +20,84 @@
 
 #include <iostream>
 #include <tclap/CmdLine.h>
+#include <algorithm>
 #include <cmath>
 #include <random>
 
 #include "config.h"
 #include "flasher.h"
 #include "serialport.h"
+#include "gang.h"
+#include "bench.h"
+#include "daemonclient.h"
+#include "watch.h"
+#include "urlcache.h"
+#include "eventlog.h"
+#include "trace.h"
+#include <csignal>
+#include <unistd.h>
+
+static volatile sig_atomic_t stop = 0;
+
+static void handle_signal(int) {
+    stop = 1;
+}
+
+/**
+ * Parses a range given as <first>-<last>, <first>+<count> or a single
+ * number; numbers may be given in hexadecimal using the 0x prefix.
+ * @param text Range to parse.
+ * @param option Name of the option, used in error messages.
+ * @return First element and number of elements of the range.
+ */
+static std::pair<uint64_t, uint64_t> parse_range(const std::string& text, const std::string& option) {
+    try {
+        size_t pos = 0;
+        uint64_t first = std::stoull(text, &pos, 0);
+        if(pos == text.size()) {
+            return {first, 1};
+        }
+        size_t end = 0;
+        uint64_t second = std::stoull(text.substr(pos + 1), &end, 0);
+        if(pos + 1 + end == text.size()) {
+            if(text[pos] == '+' && second > 0) {
+                return {first, second};
+            } else if(text[pos] == '-' && second >= first) {
+                return {first, second - first + 1};
+            }
+        }
+    } catch(const std::exception&) {
+        // reported below
+    }
+    throw std::runtime_error("Error: Invalid range " + text + " for " + option + ", expected <first>-<last> or <first>+<count>.");
+}
 
 int main(int argc, char* argv[]) {
+    // events are written to the original standard output, progress is moved to standard error
+    std::ostream json_out(std::cout.rdbuf());
+    std::unique_ptr<EventLog> events;
+    std::unique_ptr<SerialStats> stats;
+    std::unique_ptr<Tracer> tracer;
+    std::string trace_filename;
+
+    // writes the timeline of the session, if one is recorded
+    auto write_trace = [&]() {
+        if(tracer) {
+            tracer->write(trace_filename);
+            std::cout << "Writing trace " << TEXTBLUE << trace_filename << TEXTWHITE << std::endl;
+        }
+    };
+    std::string operation;
+
     try {
         TCLAP::CmdLine cmd("Transfer data to SST39SF0x0 chip", ' ', PROGRAM_VERSION);
 
         // input filename
-        TCLAP::ValueArg<std::string> arg_input_filename("i","input","Input file (i.e. .BIN)",false,"DATA.BIN","filename");
+        TCLAP::ValueArg<std::string> arg_input_filename("i","input","Input file (i.e. .BIN), - for standard input",false,"DATA.BIN","filename");
         cmd.add(arg_input_filename);
 
         // output filename
-        TCLAP::ValueArg<std::string> arg_output_filename("o","output","Output file (i.e. .BIN)",false,"DATA.BIN","filename");
+        TCLAP::ValueArg<std::string> arg_output_filename("o","output","Output file (i.e. .BIN), - for standard output",false,"DATA.BIN","filename");
         cmd.add(arg_output_filename);
 
         // operation modes
@@ -45,16 +106,223 @@ int main(int argc, char* argv[]) {
         TCLAP::SwitchArg arg_read("r","read","Read data from chip",false);
         TCLAP::SwitchArg arg_verify("v","verify","Verify data on chip",false);
         TCLAP::SwitchArg arg_test("t","test","Test all operations on the chip",false);
+        TCLAP::SwitchArg arg_bench("","bench","Benchmark command latency and throughput of the device",false);
         TCLAP::ValueArg<unsigned int> arg_bank("b", "bank", "Bank number", false, 0, "bank");
+        TCLAP::ValueArg<std::string> arg_offset("","offset","Sector-aligned chip address to write or verify the image at, e.g. 0x1000",false,"0","address");
+        TCLAP::ValueArg<unsigned int> arg_sectors("","sectors","Number of sectors to write or verify at the offset, padding the image",false,0,"sectors");
+        TCLAP::ValueArg<std::string> arg_banks("","banks","Range of banks to read, e.g. 2-5 (read mode)",false,"","first-last");
+        TCLAP::ValueArg<std::string> arg_range("","range","Range of bytes to read, e.g. 0x4000-0x40FF or 0x4000+256 (read mode)",false,"","first-last");
+        TCLAP::SwitchArg arg_hexdump("x","hexdump","Print the data read as a hexdump to standard output (read mode)",false);
+        TCLAP::ValueArg<std::string> arg_device("","device","Serial device of the programmer, skips device discovery",false,"","path");
+        TCLAP::ValueArg<std::string> arg_serial("","serial","USB serial number of the programmer, skips device discovery",false,"","serial");
+        TCLAP::SwitchArg arg_diff("d","diff","Only rewrite sectors that differ from the image (write mode)",false);
+        TCLAP::SwitchArg arg_skip_blank("s","skip-blank","Do not transfer sectors that only contain 0xFF (write mode)",false);
+        TCLAP::SwitchArg arg_pad_ff("","pad-ff","Pad short images with 0xFF instead of zeros (write mode)",false);
+        TCLAP::SwitchArg arg_pipeline("p","pipeline","Prepare and process sectors on worker threads while transferring",false);
+        TCLAP::SwitchArg arg_stream("","stream","Flash a URL input while it is being downloaded (write mode)",false);
+        TCLAP::ValueArg<std::string> arg_mismatch_map("","mismatch-map","Store the XOR of expected and actual data (write and verify modes)",false,"","filename");
+        // transport settings
+        TCLAP::ValueArg<std::string> arg_transport("","transport","Transport configuration file (key=value lines)",false,"","filename");
+        TCLAP::ValueArg<unsigned int> arg_baud("","baud","Baud rate of the serial port",false,19200,"baud");
+        TCLAP::ValueArg<unsigned int> arg_timeout("","timeout","Time to wait for a reply of the programmer",false,1000,"ms");
+        TCLAP::ValueArg<unsigned int> arg_window("","window","Number of sector writes or bank reads kept in flight (1-" + std::to_string(MAX_WINDOW) + ")",false,1,"commands");
+        TCLAP::ValueArg<unsigned int> arg_chunk_size("","chunk-size","Maximum number of bytes per write call",false,0x1000,"bytes");
+        TCLAP::SwitchArg arg_low_latency("","low-latency","Request low latency mode from the serial driver",false);
+        TCLAP::SwitchArg arg_no_sync("","no-sync","Do not open the serial port with O_SYNC",false);
+        TCLAP::SwitchArg arg_probe("","probe","Probe for the fastest reliable transport settings before the operation",false);
+        TCLAP::SwitchArg arg_gang("g","gang","Run on all connected programmers concurrently (erase, write and verify)",false);
+        TCLAP::ValueArg<std::string> arg_manifest("m","manifest","Manifest of files and their target banks or addresses (write and verify modes)",false,"","filename");
+        TCLAP::SwitchArg arg_offline("","offline","Only use cached copies of URL inputs",false);
+        TCLAP::SwitchArg arg_no_cache("","no-cache","Always download URL inputs and do not cache them",false);
+        TCLAP::SwitchArg arg_watch("","watch","Run the write or read job on every programmer that is plugged in",false);
+        TCLAP::ValueArg<std::string> arg_socket("","socket","Submit the job to a running picoflashd instead of opening the device",false,"","path");
+        TCLAP::SwitchArg arg_resume("","resume","Continue an interrupted whole-chip write without erasing the chip again",false);
+        TCLAP::SwitchArg arg_stats("","stats","Print latency histograms and system call counters of the serial port at exit",false);
+        TCLAP::ValueArg<std::string> arg_trace("","trace","Record a timeline of the session in Chrome trace event format",false,"","filename");
+        TCLAP::SwitchArg arg_json("","json","Write progress and a final summary as JSON lines to standard output",false);
         cmd.add(arg_erase);
         cmd.add(arg_test);
+        cmd.add(arg_bench);
         cmd.add(arg_write);
         cmd.add(arg_read);
         cmd.add(arg_verify);
         cmd.add(arg_bank);
+        cmd.add(arg_device);
+        cmd.add(arg_serial);
+        cmd.add(arg_diff);
+        cmd.add(arg_skip_blank);
+        cmd.add(arg_pad_ff);
+        cmd.add(arg_pipeline);
+        cmd.add(arg_gang);
+        cmd.add(arg_stream);
+        cmd.add(arg_mismatch_map);
+        cmd.add(arg_transport);
+        cmd.add(arg_baud);
+        cmd.add(arg_timeout);
+        cmd.add(arg_chunk_size);
+        cmd.add(arg_window);
+        cmd.add(arg_low_latency);
+        cmd.add(arg_no_sync);
+        cmd.add(arg_probe);
+        cmd.add(arg_socket);
+        cmd.add(arg_watch);
+        cmd.add(arg_manifest);
+        cmd.add(arg_offset);
+        cmd.add(arg_sectors);
+        cmd.add(arg_banks);
+        cmd.add(arg_range);
+        cmd.add(arg_hexdump);
+        cmd.add(arg_offline);
+        cmd.add(arg_no_cache);
+        cmd.add(arg_resume);
+        cmd.add(arg_json);
+        cmd.add(arg_stats);
+        cmd.add(arg_trace);
 
         cmd.parse(argc, argv);
 
+        // get operation mode
+        unsigned int modes = arg_erase.getValue() + arg_write.getValue() + arg_read.getValue() + arg_verify.getValue() + + arg_test.getValue()
+                           + arg_bench.getValue();
+        if(modes != 1) {
+            std::cerr << "Error: Please select one operation mode." << std::endl;
+            std::cerr << "Select one of the following modes: -e, -w, -r, -v, -t, --bench" << std::endl;
+            return 1;
+        }
+
+        if(arg_offline.getValue() && arg_no_cache.getValue()) {
+            throw std::runtime_error("Error: --offline and --no-cache are mutually exclusive.");
+        } else if(arg_offline.getValue()) {
+            UrlCache::set_mode(CacheMode::OFFLINE);
+        } else if(arg_no_cache.getValue()) {
+            UrlCache::set_mode(CacheMode::DISABLED);
+        }
+
+        if(arg_resume.getValue()) {
+            if(!arg_write.getValue() || arg_bank.isSet() || arg_diff.getValue() || arg_stream.getValue() || arg_gang.getValue()
+               || arg_watch.getValue() || arg_socket.isSet() || arg_manifest.isSet() || arg_offset.isSet() || arg_sectors.isSet()) {
+                throw std::runtime_error("Error: --resume only supports whole-chip writes (-w).");
+            }
+        }
+
+        if(arg_manifest.isSet()) {
+            if(!arg_write.getValue() && !arg_verify.getValue()) {
+                throw std::runtime_error("Error: A manifest can only be written (-w) or verified (-v).");
+            }
+            if(arg_gang.getValue() || arg_watch.getValue() || arg_socket.isSet() || arg_bank.isSet() || arg_diff.getValue() || arg_stream.getValue()) {
+                throw std::runtime_error("Error: A manifest cannot be combined with -b, -d, -g, --stream, --watch or --socket.");
+            }
+        }
+
+        // a partial image is written or verified as a single segment
+        bool partial = arg_offset.isSet() || arg_sectors.isSet();
+        if(partial) {
+            if(!arg_write.getValue() && !arg_verify.getValue()) {
+                throw std::runtime_error("Error: --offset and --sectors can only be used to write (-w) or verify (-v).");
+            }
+            if(arg_gang.getValue() || arg_watch.getValue() || arg_socket.isSet() || arg_bank.isSet() || arg_diff.getValue()
+               || arg_stream.getValue() || arg_manifest.isSet() || arg_mismatch_map.isSet()) {
+                throw std::runtime_error("Error: --offset and --sectors cannot be combined with -b, -d, -g, -m, --stream, --mismatch-map, --watch or --socket.");
+            }
+        }
+
+        // a read of part of the chip only issues the bank reads it needs
+        bool ranged = arg_read.getValue() && (arg_bank.isSet() || arg_banks.isSet() || arg_range.isSet() || arg_hexdump.getValue());
+        if(arg_banks.isSet() || arg_range.isSet() || arg_hexdump.getValue()) {
+            if(!arg_read.getValue()) {
+                throw std::runtime_error("Error: --banks, --range and --hexdump can only be used to read (-r).");
+            }
+            if(arg_bank.isSet() + arg_banks.isSet() + arg_range.isSet() > 1) {
+                throw std::runtime_error("Error: Select one of -b, --banks or --range.");
+            }
+        }
+        if(ranged && (arg_watch.getValue() || arg_socket.isSet())) {
+            throw std::runtime_error("Error: Partial reads cannot be combined with --watch or --socket.");
+        }
+        if(arg_hexdump.getValue() && (arg_output_filename.isSet() || arg_json.getValue())) {
+            throw std::runtime_error("Error: --hexdump writes to standard output and cannot be combined with -o or --json.");
+        }
+
+        if(arg_stats.getValue() && (arg_gang.getValue() || arg_watch.getValue() || arg_socket.isSet())) {
+            throw std::runtime_error("Error: --stats cannot be combined with -g, --watch or --socket.");
+        }
+
+        if(arg_trace.isSet()) {
+            if(arg_watch.getValue() || arg_socket.isSet()) {
+                throw std::runtime_error("Error: --trace cannot be combined with --watch or --socket.");
+            }
+            trace_filename = arg_trace.getValue();
+            tracer = std::make_unique<Tracer>();
+            tracer->activate();
+            Tracer::name_thread("main");
+        }
+
+        if(arg_json.getValue()) {
+            if(arg_gang.getValue() || arg_watch.getValue() || arg_socket.isSet() || arg_bench.getValue()) {
+                throw std::runtime_error("Error: --json cannot be combined with -g, --watch, --socket or --bench.");
+            }
+            if((arg_read.getValue() && arg_output_filename.getValue() == "-") || arg_mismatch_map.getValue() == "-") {
+                throw std::runtime_error("Error: --json writes to standard output, which is already used for data.");
+            }
+        }
+
+        // data written to standard output must not be mixed with progress messages
+        bool to_stdout = (arg_read.getValue() && arg_output_filename.getValue() == "-") || arg_mismatch_map.getValue() == "-"
+                         || arg_json.getValue() || arg_hexdump.getValue();
+        std::ostream data_out(std::cout.rdbuf());
+        if(to_stdout) {
+            std::cout.rdbuf(std::cerr.rdbuf());
+        }
+
+        // hand the job to picoflashd, which keeps the device open between jobs
+        if(arg_socket.isSet()) {
+            if(arg_test.getValue() || arg_bench.getValue() || arg_gang.getValue() || arg_stream.getValue() || arg_mismatch_map.isSet()) {
+                throw std::runtime_error("Error: --socket supports the -e, -w, -r and -v modes.");
+            }
+            if(arg_input_filename.getValue() == "-" || arg_output_filename.getValue() == "-") {
+                throw std::runtime_error("Error: Standard input and output cannot be used with --socket.");
+            }
+
+            // the daemon resolves paths relative to its own working directory
+            auto absolute = [](const std::string& filename) {
+                if(filename.empty() || filename[0] == '/' || filename.find("://") != std::string::npos) {
+                    return filename;
+                }
+                char cwd[4096];
+                if(getcwd(cwd, sizeof(cwd)) == nullptr) {
+                    throw std::runtime_error("Error: Cannot determine working directory.");
+                }
+                return std::string(cwd) + "/" + filename;
+            };
+
+            DaemonJob job;
+            job.device = arg_serial.isSet() ? SerialPort().find_by_serial(arg_serial.getValue()) : arg_device.getValue();
+            job.bank = arg_bank.isSet() ? (int)arg_bank.getValue() : -1;
+            job.diff = arg_diff.getValue();
+            job.skip_blank = arg_skip_blank.getValue();
+            job.pad_ff = arg_pad_ff.getValue();
+            job.pipelined = arg_pipeline.getValue();
+            if(arg_erase.getValue()) {
+                std::cout << TEXTRED << "Warning" << TEXTWHITE << ": This will erase the entire chip." << std::endl;
+                std::cout << "Do you want to continue? [y/N]: ";
+                char c;
+                std::cin >> c;
+                if(c != 'y' && c != 'Y') {
+                    std::cout << "Cancelling operation." << std::endl;
+                    return 0;
+                }
+                job.operation = "erase";
+            } else if(arg_read.getValue()) {
+                job.operation = "read";
+                job.filename = absolute(arg_output_filename.getValue());
+            } else {
+                job.operation = arg_write.getValue() ? "write" : "verify";
+                job.filename = absolute(arg_input_filename.getValue());
+            }
+
+            return DaemonClient::submit(arg_socket.getValue(), job) ? 0 : 1;
+        }
+
         // **************************************
         // Inform user about execution
         // **************************************
@@ -67,27 +335,99 @@ int main(int argc, char* argv[]) {
         std::cout << "Git Hash: " << PROGRAM_GIT_HASH << std::endl;
         std::cout << "--------------------------------------------------------------" << std::endl;
         
-        // get operation mode
-        unsigned int modes = arg_erase.getValue() + arg_write.getValue() + arg_read.getValue() + arg_verify.getValue() + + arg_test.getValue();
-        if(modes != 1) {
-            std::cerr << "Error: Please select one operation mode." << std::endl;
-            std::cerr << "Select one of the following modes: -e, -w, -r, -v, -t" << std::endl;
-            return 1;
+        // collect transport settings; command line options override the configuration file
+        SerialConfig transport;
+        if(arg_transport.isSet()) {
+            transport.load(arg_transport.getValue());
         }
-        
-        // loop over all serial devices and look for the signature of a RASPBERRY PI PICO
-        SerialPort sp;
-        auto devices = sp.list_serial_ports_with_ids();
-        std::string dev;
-        std::cout << "Listing serial devices:" << std::endl;
-        unsigned int ctr = 0;
-        for(const auto& device : devices) {
-            std::cout << (++ctr) << (". /dev/" + device.first) << " " << device.second;
-            if(device.second == "2e8a:0009") {
-                dev = "/dev/" + device.first;
-                std::cout << TEXTBLUE << " (*)" << TEXTWHITE << std::endl;
+        if(arg_baud.isSet()) {
+            transport.baud = arg_baud.getValue();
+        }
+        if(arg_timeout.isSet()) {
+            transport.timeout = std::max(arg_timeout.getValue(), 1u);
+        }
+        if(arg_chunk_size.isSet()) {
+            transport.chunk_size = std::max(arg_chunk_size.getValue(), 1u);
+        }
+        if(arg_window.isSet()) {
+            transport.window = std::clamp(arg_window.getValue(), 1u, (unsigned int)MAX_WINDOW);
+        }
+        if(arg_low_latency.isSet()) {
+            transport.low_latency = true;
+        }
+        if(arg_no_sync.isSet()) {
+            transport.sync = false;
+        }
+
+        // production line: wait for programmers to be plugged in and run the job on each of them
+        if(arg_watch.getValue()) {
+            WatchOptions options;
+            options.skip_blank = arg_skip_blank.getValue();
+            options.pad_ff = arg_pad_ff.getValue();
+            options.pipelined = arg_pipeline.getValue();
+            options.transport = transport;
+
+            std::vector<uint8_t> image;
+            if(arg_write.getValue()) {
+                if(arg_bank.isSet() || arg_diff.getValue() || arg_stream.getValue()) {
+                    throw std::runtime_error("Error: Watch mode only supports whole-chip writes.");
+                }
+                Flasher::read_file(arg_input_filename.getValue(), image);
+                options.operation = WatchOperation::WRITE;
+            } else if(arg_read.getValue()) {
+                if(arg_output_filename.getValue() == "-") {
+                    throw std::runtime_error("Error: Watch mode writes numbered dumps and cannot use standard output.");
+                }
+                options.operation = WatchOperation::DUMP;
+                options.output = arg_output_filename.getValue();
             } else {
-                std::cout << std::endl;
+                throw std::runtime_error("Error: Watch mode supports the -w and -r modes.");
+            }
+            Watch watch(image, options);
+
+            struct sigaction sa = {};
+            sa.sa_handler = handle_signal;
+            sigaction(SIGINT, &sa, nullptr);
+            sigaction(SIGTERM, &sa, nullptr);
+
+            watch.run(stop);
+            return 0;
+        }
+
+        std::string dev;
+        std::string device_id;          // identifies the programmer in the write journal
+        std::vector<std::string> gang_devices;
+        if(arg_device.isSet()) {
+            // use the given device as is, e.g. the pseudo-terminal of picoflash-emu
+            dev = arg_device.getValue();
+            gang_devices.push_back(dev);
+        } else if(arg_serial.isSet()) {
+            // select a single programmer by its USB serial number
+            SerialPort sp;
+            dev = sp.find_by_serial(arg_serial.getValue());
+            device_id = arg_serial.getValue();
+            std::cout << "Programmer " << arg_serial.getValue() << ": " << TEXTBLUE << dev << TEXTWHITE << std::endl;
+            gang_devices.push_back(dev);
+        } else {
+            // list the ttys of all RASPBERRY PI PICO programmers, ordered by USB port
+            SerialPort sp;
+            auto devices = sp.find_devices();
+            std::cout << "Listing programmers:" << std::endl;
+            unsigned int ctr = 0;
+            for(const auto& device : devices) {
+                std::cout << (++ctr) << ". " << device.device_path
+                          << " serial " << (device.serial.empty() ? "-" : device.serial)
+                          << " port " << (device.topology.empty() ? "-" : device.topology) << std::endl;
+                gang_devices.push_back(device.device_path);
+            }
+
+            if(!devices.empty()) {
+                dev = devices.front().device_path;
+                device_id = devices.front().serial;
+                if(devices.size() > 1 && !arg_gang.getValue()) {
+                    std::cout << "Using " << TEXTBLUE << dev << TEXTWHITE
+                              << "; select another programmer with --device or --serial." << std::endl;
+                }
             }
         }
 
@@ -96,23 +436,75 @@ int main(int argc, char* argv[]) {
             throw std::runtime_error("Error: No valid serial device found. Did you connect the PICO Flasher?");
         }
 
-        Flasher flasher(dev);
+        // run the operation on all programmers concurrently
+        if(arg_gang.getValue()) {
+            GangOptions options;
+            options.diff = arg_diff.getValue();
+            options.skip_blank = arg_skip_blank.getValue();
+            options.pad_ff = arg_pad_ff.getValue();
+            options.pipelined = arg_pipeline.getValue();
+            options.transport = transport;
+            Gang gang(gang_devices, options);
+
+            GangOperation operation;
+            std::vector<std::vector<uint8_t>> images;
+            if(arg_erase.getValue()) {
+                std::cout << TEXTRED << "Warning" << TEXTWHITE << ": This will erase the entire chip on "
+                          << gang_devices.size() << " devices." << std::endl;
+                std::cout << "Do you want to continue? [y/N]: ";
+                char c;
+                std::cin >> c;
+                if(c != 'y' && c != 'Y') {
+                    std::cout << "Cancelling operation." << std::endl;
+                    return 0;
+                }
+                operation = GangOperation::ERASE;
+            } else if(arg_write.getValue() || arg_verify.getValue()) {
+                if(arg_bank.isSet()) {
+                    throw std::runtime_error("Error: Gang mode only supports whole-chip operations.");
+                }
+
+                // a comma-separated list of inputs assigns one image per device
+                std::stringstream inputs(arg_input_filename.getValue());
+                std::string filename;
+                while(std::getline(inputs, filename, ',')) {
+                    images.emplace_back();
+                    Flasher::read_file(filename, images.back());
+                }
+                operation = arg_write.getValue() ? GangOperation::WRITE : GangOperation::VERIFY;
+            } else {
+                throw std::runtime_error("Error: Gang mode supports the -e, -w and -v modes.");
+            }
+
+            auto results = gang.run(operation, images);
+            bool pass = Gang::print_summary(results);
+            write_trace();
+            return pass ? 0 : 1;
+        }
+
+        // optionally collect a map of the differing bits during verification
+        std::vector<uint8_t> mismatch_map;
+        std::vector<uint8_t>* mismatch_map_ptr = arg_mismatch_map.isSet() ? &mismatch_map : nullptr;
+
+        if(arg_json.getValue()) {
+            events = std::make_unique<EventLog>(json_out);
+        }
+        operation = arg_test.getValue() ? "test" : arg_bench.getValue() ? "bench" : arg_erase.getValue() ? "erase" :
+                    arg_write.getValue() ? "write" : arg_read.getValue() ? "read" : "verify";
+        bool pass = true;               // outcome of all verifications of the run
+
+        Flasher flasher(dev, std::cout, transport);
+        flasher.set_pipelined(arg_pipeline.getValue());
+        flasher.set_events(events.get());
+        if(arg_stats.getValue()) {
+            stats = std::make_unique<SerialStats>();
+            flasher.set_stats(stats.get());
+        }
         uint16_t devid = flasher.read_chip_id();
-        size_t romsize = 0;
-        switch(devid) {
-            case 0xBFB7:
-                romsize = 512 * 1024;
-            break;
-            case 0xBFB6:
-                romsize = 256 * 1024;
-            break;
-            case 0xBFB5:
-                romsize = 128 * 1024;
-            break;
-            default:
-                throw std::logic_error("Error: Unknown device ID.");
-                return 1;
-            break;
+        size_t romsize = Flasher::get_rom_size(devid);
+
+        if(arg_probe.getValue()) {
+            flasher.probe_transport();
         }
 
         if(arg_test.getValue()) {
@@ -140,7 +532,7 @@ int main(int argc, char* argv[]) {
             // perform full-chip write
             flasher.erase_chip();
             flasher.write_chip(data);
-            flasher.verify_chip(data);
+            pass = flasher.verify_chip(data) && pass;
 
             // perform bank-wise write with new randomly generated data
             for (auto& byte : data) {
@@ -148,11 +540,35 @@ int main(int argc, char* argv[]) {
             }
 
             for(unsigned int i=0; i<romsize/BANKSIZE; i++) {
-                std::vector<uint8_t> chunk(data.begin() + i * BANKSIZE, data.begin() + (i + 1) * BANKSIZE);
+                auto chunk = std::span<const uint8_t>(data).subspan(i * BANKSIZE, BANKSIZE);
                 flasher.write_bank(chunk, i);
-                flasher.verify_bank(chunk, i);
+                pass = flasher.verify_bank(chunk, i) && pass;
+            }
+            pass = flasher.verify_chip(data) && pass;
+        } else if(arg_bench.getValue()) {
+            // the last bank serves as scratch area unless another one is chosen
+            unsigned int max_bank = romsize / BANKSIZE;
+            unsigned int bank = arg_bank.isSet() ? arg_bank.getValue() : max_bank - 1;
+            if(bank >= max_bank) {
+                throw std::runtime_error("Error: Bank number must be between 0 and " + std::to_string(max_bank-1) + ".");
+            }
+
+            std::cout << TEXTRED << "Warning" << TEXTWHITE << ": This will overwrite bank " << std::dec << bank
+                      << " and erase the entire chip." << std::endl;
+            std::cout << "Do you want to continue? [y/N]: ";
+            char c;
+            std::cin >> c;
+            if(c != 'y' && c != 'Y') {
+                std::cout << "Cancelling operation." << std::endl;
+                return 0;
+            }
+
+            Benchmark bench(flasher);
+            bench.run(bank);
+            bench.print_results();
+            if(arg_output_filename.isSet()) {
+                bench.write_json(arg_output_filename.getValue());
             }
-            flasher.verify_chip(data);
         } else if(arg_erase.getValue()) {
             std::cout << TEXTRED << "Warning" << TEXTWHITE << ": This will erase the entire chip." << std::endl;
             std::cout << "Do you want to continue? [y/N]: ";
@@ -164,6 +580,85 @@ int main(int argc, char* argv[]) {
             }
 
             flasher.erase_chip();
+        } else if(arg_manifest.isSet()) {
+            // compose all files into a single plan that is executed over this session
+            auto segments = Manifest::load(arg_manifest.getValue(), romsize);
+            std::cout << "Manifest holds " << TEXTBLUE << segments.size() << TEXTWHITE << " segments:" << std::endl;
+            for(const auto& segment : segments) {
+                std::cout << "  0x" << std::hex << std::uppercase << std::setw(5) << std::setfill('0') << segment.offset
+                          << " - 0x" << std::setw(5) << (segment.offset + segment.data.size() - 1) << std::dec << std::nouppercase
+                          << " (bank " << (segment.offset / BANKSIZE) << ") " << segment.source << std::endl;
+            }
+
+            if(arg_write.getValue()) {
+                flasher.write_segments(segments, arg_skip_blank.getValue());
+            }
+            pass = flasher.verify_segments(segments);
+        } else if(partial) {
+            // only the sectors covered by the image are erased, written and verified
+            Segment segment;
+            segment.source = arg_input_filename.getValue();
+            uint64_t offset = 0;
+            try {
+                offset = std::stoull(arg_offset.getValue(), nullptr, 0);
+            } catch(const std::exception&) {
+                throw std::runtime_error("Error: Invalid offset " + arg_offset.getValue() + ".");
+            }
+            if(offset % SECTORSIZE != 0) {
+                throw std::runtime_error("Error: Offset must be a multiple of 4 KiB (0x1000).");
+            }
+            // check against the chip before narrowing to a chip address
+            if(offset >= romsize) {
+                throw std::runtime_error("Error: Offset lies beyond the end of the chip.");
+            }
+            segment.offset = offset;
+            flasher.read_file(segment.source, segment.data);
+
+            if(arg_sectors.isSet()) {
+                size_t size = (size_t)arg_sectors.getValue() * SECTORSIZE;
+                if(size == 0 || segment.data.size() > size) {
+                    throw std::runtime_error("Error: The image does not fit in " + std::to_string(arg_sectors.getValue()) + " sectors.");
+                } else if(segment.data.size() < size) {
+                    if(arg_pad_ff.getValue()) {
+                        std::cout << "Resizing file to " << arg_sectors.getValue() << " sectors, appending 0xFF." << std::endl;
+                        segment.data.resize(size, 0xFF);
+                    } else {
+                        std::cout << "Resizing file to " << arg_sectors.getValue() << " sectors, appending zeros." << std::endl;
+                        segment.data.resize(size, 0);
+                    }
+                }
+            } else if(segment.data.empty() || segment.data.size() % SECTORSIZE != 0) {
+                throw std::runtime_error("Error: File size must be a multiple of 4 KiB; use --sectors to pad it.");
+            }
+            if(segment.offset + segment.data.size() > romsize) {
+                throw std::runtime_error("Error: The image does not fit on the chip at this offset.");
+            }
+
+            unsigned int first = segment.offset / SECTORSIZE;
+            unsigned int last = first + segment.data.size() / SECTORSIZE - 1;
+            std::cout << (arg_write.getValue() ? "Flashing" : "Checking") << " sectors " << TEXTBLUE << std::hex << std::uppercase
+                      << std::setw(2) << std::setfill('0') << first << "-" << std::setw(2) << last << TEXTWHITE
+                      << " (0x" << std::setw(5) << segment.offset << " - 0x" << std::setw(5) << (segment.offset + segment.data.size() - 1)
+                      << ")" << std::dec << std::nouppercase << std::setfill(' ') << std::endl;
+
+            std::vector<Segment> segments = {segment};
+            if(arg_write.getValue()) {
+                flasher.write_segments(segments, arg_skip_blank.getValue());
+            }
+            pass = flasher.verify_segments(segments);
+        } else if(arg_write.getValue() && arg_stream.getValue()) {
+            // overlap the download with erasing and flashing the chip
+            const std::string& url = arg_input_filename.getValue();
+            if(url.find("https://") != 0 && url.find("http://") != 0) {
+                throw std::runtime_error("Error: Streaming requires a URL as input.");
+            }
+            if(arg_bank.isSet() || arg_diff.getValue()) {
+                throw std::runtime_error("Error: Streaming only supports whole-chip writes.");
+            }
+
+            std::vector<uint8_t> data(romsize, arg_pad_ff.getValue() ? 0xFF : 0);
+            flasher.stream_chip(url, data, arg_skip_blank.getValue());
+            pass = flasher.verify_chip(data);
         } else if(arg_write.getValue()) {
             std::vector<uint8_t> data;
             flasher.read_file(arg_input_filename.getValue(), data);
@@ -184,23 +679,83 @@ int main(int argc, char* argv[]) {
                 }
 
                 flasher.write_bank(data, bank);     // write_bank automatically erases the bank
-                flasher.verify_bank(data, bank);    // verify that data has been written correctly
+                pass = flasher.verify_bank(data, bank, mismatch_map_ptr);    // verify that data has been written correctly
             } else {
                 if(data.size() > romsize) {
                     throw std::runtime_error("Error: File size too large.");
                 } else if(romsize > data.size()) {
-                    std::cout << "Resizing file to match chip size, appending zeros." << std::endl;
-                    data.resize(romsize, 0);
+                    if(arg_pad_ff.getValue()) {
+                        std::cout << "Resizing file to match chip size, appending 0xFF." << std::endl;
+                        data.resize(romsize, 0xFF);
+                    } else {
+                        std::cout << "Resizing file to match chip size, appending zeros." << std::endl;
+                        data.resize(romsize, 0);
+                    }
+                }
+
+                if(arg_diff.getValue()) {
+                    flasher.write_chip_diff(data);
+                    pass = flasher.verify_chip(data, mismatch_map_ptr);
+                } else {
+                    // record the acknowledged sectors, such that an interrupted write can be resumed
+                    Journal journal(device_id.empty() ? dev : device_id, UrlCache::calculate_sha256(data.data(), data.size()), romsize);
+                    if(arg_resume.getValue() && journal.resume()) {
+                        std::cout << "Resuming from journal " << TEXTBLUE << journal.get_path() << TEXTWHITE << std::endl;
+                        flasher.resume_chip(data, journal, arg_skip_blank.getValue());
+                    } else {
+                        if(arg_resume.getValue()) {
+                            std::cout << "No interrupted write of this image found, writing the whole chip." << std::endl;
+                        }
+                        try {
+                            journal.start();
+                        } catch(const std::exception& e) {
+                            std::cout << TEXTRED << "Warning" << TEXTWHITE << ": " << e.what() << "; the write cannot be resumed." << std::endl;
+                        }
+                        flasher.erase_chip();
+                        flasher.write_chip(data, arg_skip_blank.getValue(), nullptr, &journal);
+                    }
+                    pass = flasher.verify_chip(data, mismatch_map_ptr);
+                    if(pass) {
+                        journal.finish();
+                    }
                 }
+            }
+        } else if(ranged) {
+            // determine the bytes to read; a hexdump without a range shows the whole chip
+            uint64_t max_bank = romsize / BANKSIZE;
+            uint64_t address = 0;
+            uint64_t size = romsize;
+            if(arg_bank.isSet()) {
+                if(arg_bank.getValue() >= max_bank) {
+                    throw std::runtime_error("Error: Bank number must be between 0 and " + std::to_string(max_bank-1) + ".");
+                }
+                address = (uint64_t)arg_bank.getValue() * BANKSIZE;
+                size = BANKSIZE;
+            } else if(arg_banks.isSet()) {
+                auto banks = parse_range(arg_banks.getValue(), "--banks");
+                if(banks.first >= max_bank || banks.second > max_bank - banks.first) {
+                    throw std::runtime_error("Error: Bank numbers must be between 0 and " + std::to_string(max_bank-1) + ".");
+                }
+                address = banks.first * BANKSIZE;
+                size = banks.second * BANKSIZE;
+            } else if(arg_range.isSet()) {
+                std::tie(address, size) = parse_range(arg_range.getValue(), "--range");
+            }
+            if(size == 0 || address >= romsize || size > romsize - address) {
+                throw std::runtime_error("Error: The range to read must lie within the chip of " + std::to_string(romsize) + " bytes.");
+            }
 
-                flasher.erase_chip();
-                flasher.write_chip(data);
-                flasher.verify_chip(data);
+            std::cout << "Reading banks " << TEXTBLUE << std::dec << (address / BANKSIZE) << "-" << ((address + size - 1) / BANKSIZE)
+                      << TEXTWHITE << " for " << size << " bytes" << std::endl;
+            std::vector<uint8_t> data(size);
+            flasher.read_range((uint32_t)address, data);
+            if(arg_hexdump.getValue()) {
+                Flasher::write_hexdump(data_out, data, (uint32_t)address);
+            } else {
+                Flasher::write_file(arg_output_filename.getValue(), data);
             }
         } else if(arg_read.getValue()) {
-            std::vector<uint8_t> data(romsize, 0);
-            flasher.read_chip(data);
-            flasher.write_file(arg_output_filename.getValue(), data);
+            flasher.dump_chip(arg_output_filename.getValue(), romsize);
         } else if(arg_verify.getValue()) {
             std::vector<uint8_t> data;
             flasher.read_file(arg_input_filename.getValue(), data);
@@ -221,21 +776,42 @@ int main(int argc, char* argv[]) {
                     throw std::runtime_error("Error: Bank number must be between 0 and " + std::to_string(max_bank-1) + ".");
                 }
                 
-                flasher.verify_bank(data, bank);
+                pass = flasher.verify_bank(data, bank, mismatch_map_ptr);
             } else {
                 if(data.size() != romsize) {
                     throw std::runtime_error("Error: File size does not match chip size.");
                 }
                 
-                flasher.verify_chip(data);
+                pass = flasher.verify_chip(data, mismatch_map_ptr);
             }
         }
 
+        if(mismatch_map_ptr && !mismatch_map.empty()) {
+            Flasher::write_file(arg_mismatch_map.getValue(), mismatch_map);
+        }
+
+        if(stats) {
+            stats->print(std::cout);
+        }
+        write_trace();
         std::cout << "All done!" << std::endl;
+        if(events) {
+            events->summary(operation, pass ? "pass" : "fail");
+        }
 
         return 0;
     } catch (TCLAP::ArgException &e) {
         std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
         return -1;
+    } catch (const std::exception& e) {
+        // the run ends here, but the statistics and the summary of the events are still reported
+        if(stats) {
+            stats->print(std::cout);
+        }
+        write_trace();
+        if(events) {
+            events->summary(operation, "error", e.what());
+        }
+        throw;
     }
 }
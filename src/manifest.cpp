@@ -0,0 +1,136 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "manifest.h"
+#include "flasher.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+/**
+ * Reads a manifest and loads all files it refers to. Every line holds
+ * a target, either bank=<n> or offset=<address>, followed by a file or
+ * URL. Empty lines and lines starting with '#' are ignored. Relative
+ * paths are taken relative to the directory of the manifest.
+ * @param filename Name of the manifest.
+ * @param romsize Size of the chip in bytes.
+ * @param out Stream to write progress to.
+ * @return Segments sorted by address.
+ * @throws std::runtime_error on invalid entries, or when segments
+ *         overlap or do not fit on the chip.
+ */
+std::vector<Segment> Manifest::load(const std::string& filename, size_t romsize, std::ostream& out) {
+    std::ifstream infile(filename);
+    if(!infile) {
+        throw std::runtime_error("Error opening manifest: " + filename);
+    }
+
+    size_t slash = filename.rfind('/');
+    std::string directory = slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+
+    std::vector<Segment> segments;
+    std::string line;
+    unsigned int linenr = 0;
+    while(std::getline(infile, line)) {
+        linenr++;
+        std::string error = "Error in " + filename + " line " + std::to_string(linenr) + ": ";
+
+        // strip whitespace and skip comments
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        std::string target;
+        std::string source;
+        if(!(fields >> target >> source)) {
+            throw std::runtime_error(error + "expected a target and a file.");
+        }
+
+        size_t pos = target.find('=');
+        std::string key = target.substr(0, pos);
+        std::string value = pos == std::string::npos ? "" : target.substr(pos + 1);
+
+        if(key != "bank" && key != "offset") {
+            throw std::runtime_error(error + "unknown target " + target + ", expected bank=<n> or offset=<address>.");
+        }
+        uint64_t number = 0;
+        try {
+            number = std::stoull(value, nullptr, 0);
+        } catch(const std::logic_error&) {
+            throw std::runtime_error(error + "invalid value for " + key + ".");
+        }
+
+        // check against the chip before narrowing to a chip address
+        Segment segment;
+        if(key == "bank") {
+            uint64_t max_bank = romsize / BANKSIZE;
+            if(number >= max_bank) {
+                throw std::runtime_error(error + "bank must be between 0 and " + std::to_string(max_bank-1) + ".");
+            }
+            segment.offset = number * BANKSIZE;
+        } else {
+            if(number >= romsize) {
+                throw std::runtime_error(error + "offset lies beyond the end of the chip.");
+            }
+            segment.offset = number;
+        }
+
+        if(source.find("://") == std::string::npos && source[0] != '/') {
+            source = directory + source;
+        }
+        segment.source = source;
+        Flasher::read_file(source, segment.data, out);
+        segments.push_back(std::move(segment));
+    }
+
+    Manifest::validate(segments, romsize);
+    return segments;
+}
+
+/**
+ * Sorts segments by address and checks that they neither overlap nor
+ * exceed the chip.
+ * @param segments Segments to check.
+ * @param romsize Size of the chip in bytes.
+ * @throws std::runtime_error if segments overlap or do not fit on the chip.
+ */
+void Manifest::validate(std::vector<Segment>& segments, size_t romsize) {
+    std::sort(segments.begin(), segments.end(), [](const Segment& a, const Segment& b) {
+        return a.offset < b.offset;
+    });
+
+    for(unsigned int i=0; i<segments.size(); i++) {
+        if(segments[i].data.empty()) {
+            throw std::runtime_error("Error: " + segments[i].source + " is empty.");
+        }
+        if(segments[i].offset + segments[i].data.size() > romsize) {
+            throw std::runtime_error("Error: " + segments[i].source + " does not fit on the chip.");
+        }
+        if(i > 0 && segments[i-1].offset + segments[i-1].data.size() > segments[i].offset) {
+            throw std::runtime_error("Error: " + segments[i-1].source + " overlaps with " + segments[i].source + ".");
+        }
+    }
+}
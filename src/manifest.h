@@ -0,0 +1,60 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Contiguous block of data placed at an address of the chip
+struct Segment {
+    uint32_t offset = 0;            // chip address of the first byte
+    std::vector<uint8_t> data;      // data to place on the chip
+    std::string source;             // file or URL the data originates from
+};
+
+class Manifest {
+public:
+    /**
+     * Reads a manifest and loads all files it refers to. Every line holds
+     * a target, either bank=<n> or offset=<address>, followed by a file or
+     * URL. Empty lines and lines starting with '#' are ignored. Relative
+     * paths are taken relative to the directory of the manifest.
+     * @param filename Name of the manifest.
+     * @param romsize Size of the chip in bytes.
+     * @param out Stream to write progress to.
+     * @return Segments sorted by address.
+     * @throws std::runtime_error on invalid entries, or when segments
+     *         overlap or do not fit on the chip.
+     */
+    static std::vector<Segment> load(const std::string& filename, size_t romsize, std::ostream& out = std::cout);
+
+    /**
+     * Sorts segments by address and checks that they neither overlap nor
+     * exceed the chip.
+     * @param segments Segments to check.
+     * @param romsize Size of the chip in bytes.
+     * @throws std::runtime_error if segments overlap or do not fit on the chip.
+     */
+    static void validate(std::vector<Segment>& segments, size_t romsize);
+};
@@ -0,0 +1,156 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "mappedfile.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Maps an existing file read-only.
+ * @param filename Name of the file to map.
+ */
+MappedFile::MappedFile(const std::string& filename) {
+    this->fd = open(filename.c_str(), O_RDONLY);
+    if(this->fd < 0) {
+        throw std::runtime_error("Error opening file.");
+    }
+
+    struct stat st;
+    if(fstat(this->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(this->fd);
+        throw std::runtime_error("Error reading file.");
+    }
+    this->size = st.st_size;
+    this->map(filename);
+
+    // images are consumed front to back
+    if(this->ptr) {
+        madvise(this->ptr, this->size, MADV_SEQUENTIAL);
+    }
+}
+
+/**
+ * Creates or truncates a file of the given size and maps it writable.
+ * @param filename Name of the file to create.
+ * @param size Size of the file in bytes.
+ */
+MappedFile::MappedFile(const std::string& filename, size_t size) {
+    this->writable = true;
+    this->fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(this->fd < 0) {
+        throw std::runtime_error("Error opening file.");
+    }
+
+    // reserve the blocks up front, such that running out of space fails here
+    // rather than with SIGBUS while storing data in the mapping
+    this->size = size;
+    int err = posix_fallocate(this->fd, 0, size);
+    if(err == EOPNOTSUPP || err == EINVAL) {
+        err = ftruncate(this->fd, size) == 0 ? 0 : errno;
+    }
+    if(err != 0) {
+        close(this->fd);
+        throw std::runtime_error("Error allocating " + filename + ": " + std::strerror(err));
+    }
+    this->map(filename);
+}
+
+/**
+ * Gets the contents of a writable mapping.
+ * @return Contents of the file.
+ */
+std::span<uint8_t> MappedFile::data() {
+    if(!this->writable) {
+        throw std::logic_error("Error: File is mapped read-only.");
+    }
+    return std::span<uint8_t>(this->ptr, this->size);
+}
+
+/**
+ * Flushes the contents of a writable mapping to the file.
+ */
+void MappedFile::sync() {
+    if(this->writable && this->ptr && msync(this->ptr, this->size, MS_SYNC) != 0) {
+        throw std::runtime_error(std::string("Error writing file: ") + std::strerror(errno));
+    }
+}
+
+/**
+ * Unmaps a writable file and shortens it, e.g. to the part of a dump
+ * that has been completed.
+ * @param size New size of the file in bytes.
+ */
+void MappedFile::truncate(size_t size) {
+    if(!this->writable) {
+        throw std::logic_error("Error: File is mapped read-only.");
+    }
+    if(this->ptr) {
+        munmap(this->ptr, this->size);
+        this->ptr = nullptr;
+    }
+    this->size = 0;
+    if(ftruncate(this->fd, size) != 0) {
+        throw std::runtime_error(std::string("Error truncating file: ") + std::strerror(errno));
+    }
+}
+
+/**
+ * Destructor for the MappedFile class.
+ */
+MappedFile::~MappedFile() {
+    if(this->ptr) {
+        munmap(this->ptr, this->size);
+    }
+    if(this->fd >= 0) {
+        close(this->fd);
+    }
+}
+
+/**********************************************************************************
+ * PRIVATE FUNCTIONS
+ **********************************************************************************/
+
+/**
+ * Maps the open file.
+ * @param filename Name of the file, used in error messages.
+ */
+void MappedFile::map(const std::string& filename) {
+    // empty files cannot be mapped and are represented by an empty span
+    if(this->size == 0) {
+        return;
+    }
+
+    int prot = this->writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    int flags = this->writable ? MAP_SHARED : MAP_PRIVATE;
+    void* addr = mmap(nullptr, this->size, prot, flags, this->fd, 0);
+    if(addr == MAP_FAILED) {
+        int err = errno;
+        close(this->fd);
+        this->fd = -1;
+        throw std::runtime_error("Error mapping " + filename + ": " + std::strerror(err));
+    }
+    this->ptr = reinterpret_cast<uint8_t*>(addr);
+}
@@ -0,0 +1,95 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <string>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * File mapped into memory, either read-only to load an image without
+ * copying it through a stream buffer, or writable and preallocated such
+ * that data lands in the file as soon as it is stored in the mapping.
+ */
+class MappedFile {
+private:
+    int fd = -1;                    // file descriptor of the mapped file
+    uint8_t* ptr = nullptr;         // start of the mapping, null for empty files
+    size_t size = 0;                // size of the mapping in bytes
+    bool writable = false;          // mapping is shared and writable
+
+public:
+    /**
+     * Maps an existing file read-only.
+     * @param filename Name of the file to map.
+     */
+    MappedFile(const std::string& filename);
+
+    /**
+     * Creates or truncates a file of the given size and maps it writable.
+     * @param filename Name of the file to create.
+     * @param size Size of the file in bytes.
+     */
+    MappedFile(const std::string& filename, size_t size);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * Gets the contents of a writable mapping.
+     * @return Contents of the file.
+     */
+    std::span<uint8_t> data();
+
+    /**
+     * Gets the contents of the mapping.
+     * @return Contents of the file.
+     */
+    std::span<const uint8_t> data() const {
+        return std::span<const uint8_t>(this->ptr, this->size);
+    }
+
+    /**
+     * Flushes the contents of a writable mapping to the file.
+     */
+    void sync();
+
+    /**
+     * Unmaps a writable file and shortens it, e.g. to the part of a dump
+     * that has been completed.
+     * @param size New size of the file in bytes.
+     */
+    void truncate(size_t size);
+
+    /**
+     * Destructor for the MappedFile class.
+     */
+    ~MappedFile();
+
+private:
+    /**
+     * Maps the open file.
+     * @param filename Name of the file, used in error messages.
+     */
+    void map(const std::string& filename);
+};
@@ -19,12 +19,23 @@
  **************************************************************************/
 
 #include "serial.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
 
 /**
  * Constructor for the Serial class.
+ * @param out Stream to write status messages to.
+ * @param config Settings of the serial transport.
  */
-Serial::Serial() {
+Serial::Serial(std::ostream& out, const SerialConfig& config) {
     this->fd = -1;
+    this->out = &out;
+    this->config = config;
 }
 
 /**
@@ -33,29 +44,31 @@ Serial::Serial() {
  */
 void Serial::open_serial_port(const char* port_name) {
     if(!this->is_open) {
-        this->fd = open(port_name, O_RDWR | O_NOCTTY | O_SYNC);
+        // non-blocking, every wait is bounded by poll()
+        this->fd = open(port_name, O_RDWR | O_NOCTTY | O_NONBLOCK | (this->config.sync ? O_SYNC : 0));
         if (this->fd < 0) {
-            std::cerr << "Error opening " << port_name << ": " << std::strerror(errno) << std::endl;
+            throw std::runtime_error(std::string("Error opening ") + port_name + ": " + std::strerror(errno));
         }
+        this->is_open = true;
     } else {
         throw std::logic_error("Error: Serial port already open.");
     }
 
-    std::cout << "Opening serial port: " << port_name << std::endl;
+    *this->out << "Opening serial port: " << port_name << std::endl;
 }
 
 /**
- * Configures the serial port with the given file descriptor and speed.
- * @param speed Baud rate for the serial communication.
+ * Configures the serial port using the transport settings.
  * @return True if configuration is successful, false otherwise.
  */
-bool Serial::configure_serial_port(int speed) {
+bool Serial::configure_serial_port() {
     struct termios tty;
     if (tcgetattr(this->fd, &tty) != 0) {
         std::cerr << "Error from tcgetattr: " << std::strerror(errno) << std::endl;
         return false;
     }
 
+    speed_t speed = this->config.get_speed();
     cfsetospeed(&tty, speed);
     cfsetispeed(&tty, speed);
 
@@ -64,8 +77,8 @@ bool Serial::configure_serial_port(int speed) {
     tty.c_iflag &= ~ICRNL;                      // disable CR-to-NL translation
     tty.c_lflag = 0;                            // no signaling chars, no echo, no canonical processing
     tty.c_oflag = 0;                            // no remapping, no delays
-    tty.c_cc[VMIN] = 0;                         // read
-    tty.c_cc[VTIME] = 5;                        // 0.5 seconds read timeout
+    tty.c_cc[VMIN] = 0;                         // reads return what is available,
+    tty.c_cc[VTIME] = 0;                        // waiting is done by poll()
     tty.c_iflag &= ~(IXON | IXOFF | IXANY);     // no xon/xoff ctrl
     tty.c_cflag |= (CLOCAL | CREAD);            // ignore modem controls, enable reading
     tty.c_cflag &= ~(PARENB | PARODD);          // no parity
@@ -76,21 +89,40 @@ bool Serial::configure_serial_port(int speed) {
         std::cerr << "Error from tcsetattr: " << std::strerror(errno) << std::endl;
         return false;
     }
+
+    // not every driver supports low latency mode, hence only warn on failure
+    if (this->config.low_latency) {
+        struct serial_struct serinfo;
+        if (ioctl(this->fd, TIOCGSERIAL, &serinfo) == 0) {
+            serinfo.flags |= ASYNC_LOW_LATENCY;
+            if (ioctl(this->fd, TIOCSSERIAL, &serinfo) != 0) {
+                std::cerr << "Warning: cannot enable low latency mode: " << std::strerror(errno) << std::endl;
+            }
+        } else {
+            std::cerr << "Warning: cannot enable low latency mode: " << std::strerror(errno) << std::endl;
+        }
+    }
+
+    // discard anything left over from a previous session
+    tcflush(this->fd, TCIOFLUSH);
+
     return true;
 }
 
 std::string Serial::read_device_info() {
+    TraceSpan span("read_device_info", "serial");
+    auto start = std::chrono::steady_clock::now();
+
     // send command
     this->send_command("READINFO");
 
-    char buffer[24];
-    int n = this->read_from_serial_port(buffer, 16);
-    if (n < 0) {
-        throw std::runtime_error(std::string("Error reading from serial port: ") + 
-                                 std::string(std::strerror(errno)));
-    }
+    uint8_t buffer[16];
+    this->read_exact(buffer, sizeof(buffer), this->config.timeout, "device information");
 
-    return std::string(buffer, n);
+    if(this->stats) {
+        this->stats->record(SerialOp::OTHER, start);
+    }
+    return std::string(reinterpret_cast<char*>(buffer), sizeof(buffer));
 }
 
 /**
@@ -98,32 +130,28 @@ std::string Serial::read_device_info() {
  * @return Device ID as a 16-bit unsigned integer.
  */
 uint16_t Serial::get_device_id() {
+    TraceSpan span("get_device_id", "serial");
+    auto start = std::chrono::steady_clock::now();
     this->send_command("DEVIDSST");
-    uint16_t val;
-    int n = this->read_from_serial_port((char*)&val, 2);
-    if (n < 0) {
-        throw std::runtime_error(std::string("Error reading from serial port: ") + 
-                                 std::string(std::strerror(errno)));
+    uint16_t devid = this->read_value("DEVIDSST", this->config.timeout);
+    if(this->stats) {
+        this->stats->record(SerialOp::OTHER, start);
     }
-
-    // swap the two bytes
-    return (val >> 8) | (val << 8);
+    return devid;
 }
 
 /**
  * Erases the chip.
  */
 uint16_t Serial::erase_chip() {
+    TraceSpan span("erase_chip", "serial");
+    auto start = std::chrono::steady_clock::now();
     this->send_command("ERASEALL");
-    uint16_t val;
-    int n = this->read_from_serial_port((char*)&val, 2);
-    if (n < 0) {
-        throw std::runtime_error(std::string("Error reading from serial port: ") + 
-                                 std::string(std::strerror(errno)));
+    uint16_t polls = this->read_value("ERASEALL", this->config.timeout + DEADLINE_CHIP_ERASE);
+    if(this->stats) {
+        this->stats->record(SerialOp::ERASE_CHIP, start, 0, polls);
     }
-
-    // swap the two bytes
-    return (val >> 8) | (val << 8);
+    return polls;
 }
 
 /**
@@ -131,73 +159,235 @@ uint16_t Serial::erase_chip() {
  * @param sector which sector to erase
  */
 uint16_t Serial::erase_sector(uint16_t sector) {
+    TraceSpan span("erase_sector", "serial");
+    span.arg("sector", sector);
+    auto start = std::chrono::steady_clock::now();
     char cmd[9];
     sprintf(cmd, "ESST%04X", sector * 0x10);
     this->send_command(cmd);
-    uint16_t val;
-    int n = this->read_from_serial_port((char*)&val, 2);
-    if (n < 0) {
-        throw std::runtime_error(std::string("Error reading from serial port: ") + 
-                                 std::string(std::strerror(errno)));
+    uint16_t polls = this->read_value(cmd, this->config.timeout + DEADLINE_SECTOR_ERASE);
+    if(this->stats) {
+        this->stats->record(SerialOp::ERASE_SECTOR, start, 0, polls);
     }
-
-    // swap the two bytes
-    return (val >> 8) | (val << 8);
+    return polls;
 }
 
 /**
  * Write sector on flash chip.
  * @param sector which sector to write to
- * @param data data to write to sector
+ * @param data data to write to sector, viewed in place
  * @return Number of bytes written, or -1 on error.
  */
-uint16_t Serial::write_sector(uint16_t sector, const std::vector<uint8_t>& data) {
+uint16_t Serial::write_sector(uint16_t sector, std::span<const uint8_t> data) {
+    TraceSpan span("write_sector", "serial");
+    span.arg("sector", sector);
     if(data.size() != 0x1000) {
         throw std::runtime_error("Error: Data size must be 4KB");
     }
     
+    auto start = std::chrono::steady_clock::now();
     char cmd[9];
     sprintf(cmd, "WRSECT%02X", sector);
     this->send_command(cmd);
+    this->write_all(data.data(), data.size(), this->config.timeout, std::string("data of ") + cmd);
 
-    size_t byteswritten = 0;
+    // the checksum is sent least significant byte first
+    uint8_t val[2];
+    this->read_exact(val, 2, this->config.timeout + DEADLINE_SECTOR_PROGRAM, std::string("checksum of ") + cmd);
 
-    while(byteswritten < 0x1000) {
-        int n = this->write_to_serial_port((char*)data.data() + byteswritten, 0x1000 - byteswritten);
-        if(n < 0) {
-            throw std::runtime_error(std::string("Error writing to serial port: ") + 
-                                     std::string(std::strerror(errno)));
-        }
-        byteswritten += n;
+    if(this->stats) {
+        this->stats->record(SerialOp::WRITE_SECTOR, start, data.size());
     }
-
-    uint16_t val;
-    this->read_from_serial_port((char*)&val, 2);
-
-    return val;
+    return val[0] | (val[1] << 8);
 }
 
 /**
  * Reads data from sector on flash chip.
  * @param sector which sector to read from
- * @param data data to read from sector
+ * @param data caller-owned buffer of one bank that receives the data
  */
-void Serial::read_bank(uint16_t bank, std::vector<uint8_t>& chunk) {
+void Serial::read_bank(uint16_t bank, std::span<uint8_t> chunk) {
+    TraceSpan span("read_bank", "serial");
+    span.arg("bank", bank);
     if(chunk.size() != BANKSIZE) {
         throw std::runtime_error("Error: Data size must be 16KB");
     }
+    auto start = std::chrono::steady_clock::now();
     char cmd[9];
     sprintf(cmd, "RDBANK%02X", bank);
     this->send_command(cmd);
-    unsigned int bytesread = 0;
-    while(bytesread < BANKSIZE) {
-        int n = this->read_from_serial_port((char*)chunk.data() + bytesread, BANKSIZE - bytesread);
-        if(n < 0) {
-            throw std::runtime_error(std::string("Error reading from serial port: ") + 
-                                     std::string(std::strerror(errno)));
-        }
-        bytesread += n;
+    this->read_exact(chunk.data(), BANKSIZE, this->config.timeout, std::string("data of ") + cmd);
+    if(this->stats) {
+        this->stats->record(SerialOp::READ_BANK, start, BANKSIZE);
+    }
+}
+
+/**
+ * Prepares a sector write for transact().
+ * @param sector which sector to write to
+ * @param data data to write to sector, viewed in place
+ * @param command Command that receives the request.
+ */
+void Serial::prepare_write_sector(uint16_t sector, std::span<const uint8_t> data, SerialCommand& command) const {
+    if(data.size() != 0x1000) {
+        throw std::runtime_error("Error: Data size must be 4KB");
+    }
+    snprintf(command.cmd, sizeof(command.cmd), "WRSECT%02X", (uint8_t)sector);
+    command.payload = data;
+    command.reply = std::span<uint8_t>(command.value, 2);
+    command.timeout_ms = this->config.timeout + DEADLINE_SECTOR_PROGRAM;
+    command.op = SerialOp::WRITE_SECTOR;
+}
+
+/**
+ * Prepares a bank read for transact().
+ * @param bank which bank to read from
+ * @param data caller-owned buffer of one bank that receives the data
+ * @param command Command that receives the request.
+ */
+void Serial::prepare_read_bank(uint16_t bank, std::span<uint8_t> data, SerialCommand& command) const {
+    if(data.size() != BANKSIZE) {
+        throw std::runtime_error("Error: Data size must be 16KB");
     }
+    snprintf(command.cmd, sizeof(command.cmd), "RDBANK%02X", (uint8_t)bank);
+    command.payload = {};
+    command.reply = data;
+    command.timeout_ms = this->config.timeout;
+    command.op = SerialOp::READ_BANK;
+}
+
+/**
+ * Sends a sequence of commands while keeping up to window of them in
+ * flight. Echoes and replies are matched in the order in which the
+ * commands were sent, while further commands are being sent, such that
+ * the round trip of one command overlaps with the transfer of the next.
+ * @param window Largest number of commands in flight.
+ * @param next Fills in the next command; returns false if there are no more commands.
+ * @param done Called in order for every completed command; returning false stops
+ *             sending further commands.
+ * @throws SerialTimeout if a reply does not arrive before its deadline.
+ * @throws SerialProtocolError if a command is not echoed correctly.
+ */
+void Serial::transact(unsigned int window, const std::function<bool(SerialCommand&)>& next,
+                      const std::function<bool(SerialCommand&)>& done) {
+    TraceSpan span("transact", "serial");
+    span.arg("window", window);
+
+    bool more = true;
+    auto last_progress = std::chrono::steady_clock::now();
+    while(true) {
+        // top up the window
+        while(more && this->inflight.size() < window) {
+            SerialCommand& command = this->inflight.emplace_back();
+            if(!next(command)) {
+                this->inflight.pop_back();
+                more = false;
+                break;
+            }
+            command.issued = std::chrono::steady_clock::now();
+        }
+        if(this->inflight.empty()) {
+            return;
+        }
+
+        // hand out the replies that are complete
+        bool progress = this->transmit_pending();
+        while(this->receive_pending(progress)) {
+            SerialCommand& command = this->inflight.front();
+            if(this->stats) {
+                this->stats->record(command.op, command.issued, std::max(command.payload.size(), command.reply.size()));
+            }
+            if(Tracer* tracer = Tracer::get_active()) {
+                // commands in flight overlap, hence they do not nest on the thread of the caller
+                tracer->add_async_span(SerialStats::get_name(command.op), "serial", command.issued,
+                                       std::chrono::steady_clock::now(), "\"cmd\":\"" + std::string(command.cmd) + "\"");
+            }
+            if(!done(command)) {
+                more = false;
+            }
+            this->inflight.pop_front();
+            this->tx_index = this->tx_index > 0 ? this->tx_index - 1 : 0;
+        }
+
+        // the deadline only passes when neither direction makes progress
+        auto now = std::chrono::steady_clock::now();
+        if(progress) {
+            last_progress = now;
+            continue;
+        }
+        if(this->inflight.empty()) {
+            continue;
+        }
+
+        short events = POLLIN | (this->tx_index < this->inflight.size() ? POLLOUT : 0);
+        auto deadline = last_progress + std::chrono::milliseconds(this->inflight.front().timeout_ms);
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+        if(remaining <= 0 || !this->wait_ready(events, remaining)) {
+            const SerialCommand& command = this->inflight.front();
+            size_t expected = 8 + command.reply.size();
+            throw SerialTimeout(std::string("Error: Timeout waiting for reply to ") + command.cmd + " with "
+                                + std::to_string(this->inflight.size()) + " commands in flight ("
+                                + std::to_string(this->rx_offset) + " of " + std::to_string(expected)
+                                + " bytes received within " + std::to_string(command.timeout_ms) + " ms).");
+        }
+    }
+}
+
+/**
+ * Brings the programmer back in step after transact() has failed. The
+ * command that is partially sent is completed, such that the programmer
+ * does not wait for the remainder of its data, and all replies are
+ * discarded until the port has been quiet for the deadline of a sector
+ * write. Commands that have not been sent at all are dropped.
+ * @return Number of commands whose reply has not been received.
+ */
+unsigned int Serial::recover() {
+    unsigned int nrlost = this->inflight.size();
+    this->inflight.resize(std::min(this->inflight.size(), this->tx_index + (this->tx_offset > 0 ? 1 : 0)));
+
+    unsigned int quiet_ms = this->config.timeout + DEADLINE_SECTOR_PROGRAM;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(quiet_ms);
+    uint8_t scratch[4096];
+    while(true) {
+        bool sending = this->tx_index < this->inflight.size();
+        bool progress = sending && this->transmit_pending();
+
+        // discard everything the programmer still sends
+        while(true) {
+            ssize_t n = read(this->fd, scratch, sizeof(scratch));
+            if(this->stats) {
+                this->stats->count_read(n);
+            }
+            if(n > 0) {
+                progress = true;
+            } else if(n < 0 && errno == EINTR) {
+                continue;
+            } else if(n < 0 && errno != EAGAIN) {
+                throw std::runtime_error(std::string("Error reading from serial port: ") + std::strerror(errno));
+            } else {
+                break;
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if(progress) {
+            deadline = now + std::chrono::milliseconds(quiet_ms);
+            continue;
+        }
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+        if(remaining <= 0 || !this->wait_ready(POLLIN | (sending ? POLLOUT : 0), remaining)) {
+            if(sending) {
+                throw SerialTimeout("Error: Timeout completing " + std::string(this->inflight.back().cmd) + " while recovering.");
+            }
+            break;
+        }
+    }
+
+    this->inflight.clear();
+    this->tx_index = 0;
+    this->tx_offset = 0;
+    this->rx_offset = 0;
+    return nrlost;
 }
 
 /*
@@ -214,44 +404,241 @@ Serial::~Serial() {
  **********************************************************************************/
 
 /**
- * Reads data from the serial port.
+ * Reads exactly the given number of bytes from the serial port. The
+ * deadline is restarted whenever data arrives, such that long replies
+ * only fail when the programmer stalls.
  * @param buffer Buffer to store the read data.
  * @param size Number of bytes to read.
- * @return Number of bytes read, or -1 on error.
+ * @param timeout_ms Time to wait for the next data in milliseconds.
+ * @param what Description of the awaited reply for error messages.
+ * @throws SerialTimeout if no data arrives before the deadline.
  */
-int Serial::read_from_serial_port(char* buffer, size_t size) {
-    return read(this->fd, buffer, size);
+void Serial::read_exact(uint8_t* buffer, size_t size, unsigned int timeout_ms, const std::string& what) {
+    TraceSpan span("read", "serial");
+    span.arg("bytes", size);
+    auto start = std::chrono::steady_clock::now();
+    size_t received = 0;
+    while(received < size) {
+        ssize_t n = read(this->fd, buffer + received, size - received);
+        if(this->stats) {
+            this->stats->count_read(n);
+        }
+        if(n > 0) {
+            received += n;
+            continue;
+        }
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0 && errno != EAGAIN) {
+            throw std::runtime_error(std::string("Error reading from serial port: ") + std::strerror(errno));
+        }
+
+        if(!this->wait_ready(POLLIN, timeout_ms)) {
+            // discard a late reply, such that it does not end up in the next command
+            tcflush(this->fd, TCIFLUSH);
+            throw SerialTimeout("Error: Timeout waiting for " + what + " (" + std::to_string(received) + " of "
+                                + std::to_string(size) + " bytes received within " + std::to_string(timeout_ms) + " ms).");
+        }
+    }
+    if(this->stats) {
+        this->stats->record(SerialOp::READ, start, size);
+    }
 }
 
 /**
- * Writes data to the serial port.
+ * Writes all bytes to the serial port, in chunks of at most the
+ * configured chunk size.
  * @param buffer Buffer containing the data to write.
  * @param size Number of bytes to write.
- * @return Number of bytes written, or -1 on error.
+ * @param timeout_ms Time to wait for the port to accept more data in milliseconds.
+ * @param what Description of the data for error messages.
+ * @throws SerialTimeout if the port does not accept data before the deadline.
  */
-int Serial::write_to_serial_port(const char* buffer, size_t size) {
-    return write(this->fd, buffer, size);
+void Serial::write_all(const uint8_t* buffer, size_t size, unsigned int timeout_ms, const std::string& what) {
+    TraceSpan span("write", "serial");
+    span.arg("bytes", size);
+    auto start = std::chrono::steady_clock::now();
+    size_t written = 0;
+    while(written < size) {
+        size_t chunk = std::min(this->config.chunk_size, size - written);
+        ssize_t n = write(this->fd, buffer + written, chunk);
+        if(this->stats) {
+            this->stats->count_write(n);
+        }
+        if(n > 0) {
+            written += n;
+            continue;
+        }
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0 && errno != EAGAIN) {
+            throw std::runtime_error(std::string("Error writing to serial port: ") + std::strerror(errno));
+        }
+
+        if(!this->wait_ready(POLLOUT, timeout_ms)) {
+            throw SerialTimeout("Error: Timeout sending " + what + " (" + std::to_string(written) + " of "
+                                + std::to_string(size) + " bytes sent within " + std::to_string(timeout_ms) + " ms).");
+        }
+    }
+    if(this->stats) {
+        this->stats->record(SerialOp::WRITE, start, size);
+    }
 }
 
 /**
- * Reads data from the serial port.
- * @param cmd Command to send to the serial port
+ * Sends as much of the commands in flight as the port accepts without
+ * blocking.
+ * @return True if any data has been sent.
  */
-void Serial::send_command(const char* cmd) {
-    // write to port
-    if (this->write_to_serial_port(cmd, strlen(cmd)) < 0) {
-        std::cerr << "Error writing to serial port: " << std::strerror(errno) << std::endl;
+bool Serial::transmit_pending() {
+    bool progress = false;
+    while(this->tx_index < this->inflight.size()) {
+        const SerialCommand& command = this->inflight[this->tx_index];
+
+        // the command itself is followed by its payload
+        const uint8_t* data;
+        size_t size;
+        if(this->tx_offset < 8) {
+            data = reinterpret_cast<const uint8_t*>(command.cmd) + this->tx_offset;
+            size = 8 - this->tx_offset;
+        } else {
+            data = command.payload.data() + (this->tx_offset - 8);
+            size = command.payload.size() - (this->tx_offset - 8);
+        }
+        if(size == 0) {
+            this->tx_index++;
+            this->tx_offset = 0;
+            continue;
+        }
+
+        ssize_t n = write(this->fd, data, std::min(this->config.chunk_size, size));
+        if(this->stats) {
+            this->stats->count_write(n);
+        }
+        if(n > 0) {
+            this->tx_offset += n;
+            progress = true;
+        } else if(n < 0 && errno == EINTR) {
+            continue;
+        } else if(n < 0 && errno != EAGAIN) {
+            throw std::runtime_error(std::string("Error writing to serial port: ") + std::strerror(errno));
+        } else {
+            break;
+        }
     }
+    return progress;
+}
 
-    // read from port
-    char buffer[16];
-    int n = this->read_from_serial_port(buffer, 8);
-    if (n < 0) {
-        throw std::runtime_error(std::string("Error reading from serial port: ") + std::string(std::strerror(errno)));
-    } else {
-        if(std::string(buffer, 8) != std::string(cmd,8)) {
-            throw std::runtime_error("Error: Command not received correctly: " + std::string(buffer, 8));
+/**
+ * Receives as much of the reply of the oldest command in flight as is
+ * available without blocking.
+ * @param progress Set to true if any data has been received.
+ * @return True if the reply of the oldest command is complete.
+ * @throws SerialProtocolError if the command is not echoed correctly.
+ */
+bool Serial::receive_pending(bool& progress) {
+    if(this->inflight.empty()) {
+        return false;
+    }
+    SerialCommand& command = this->inflight.front();
+    while(true) {
+        // the echo of the command is followed by its reply
+        uint8_t* data;
+        size_t size;
+        if(this->rx_offset < 8) {
+            data = command.echo + this->rx_offset;
+            size = 8 - this->rx_offset;
+        } else {
+            data = command.reply.data() + (this->rx_offset - 8);
+            size = command.reply.size() - (this->rx_offset - 8);
+        }
+        if(size == 0) {
+            this->rx_offset = 0;
+            return true;
+        }
+
+        ssize_t n = read(this->fd, data, size);
+        if(this->stats) {
+            this->stats->count_read(n);
+        }
+        if(n > 0) {
+            progress = true;
+            this->rx_offset += n;
+            if(this->rx_offset == 8 && std::memcmp(command.echo, command.cmd, 8) != 0) {
+                throw SerialProtocolError("Error: Command not received correctly: " + std::string(reinterpret_cast<char*>(command.echo), 8));
+            }
+        } else if(n < 0 && errno == EINTR) {
+            continue;
+        } else if(n < 0 && errno != EAGAIN) {
+            throw std::runtime_error(std::string("Error reading from serial port: ") + std::strerror(errno));
+        } else {
+            return false;
+        }
+    }
+}
+
+/**
+ * Waits until the serial port is ready.
+ * @param events Events to wait for, POLLIN or POLLOUT.
+ * @param timeout_ms Time to wait in milliseconds.
+ * @return True if the port is ready, false if the deadline has passed.
+ */
+bool Serial::wait_ready(short events, unsigned int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while(true) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        struct pollfd pfd = {this->fd, events, 0};
+        int n = poll(&pfd, 1, std::max(0, (int)remaining.count()));
+        if(this->stats) {
+            this->stats->count_poll();
+        }
+        if(n < 0 && errno == EINTR) {
+            continue;
+        } else if(n < 0) {
+            throw std::runtime_error(std::string("Error polling serial port: ") + std::strerror(errno));
+        } else if(n == 0) {
+            return false;
+        }
+
+        // an unplugged programmer hangs up the port rather than timing out
+        if(pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            throw std::runtime_error("Error: Serial port disconnected.");
         }
+        return true;
+    }
+}
+
+/**
+ * Reads the reply of a command that consists of a 16-bit value.
+ * @param cmd Command that has been sent.
+ * @param timeout_ms Time to wait for the reply in milliseconds.
+ * @return Value, most significant byte first.
+ */
+uint16_t Serial::read_value(const char* cmd, unsigned int timeout_ms) {
+    uint8_t val[2];
+    this->read_exact(val, 2, timeout_ms, std::string("reply to ") + cmd);
+    return (val[0] << 8) | val[1];
+}
+
+/**
+ * Sends a command and waits for its echo.
+ * @param cmd Command to send to the serial port
+ */
+void Serial::send_command(const char* cmd) {
+    TraceSpan span("command", "serial");
+    span.arg("cmd", std::string(cmd, 8));
+    auto start = std::chrono::steady_clock::now();
+    this->write_all(reinterpret_cast<const uint8_t*>(cmd), 8, this->config.timeout, std::string("command ") + cmd);
+
+    uint8_t buffer[8];
+    this->read_exact(buffer, 8, this->config.timeout, std::string("echo of ") + cmd);
+    if(std::memcmp(buffer, cmd, 8) != 0) {
+        throw SerialProtocolError("Error: Command not received correctly: " + std::string(reinterpret_cast<char*>(buffer), 8));
+    }
+    if(this->stats) {
+        this->stats->record(SerialOp::COMMAND, start);
     }
 }
 
@@ -262,7 +649,8 @@ void Serial::close_serial_port() {
     if(this->is_open) {
         close(this->fd);
         this->fd = -1;
-        std::cout << "Closing serial port." << std::endl;
+        this->is_open = false;
+        *this->out << "Closing serial port." << std::endl;
     } else {
         throw std::logic_error("Error: Serial port already closed.");
     }
@@ -29,21 +29,91 @@
 #include <exception>
 #include <string>
 #include <stdint.h>
+#include <span>
 #include <vector>
+#include <deque>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
 
 #include "config.h"
+#include "serialconfig.h"
+#include "serialstats.h"
+
+// time the chip may take for an operation on top of the reply timeout, in
+// milliseconds; well above the maximum times in the SST39SF0x0 datasheet
+#define DEADLINE_CHIP_ERASE     2000
+#define DEADLINE_SECTOR_ERASE   500
+#define DEADLINE_SECTOR_PROGRAM 500
+
+/**
+ * Thrown when the programmer does not answer before the deadline of a command.
+ */
+class SerialTimeout : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * Thrown when the programmer does not echo a command correctly.
+ */
+class SerialProtocolError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * Command of a window of commands kept in flight by Serial::transact.
+ */
+struct SerialCommand {
+    char cmd[9];                                    // command, NUL-terminated
+    std::span<const uint8_t> payload;               // data sent directly after the command
+    std::span<uint8_t> reply;                       // receives the reply that follows the echo
+    uint8_t value[2];                               // storage of short replies
+    uint8_t echo[8];                                // echo of the command as received
+    unsigned int timeout_ms;                        // time to wait for the next data of the reply
+    SerialOp op;                                    // operation for the statistics
+    std::chrono::steady_clock::time_point issued;   // moment the command was queued for sending
+};
 
 class Serial {
 
 private:
     int fd;                 // File descriptor of the serial port.
     bool is_open = false;   // Flag to check if the serial port is open.
+    std::ostream* out;      // Stream to write status messages to.
+    SerialConfig config;    // Settings of the serial transport.
+    SerialStats* stats = nullptr;   // Counters of the transport, if collected.
+
+    std::deque<SerialCommand> inflight; // Commands sent or being sent whose reply is incomplete.
+    size_t tx_index = 0;                // Command of inflight that is being sent.
+    size_t tx_offset = 0;               // Bytes of that command and its payload that have been sent.
+    size_t rx_offset = 0;               // Bytes of the echo and reply of the oldest command received.
 
 public:
     /**
      * Constructor for the Serial class.
+     * @param out Stream to write status messages to.
+     * @param config Settings of the serial transport.
+     */
+    Serial(std::ostream& out = std::cout, const SerialConfig& config = SerialConfig());
+
+    /**
+     * Redirects the status messages, e.g. to the client of a daemon job.
+     * @param out Stream to write status messages to.
+     */
+    void set_output(std::ostream& out) {
+        this->out = &out;
+    }
+
+    /**
+     * Sets the counters that receive the latency of every operation and
+     * the system calls on the port.
+     * @param stats Counters, or nullptr to disable collection.
      */
-    Serial();
+    void set_stats(SerialStats* stats) {
+        this->stats = stats;
+    }
 
     /**
      * Opens the serial port with the given name.
@@ -52,11 +122,10 @@ public:
     void open_serial_port(const char* port_name);
 
     /**
-     * Configures the serial port with the given file descriptor and speed.
-     * @param speed Baud rate for the serial communication.
+     * Configures the serial port using the transport settings.
      * @return True if configuration is successful, false otherwise.
      */
-    bool configure_serial_port(int speed);
+    bool configure_serial_port();
 
     /**
      * Reads the device information from the serial port.
@@ -73,17 +142,17 @@ public:
     /**
      * Writes data to sector on flash chip.
      * @param sector which sector to write to
-     * @param data data to write to sector
+     * @param data data to write to sector, viewed in place
      * @return Number of bytes written, or -1 on error.
      */
-    uint16_t write_sector(uint16_t sector, const std::vector<uint8_t>& data);
+    uint16_t write_sector(uint16_t sector, std::span<const uint8_t> data);
 
     /**
      * Reads data from sector on flash chip.
      * @param sector which sector to read from
-     * @param data data to read from sector
+     * @param data caller-owned buffer of one bank that receives the data
      */
-    void read_bank(uint16_t bank, std::vector<uint8_t>& data);
+    void read_bank(uint16_t bank, std::span<uint8_t> data);
 
     /**
      * Erases the chip.
@@ -96,6 +165,57 @@ public:
      */
     uint16_t erase_sector(uint16_t sector);
 
+    /**
+     * Prepares a sector write for transact().
+     * @param sector which sector to write to
+     * @param data data to write to sector, viewed in place
+     * @param command Command that receives the request.
+     */
+    void prepare_write_sector(uint16_t sector, std::span<const uint8_t> data, SerialCommand& command) const;
+
+    /**
+     * Gets the checksum from the reply of a sector write.
+     * @param command Completed sector write.
+     * @return CRC16 checksum calculated by the programmer.
+     */
+    static uint16_t get_checksum(const SerialCommand& command) {
+        // the checksum is sent least significant byte first
+        return command.value[0] | (command.value[1] << 8);
+    }
+
+    /**
+     * Prepares a bank read for transact().
+     * @param bank which bank to read from
+     * @param data caller-owned buffer of one bank that receives the data
+     * @param command Command that receives the request.
+     */
+    void prepare_read_bank(uint16_t bank, std::span<uint8_t> data, SerialCommand& command) const;
+
+    /**
+     * Sends a sequence of commands while keeping up to window of them in
+     * flight. Echoes and replies are matched in the order in which the
+     * commands were sent, while further commands are being sent, such that
+     * the round trip of one command overlaps with the transfer of the next.
+     * @param window Largest number of commands in flight.
+     * @param next Fills in the next command; returns false if there are no more commands.
+     * @param done Called in order for every completed command; returning false stops
+     *             sending further commands.
+     * @throws SerialTimeout if a reply does not arrive before its deadline.
+     * @throws SerialProtocolError if a command is not echoed correctly.
+     */
+    void transact(unsigned int window, const std::function<bool(SerialCommand&)>& next,
+                  const std::function<bool(SerialCommand&)>& done);
+
+    /**
+     * Brings the programmer back in step after transact() has failed. The
+     * command that is partially sent is completed, such that the programmer
+     * does not wait for the remainder of its data, and all replies are
+     * discarded until the port has been quiet for the deadline of a sector
+     * write. Commands that have not been sent at all are dropped.
+     * @return Number of commands whose reply has not been received.
+     */
+    unsigned int recover();
+
     /**
      * Closes the serial port.
      */
@@ -107,24 +227,63 @@ public:
     ~Serial();
 
 private:
-/**
-     * Reads data from the serial port.
+    /**
+     * Reads exactly the given number of bytes from the serial port. The
+     * deadline is restarted whenever data arrives, such that long replies
+     * only fail when the programmer stalls.
      * @param buffer Buffer to store the read data.
      * @param size Number of bytes to read.
-     * @return Number of bytes read, or -1 on error.
+     * @param timeout_ms Time to wait for the next data in milliseconds.
+     * @param what Description of the awaited reply for error messages.
+     * @throws SerialTimeout if no data arrives before the deadline.
      */
-    int read_from_serial_port(char* buffer, size_t size);
+    void read_exact(uint8_t* buffer, size_t size, unsigned int timeout_ms, const std::string& what);
 
     /**
-     * Writes data to the serial port.
+     * Writes all bytes to the serial port, in chunks of at most the
+     * configured chunk size.
      * @param buffer Buffer containing the data to write.
      * @param size Number of bytes to write.
-     * @return Number of bytes written, or -1 on error.
+     * @param timeout_ms Time to wait for the port to accept more data in milliseconds.
+     * @param what Description of the data for error messages.
+     * @throws SerialTimeout if the port does not accept data before the deadline.
+     */
+    void write_all(const uint8_t* buffer, size_t size, unsigned int timeout_ms, const std::string& what);
+
+    /**
+     * Waits until the serial port is ready.
+     * @param events Events to wait for, POLLIN or POLLOUT.
+     * @param timeout_ms Time to wait in milliseconds.
+     * @return True if the port is ready, false if the deadline has passed.
+     */
+    bool wait_ready(short events, unsigned int timeout_ms);
+
+    /**
+     * Sends as much of the commands in flight as the port accepts without
+     * blocking.
+     * @return True if any data has been sent.
+     */
+    bool transmit_pending();
+
+    /**
+     * Receives as much of the reply of the oldest command in flight as is
+     * available without blocking.
+     * @param progress Set to true if any data has been received.
+     * @return True if the reply of the oldest command is complete.
+     * @throws SerialProtocolError if the command is not echoed correctly.
+     */
+    bool receive_pending(bool& progress);
+
+    /**
+     * Reads the reply of a command that consists of a 16-bit value.
+     * @param cmd Command that has been sent.
+     * @param timeout_ms Time to wait for the reply in milliseconds.
+     * @return Value, most significant byte first.
      */
-    int write_to_serial_port(const char* buffer, size_t size);
+    uint16_t read_value(const char* cmd, unsigned int timeout_ms);
 
     /**
-     * Reads data from the serial port.
+     * Sends a command and waits for its echo.
      * @param cmd Command to send to the serial port
      */
     void send_command(const char* cmd);
@@ -0,0 +1,174 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "serialconfig.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <limits>
+
+namespace {
+    /**
+     * Parses an unsigned number that has to fit in an unsigned int.
+     * @param value Text to parse.
+     * @param base Base of the number; 0 detects hexadecimal and octal prefixes.
+     * @return Parsed number.
+     * @throws std::invalid_argument if value is not a number.
+     * @throws std::out_of_range if the number does not fit.
+     */
+    unsigned int parse_uint(const std::string& value, int base = 10) {
+        unsigned long number = std::stoul(value, nullptr, base);
+        if(number > std::numeric_limits<unsigned int>::max()) {
+            throw std::out_of_range(value);
+        }
+        return number;
+    }
+}
+
+/**
+ * Reads settings from a configuration file. Every line holds a
+ * key=value pair; empty lines and lines starting with '#' are ignored.
+ * Keys that are absent keep their current value.
+ * @param filename Name of the configuration file.
+ * @throws std::runtime_error on unreadable files or invalid entries.
+ */
+void SerialConfig::load(const std::string& filename) {
+    std::ifstream infile(filename);
+    if(!infile) {
+        throw std::runtime_error("Error opening transport configuration: " + filename);
+    }
+
+    std::string line;
+    unsigned int linenr = 0;
+    while(std::getline(infile, line)) {
+        linenr++;
+
+        // strip whitespace and skip comments
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        size_t pos = line.find('=');
+        if(pos == std::string::npos) {
+            throw std::runtime_error("Error in " + filename + " line " + std::to_string(linenr) + ": expected key=value.");
+        }
+        std::string key = line.substr(0, pos);
+        std::string value = line.substr(pos + 1);
+        key.erase(key.find_last_not_of(" \t") + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+
+        try {
+            if(key == "baud") {
+                this->baud = parse_uint(value);
+            } else if(key == "timeout") {
+                this->timeout = parse_uint(value);
+            } else if(key == "vmin" || key == "vtime") {
+                // superseded by timeout; accepted such that older files still load
+            } else if(key == "chunk_size") {
+                this->chunk_size = parse_uint(value, 0);
+            } else if(key == "low_latency") {
+                this->low_latency = (value == "1" || value == "true" || value == "yes");
+            } else if(key == "sync") {
+                this->sync = (value == "1" || value == "true" || value == "yes");
+            } else if(key == "window") {
+                this->window = parse_uint(value);
+            } else {
+                throw std::runtime_error("Error in " + filename + " line " + std::to_string(linenr) + ": unknown key " + key + ".");
+            }
+        } catch(const std::invalid_argument&) {
+            throw std::runtime_error("Error in " + filename + " line " + std::to_string(linenr) + ": invalid value for " + key + ".");
+        } catch(const std::out_of_range&) {
+            throw std::runtime_error("Error in " + filename + " line " + std::to_string(linenr) + ": value out of range for " + key + ".");
+        }
+    }
+
+    if(this->timeout == 0) {
+        throw std::runtime_error("Error in " + filename + ": timeout must be positive.");
+    }
+    if(this->chunk_size == 0) {
+        throw std::runtime_error("Error in " + filename + ": chunk_size must be positive.");
+    }
+    if(this->window == 0 || this->window > MAX_WINDOW) {
+        throw std::runtime_error("Error in " + filename + ": window must be between 1 and " + std::to_string(MAX_WINDOW) + ".");
+    }
+}
+
+/**
+ * Converts the settings to the configuration file format.
+ * @return Settings as key=value pairs on a single line.
+ */
+std::string SerialConfig::to_string() const {
+    std::ostringstream str;
+    str << "baud=" << this->baud
+        << " timeout=" << this->timeout
+        << " chunk_size=" << this->chunk_size
+        << " low_latency=" << this->low_latency
+        << " sync=" << this->sync
+        << " window=" << this->window;
+    return str.str();
+}
+
+/**
+ * Gets the termios speed constant for the baud rate.
+ * @return Speed constant.
+ * @throws std::runtime_error if the baud rate is not supported.
+ */
+speed_t SerialConfig::get_speed() const {
+    switch(this->baud) {
+        case 9600:      return B9600;
+        case 19200:     return B19200;
+        case 38400:     return B38400;
+        case 57600:     return B57600;
+        case 115200:    return B115200;
+        case 230400:    return B230400;
+        case 460800:    return B460800;
+        case 921600:    return B921600;
+        case 1000000:   return B1000000;
+        case 2000000:   return B2000000;
+        case 3000000:   return B3000000;
+        case 4000000:   return B4000000;
+        default:
+            throw std::runtime_error("Error: Unsupported baud rate " + std::to_string(this->baud) + ".");
+    }
+}
+
+/**
+ * Generates the candidate settings tried by the transport probe. The
+ * candidates vary those settings that affect the latency of reads.
+ * @return Candidate settings, starting with the current settings.
+ */
+std::vector<SerialConfig> SerialConfig::get_probe_candidates() const {
+    std::vector<SerialConfig> candidates = {*this};
+    for(bool sync : {true, false}) {
+        for(bool low_latency : {false, true}) {
+            SerialConfig candidate = *this;
+            candidate.sync = sync;
+            candidate.low_latency = low_latency;
+            if(candidate.to_string() != this->to_string()) {
+                candidates.push_back(candidate);
+            }
+        }
+    }
+    return candidates;
+}
@@ -0,0 +1,68 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <termios.h>
+
+// largest number of commands that may be kept in flight
+#define MAX_WINDOW 16
+
+// Settings of the serial transport
+struct SerialConfig {
+    unsigned int baud = 19200;      // baud rate; ignored by USB CDC devices
+    unsigned int timeout = 1000;    // time to wait for a reply or for further data (ms)
+    size_t chunk_size = 0x1000;     // maximum number of bytes per write call
+    bool low_latency = false;       // request ASYNC_LOW_LATENCY from the driver
+    bool sync = true;               // open the port with O_SYNC
+    unsigned int window = 1;        // sector writes or bank reads kept in flight
+
+    /**
+     * Reads settings from a configuration file. Every line holds a
+     * key=value pair; empty lines and lines starting with '#' are ignored.
+     * Keys that are absent keep their current value.
+     * @param filename Name of the configuration file.
+     * @throws std::runtime_error on unreadable files or invalid entries.
+     */
+    void load(const std::string& filename);
+
+    /**
+     * Converts the settings to the configuration file format.
+     * @return Settings as key=value pairs on a single line.
+     */
+    std::string to_string() const;
+
+    /**
+     * Gets the termios speed constant for the baud rate.
+     * @return Speed constant.
+     * @throws std::runtime_error if the baud rate is not supported.
+     */
+    speed_t get_speed() const;
+
+    /**
+     * Generates the candidate settings tried by the transport probe. The
+     * candidates vary those settings that affect the latency of reads.
+     * @return Candidate settings, starting with the current settings.
+     */
+    std::vector<SerialConfig> get_probe_candidates() const;
+};
@@ -20,8 +20,28 @@
 
 #include "serialport.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <stdexcept>
+#include <tuple>
+#include <dirent.h>
+#include <poll.h>
+
 SerialPort::SerialPort() {}
 
+/**
+ * Destructor for the SerialPort class; stops the monitor.
+ */
+SerialPort::~SerialPort() {
+    if (this->monitor) {
+        udev_monitor_unref(this->monitor);
+    }
+    if (this->udev) {
+        udev_unref(this->udev);
+    }
+}
+
 /**
  * List all serial ports and their IDs
  * @return vector of pairs with device path and device ID
@@ -82,4 +102,166 @@ std::vector<std::pair<std::string, std::string>> SerialPort::list_serial_ports_w
     udev_enumerate_unref(enumerate);
     udev_unref(udev);
     return devices;
-}
\ No newline at end of file
+}
+/**
+ * Lists the serial ports of a given USB device. Matching is done on the
+ * properties stored by udev, such that unrelated ttys are never opened.
+ * @param vendor_id USB vendor ID to match.
+ * @param product_id USB product ID to match.
+ * @return Matching serial ports, sorted by USB topology.
+ */
+std::vector<serial_port_info> SerialPort::find_devices(const std::string& vendor_id, const std::string& product_id) {
+    std::vector<serial_port_info> devices;
+
+    struct udev *udev = udev_new();
+    if (!udev) {
+        std::cerr << "Failed to create udev context" << std::endl;
+        return devices;
+    }
+
+    struct udev_enumerate *enumerate = udev_enumerate_new(udev);
+    if (!enumerate) {
+        std::cerr << "Failed to create udev enumerator" << std::endl;
+        udev_unref(udev);
+        return devices;
+    }
+
+    // let udev filter on the vendor; property matches are OR-ed, so the product is checked below
+    udev_enumerate_add_match_subsystem(enumerate, "tty");
+    udev_enumerate_add_match_property(enumerate, "ID_VENDOR_ID", vendor_id.c_str());
+    udev_enumerate_scan_devices(enumerate);
+
+    struct udev_list_entry *entry;
+    udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(enumerate)) {
+        struct udev_device *dev = udev_device_new_from_syspath(udev, udev_list_entry_get_name(entry));
+        if (dev) {
+            serial_port_info info = get_port_info(dev);
+            if (!info.device_path.empty() && info.vendor_id == vendor_id && info.product_id == product_id) {
+                devices.push_back(info);
+            }
+            udev_device_unref(dev);
+        }
+    }
+
+    udev_enumerate_unref(enumerate);
+    udev_unref(udev);
+
+    // enumeration order is not stable; sort such that the same port always comes first
+    std::sort(devices.begin(), devices.end(), [](const serial_port_info& a, const serial_port_info& b) {
+        return std::tie(a.topology, a.device_path) < std::tie(b.topology, b.device_path);
+    });
+
+    return devices;
+}
+
+/**
+ * Resolves the serial port of a device by its USB serial number.
+ * @param serial USB serial number of the device.
+ * @return Path to the serial port.
+ * @throws std::runtime_error if no device carries the serial number.
+ */
+std::string SerialPort::find_by_serial(const std::string& serial) {
+    // the links in /dev/serial/by-id end in <serial>-if<interface>, which avoids enumeration
+    const std::string directory = "/dev/serial/by-id";
+    DIR *dir = opendir(directory.c_str());
+    if (dir) {
+        std::string found;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            std::string name = entry->d_name;
+            if (name.find("_" + serial + "-if") != std::string::npos) {
+                char path[PATH_MAX];
+                if (realpath((directory + "/" + name).c_str(), path)) {
+                    found = path;
+                    break;
+                }
+            }
+        }
+        closedir(dir);
+        if (!found.empty()) {
+            return found;
+        }
+    }
+
+    for (const auto& device : this->find_devices()) {
+        if (device.serial == serial) {
+            return device.device_path;
+        }
+    }
+
+    throw std::runtime_error("Error: No programmer with serial number " + serial + " found.");
+}
+
+/**
+ * Starts listening for hot-plug events of serial ports.
+ * @throws std::runtime_error if the monitor cannot be created.
+ */
+void SerialPort::start_monitor() {
+    this->udev = udev_new();
+    if (!this->udev) {
+        throw std::runtime_error("Error: Failed to create udev context.");
+    }
+
+    // events are only delivered once udev has processed them, i.e. when the properties are known
+    this->monitor = udev_monitor_new_from_netlink(this->udev, "udev");
+    if (!this->monitor ||
+        udev_monitor_filter_add_match_subsystem_devtype(this->monitor, "tty", nullptr) < 0 ||
+        udev_monitor_enable_receiving(this->monitor) < 0) {
+        throw std::runtime_error("Error: Failed to create udev monitor.");
+    }
+}
+
+/**
+ * Waits until a serial port of a given USB device is added.
+ * @param info Receives information about the added serial port.
+ * @param timeout Maximum time to wait in milliseconds.
+ * @param vendor_id USB vendor ID to match.
+ * @param product_id USB product ID to match.
+ * @return True if a matching serial port was added, false on timeout or interruption.
+ */
+bool SerialPort::wait_for_device(serial_port_info& info, int timeout, const std::string& vendor_id, const std::string& product_id) {
+    if (!this->monitor) {
+        throw std::runtime_error("Error: Monitor has not been started.");
+    }
+
+    struct pollfd pfd = {udev_monitor_get_fd(this->monitor), POLLIN, 0};
+    if (poll(&pfd, 1, timeout) <= 0) {
+        return false;
+    }
+
+    struct udev_device *dev = udev_monitor_receive_device(this->monitor);
+    if (!dev) {
+        return false;
+    }
+
+    const char *action = udev_device_get_action(dev);
+    bool added = action && std::string(action) == "add";
+    if (added) {
+        info = get_port_info(dev);
+        added = !info.device_path.empty() && info.vendor_id == vendor_id && info.product_id == product_id;
+    }
+    udev_device_unref(dev);
+
+    return added;
+}
+
+/**
+ * Collects the USB properties of a tty device.
+ * @param dev udev device of the tty.
+ * @return Information about the serial port.
+ */
+serial_port_info SerialPort::get_port_info(struct udev_device* dev) {
+    auto property = [dev](const char* key) {
+        const char *value = udev_device_get_property_value(dev, key);
+        return std::string(value ? value : "");
+    };
+
+    serial_port_info info;
+    const char *devnode = udev_device_get_devnode(dev);
+    info.device_path = devnode ? devnode : "";
+    info.vendor_id = property("ID_VENDOR_ID");
+    info.product_id = property("ID_MODEL_ID");
+    info.serial = property("ID_SERIAL_SHORT");
+    info.topology = property("ID_PATH");
+    return info;
+}
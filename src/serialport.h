@@ -26,20 +26,81 @@
 #include <libudev.h>
 #include <sstream>
 
+#define PICO_VENDOR_ID  "2e8a"
+#define PICO_PRODUCT_ID "0009"
+
 // Structure to store serial port information
 struct serial_port_info {
-    std::string device_path;
-    std::string vendor_id;
-    std::string product_id;
+    std::string device_path;    // device node, e.g. /dev/ttyACM0
+    std::string vendor_id;      // USB vendor ID
+    std::string product_id;     // USB product ID
+    std::string serial;         // USB serial number (ID_SERIAL_SHORT)
+    std::string topology;       // physical path of the USB port (ID_PATH)
 };
 
 class SerialPort {
+private:
+    struct udev* udev = nullptr;                // udev context of the monitor
+    struct udev_monitor* monitor = nullptr;     // monitor for hot-plug events
+
 public:
     SerialPort();
 
+    /**
+     * Destructor for the SerialPort class; stops the monitor.
+     */
+    ~SerialPort();
+
+    SerialPort(const SerialPort&) = delete;
+    SerialPort& operator=(const SerialPort&) = delete;
+
     /**
      * List all serial ports and their IDs
      * @return vector of pairs with device path and device ID
      */
     std::vector<std::pair<std::string, std::string>> list_serial_ports_with_ids();
+
+    /**
+     * Lists the serial ports of a given USB device. Matching is done on the
+     * properties stored by udev, such that unrelated ttys are never opened.
+     * @param vendor_id USB vendor ID to match.
+     * @param product_id USB product ID to match.
+     * @return Matching serial ports, sorted by USB topology.
+     */
+    std::vector<serial_port_info> find_devices(const std::string& vendor_id = PICO_VENDOR_ID,
+                                               const std::string& product_id = PICO_PRODUCT_ID);
+
+    /**
+     * Resolves the serial port of a device by its USB serial number.
+     * @param serial USB serial number of the device.
+     * @return Path to the serial port.
+     * @throws std::runtime_error if no device carries the serial number.
+     */
+    std::string find_by_serial(const std::string& serial);
+
+    /**
+     * Starts listening for hot-plug events of serial ports.
+     * @throws std::runtime_error if the monitor cannot be created.
+     */
+    void start_monitor();
+
+    /**
+     * Waits until a serial port of a given USB device is added.
+     * @param info Receives information about the added serial port.
+     * @param timeout Maximum time to wait in milliseconds.
+     * @param vendor_id USB vendor ID to match.
+     * @param product_id USB product ID to match.
+     * @return True if a matching serial port was added, false on timeout or interruption.
+     */
+    bool wait_for_device(serial_port_info& info, int timeout,
+                         const std::string& vendor_id = PICO_VENDOR_ID,
+                         const std::string& product_id = PICO_PRODUCT_ID);
+
+private:
+    /**
+     * Collects the USB properties of a tty device.
+     * @param dev udev device of the tty.
+     * @return Information about the serial port.
+     */
+    static serial_port_info get_port_info(struct udev_device* dev);
 };
@@ -0,0 +1,137 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "serialstats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+/**
+ * Adds a sample.
+ * @param us Duration in microseconds.
+ */
+void LatencyHistogram::add(double us) {
+    // samples below one microsecond end up in the first bucket
+    int bucket = us > 1.0 ? (int)(std::log2(us) * BUCKETS_PER_OCTAVE) : 0;
+    this->buckets[std::min(bucket, (int)NRBUCKETS - 1)]++;
+    this->count++;
+    this->total_us += us;
+    this->max_us = std::max(this->max_us, us);
+}
+
+/**
+ * Estimates a percentile from the buckets.
+ * @param p Percentile between 0 and 100.
+ * @return Upper bound of the bucket holding the percentile in microseconds.
+ */
+double LatencyHistogram::get_percentile(double p) const {
+    if(this->count == 0) {
+        return 0.0;
+    }
+
+    uint64_t rank = std::max((uint64_t)1, (uint64_t)std::ceil(p / 100.0 * this->count));
+    uint64_t seen = 0;
+    for(unsigned int i=0; i<NRBUCKETS; i++) {
+        seen += this->buckets[i];
+        if(seen >= rank) {
+            // the slowest sample is a tighter bound for the last bucket
+            return std::min(std::exp2((double)(i + 1) / BUCKETS_PER_OCTAVE), this->max_us);
+        }
+    }
+    return this->max_us;
+}
+
+/**
+ * Records a completed operation.
+ * @param op Operation.
+ * @param start Start of the operation.
+ * @param bytes Payload transferred by the operation.
+ * @param polls Busy polls reported by the programmer.
+ */
+void SerialStats::record(SerialOp op, std::chrono::steady_clock::time_point start, uint64_t bytes, uint64_t polls) {
+    LatencyHistogram& histogram = this->ops[(size_t)op];
+    histogram.add(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    histogram.bytes += bytes;
+    histogram.polls += polls;
+}
+
+/**
+ * Prints a table with the latency of every operation that occurred and
+ * the system call counters.
+ * @param out Stream to write the table to.
+ */
+void SerialStats::print(std::ostream& out) const {
+    out << "--------------------------------------------------------------" << std::endl;
+    out << std::left << std::setfill(' ') << std::setw(13) << "operation" << std::right
+        << std::setw(6) << "n" << std::setw(9) << "mean ms" << std::setw(9) << "p50 ms"
+        << std::setw(9) << "p99 ms" << std::setw(9) << "max ms" << std::setw(7) << "MB/s" << std::endl;
+    out << "--------------------------------------------------------------" << std::endl;
+    for(unsigned int i=0; i<(unsigned int)SerialOp::COUNT; i++) {
+        const LatencyHistogram& histogram = this->ops[i];
+        if(histogram.count == 0) {
+            continue;
+        }
+        out << std::left << std::setw(13) << get_name((SerialOp)i) << std::right << std::dec
+            << std::setw(6) << histogram.count << std::fixed << std::setprecision(3)
+            << std::setw(9) << histogram.total_us / histogram.count / 1e3
+            << std::setw(9) << histogram.get_percentile(50.0) / 1e3
+            << std::setw(9) << histogram.get_percentile(99.0) / 1e3
+            << std::setw(9) << histogram.max_us / 1e3 << std::setprecision(2);
+        if(histogram.bytes > 0) {
+            out << std::setw(7) << histogram.bytes / histogram.total_us;
+        } else {
+            out << std::setw(7) << "-";
+        }
+        out << std::defaultfloat << std::endl;
+    }
+    out << "--------------------------------------------------------------" << std::endl;
+
+    // the programmer polls the chip until an erase completes, which is chip time rather than transfer time
+    for(SerialOp op : {SerialOp::ERASE_SECTOR, SerialOp::ERASE_CHIP}) {
+        const LatencyHistogram& histogram = this->ops[(size_t)op];
+        if(histogram.count > 0) {
+            out << "Busy polls per " << get_name(op) << ": " << std::fixed << std::setprecision(1)
+                << (double)histogram.polls / histogram.count << std::defaultfloat << std::endl;
+        }
+    }
+    out << "System calls: " << std::dec << this->read_calls << " read, " << this->write_calls << " write, "
+        << this->poll_calls << " poll (" << this->would_block << " reads/writes without data)" << std::endl;
+    out << "Transferred: " << this->bytes_written << " bytes sent, " << this->bytes_read << " bytes received" << std::endl;
+}
+
+/**
+ * Gets the name of an operation.
+ * @param op Operation.
+ * @return Name of the operation.
+ */
+const char* SerialStats::get_name(SerialOp op) {
+    switch(op) {
+        case SerialOp::COMMAND:         return "command";
+        case SerialOp::WRITE:           return "write";
+        case SerialOp::READ:            return "read";
+        case SerialOp::WRITE_SECTOR:    return "write_sector";
+        case SerialOp::READ_BANK:       return "read_bank";
+        case SerialOp::ERASE_SECTOR:    return "erase_sector";
+        case SerialOp::ERASE_CHIP:      return "erase_chip";
+        default:                        return "other";
+    }
+}
@@ -0,0 +1,145 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <sys/types.h>
+
+// operations of the serial interface that are timed individually
+enum class SerialOp : unsigned int {
+    COMMAND,            // command and its echo
+    WRITE,              // data written to the port, including waits for room
+    READ,               // reply read from the port, including waits for data
+    WRITE_SECTOR,       // command, sector data and checksum
+    READ_BANK,          // command and bank data
+    ERASE_SECTOR,       // command and busy polls of the chip
+    ERASE_CHIP,         // command and busy polls of the chip
+    OTHER,              // identification commands
+    COUNT
+};
+
+/**
+ * Latency histogram of a single operation. Buckets are spaced
+ * logarithmically with eight buckets per power of two, such that every
+ * percentile is accurate to within 10% while adding a sample only costs a
+ * logarithm and an increment.
+ */
+struct LatencyHistogram {
+    static const unsigned int BUCKETS_PER_OCTAVE = 8;
+    static const unsigned int NRBUCKETS = 27 * BUCKETS_PER_OCTAVE;   // up to 2^27 us, about two minutes
+
+    std::array<uint64_t, NRBUCKETS> buckets{};  // number of samples per bucket
+    uint64_t count = 0;                         // number of samples
+    double total_us = 0.0;                      // sum of all samples in microseconds
+    double max_us = 0.0;                        // slowest sample in microseconds
+    uint64_t bytes = 0;                         // payload transferred by the operation
+    uint64_t polls = 0;                         // busy polls reported by the programmer
+
+    /**
+     * Adds a sample.
+     * @param us Duration in microseconds.
+     */
+    void add(double us);
+
+    /**
+     * Estimates a percentile from the buckets.
+     * @param p Percentile between 0 and 100.
+     * @return Upper bound of the bucket holding the percentile in microseconds.
+     */
+    double get_percentile(double p) const;
+};
+
+/**
+ * Counters of the serial interface of a single programmer: latency
+ * histograms per operation and the number of system calls and bytes that
+ * went through the port. Only collected when statistics are requested.
+ */
+class SerialStats {
+private:
+    std::array<LatencyHistogram, (size_t)SerialOp::COUNT> ops;  // histogram per operation
+    uint64_t read_calls = 0;                    // read() calls
+    uint64_t write_calls = 0;                   // write() calls
+    uint64_t poll_calls = 0;                    // poll() calls
+    uint64_t would_block = 0;                   // read() or write() calls that transferred nothing
+    uint64_t bytes_read = 0;                    // bytes received
+    uint64_t bytes_written = 0;                 // bytes sent
+
+public:
+    /**
+     * Records a completed operation.
+     * @param op Operation.
+     * @param start Start of the operation.
+     * @param bytes Payload transferred by the operation.
+     * @param polls Busy polls reported by the programmer.
+     */
+    void record(SerialOp op, std::chrono::steady_clock::time_point start, uint64_t bytes = 0, uint64_t polls = 0);
+
+    /**
+     * Counts a read() call.
+     * @param n Return value of the call.
+     */
+    void count_read(ssize_t n) {
+        this->read_calls++;
+        if(n > 0) {
+            this->bytes_read += n;
+        } else {
+            this->would_block++;
+        }
+    }
+
+    /**
+     * Counts a write() call.
+     * @param n Return value of the call.
+     */
+    void count_write(ssize_t n) {
+        this->write_calls++;
+        if(n > 0) {
+            this->bytes_written += n;
+        } else {
+            this->would_block++;
+        }
+    }
+
+    /**
+     * Counts a poll() call.
+     */
+    void count_poll() {
+        this->poll_calls++;
+    }
+
+    /**
+     * Prints a table with the latency of every operation that occurred and
+     * the system call counters.
+     * @param out Stream to write the table to.
+     */
+    void print(std::ostream& out) const;
+
+    /**
+     * Gets the name of an operation.
+     * @param op Operation.
+     * @return Name of the operation.
+     */
+    static const char* get_name(SerialOp op);
+};
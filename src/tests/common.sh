@@ -0,0 +1,85 @@
+#!/bin/bash
+#
+# Shared helpers of the picoflash tests. Every test is called with the
+# directory holding the picoflash binaries, runs in its own temporary
+# directory and stops the processes it started on exit.
+#
+
+set -euo pipefail
+
+BINDIR=$(cd "$1" && pwd)
+TESTDIR=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+WORKDIR=$(mktemp -d)
+PIDS=()
+
+cleanup() {
+    for pid in "${PIDS[@]}"; do
+        stop_process "$pid"
+    done
+    rm -rf "$WORKDIR"
+}
+trap cleanup EXIT
+
+fail() {
+    echo "FAIL: $*" >&2
+    exit 1
+}
+
+# stops a process started by the test, e.g. $EMU_PID or $HTTP_PID
+stop_process() {
+    kill "$1" 2>/dev/null || true
+    wait "$1" 2>/dev/null || true
+}
+
+# waits until a file exists, e.g. the link to the pseudo-terminal
+wait_for() {
+    for _ in $(seq 100); do
+        [ -e "$1" ] && return 0
+        sleep 0.05
+    done
+    fail "$1 did not appear"
+}
+
+# starts picoflash-emu with the given options; the device is $DEVICE and the
+# log of the emulator is $WORKDIR/emu.log
+start_emulator() {
+    DEVICE="$WORKDIR/pty"
+    rm -f "$DEVICE"
+    "$BINDIR/picoflash-emu" --link "$DEVICE" "$@" > "$WORKDIR/emu.log" 2>&1 &
+    EMU_PID=$!
+    PIDS+=($EMU_PID)
+    wait_for "$DEVICE"
+}
+
+# starts an HTTP server for the directory $WORKDIR/www; the server is reached
+# at $URL and logs its requests to $WORKDIR/http.log
+start_http_server() {
+    mkdir -p "$WORKDIR/www"
+    python3 "$TESTDIR/httpserver.py" "$WORKDIR/www" "$WORKDIR/port" "$@" 2> "$WORKDIR/http.log" &
+    HTTP_PID=$!
+    PIDS+=($HTTP_PID)
+    wait_for "$WORKDIR/port"
+    URL="http://127.0.0.1:$(cat "$WORKDIR/port")"
+}
+
+# writes a file of random bytes
+random_file() {
+    head -c "$2" /dev/urandom > "$1"
+}
+
+# runs picoflash against the emulator; the output is kept in $WORKDIR/out.log
+picoflash() {
+    "$BINDIR/picoflash" --device "$DEVICE" "$@" > "$WORKDIR/out.log" 2>&1 || {
+        cat "$WORKDIR/out.log" >&2
+        return 1
+    }
+}
+
+# runs picoflash against the emulator and expects it to fail; errors end
+# picoflash with an uncaught exception, whose report by bash is discarded
+picoflash_fails() {
+    if { "$BINDIR/picoflash" --device "$DEVICE" "$@" > "$WORKDIR/out.log" 2>&1; } 2>/dev/null; then
+        cat "$WORKDIR/out.log" >&2
+        return 1
+    fi
+}
@@ -0,0 +1,32 @@
+#!/bin/bash
+#
+# Submits jobs to picoflashd for picoflash-emu. A job that fails because the
+# programmer went away closes the session; the next job reopens it while its
+# output goes to the client, after which the daemon shuts down cleanly and
+# reports closing the port on its own output.
+#
+
+source "$(dirname "$0")/common.sh"
+
+random_file "$WORKDIR/image.bin" 524288
+start_emulator --chip 040
+"$BINDIR/picoflashd" --socket "$WORKDIR/socket" --device "$DEVICE" > "$WORKDIR/daemon.log" 2>&1 &
+DAEMON_PID=$!
+PIDS+=($DAEMON_PID)
+wait_for "$WORKDIR/socket"
+
+submit() {
+    "$BINDIR/picoflash" --socket "$WORKDIR/socket" --device "$DEVICE" "$@" > "$WORKDIR/out.log" 2>&1
+}
+
+submit -w -i "$WORKDIR/image.bin" || fail "write through the daemon"
+stop_process "$EMU_PID"
+! submit -v -i "$WORKDIR/image.bin" || fail "verify without a programmer passed"
+start_emulator --chip 040 --image "$WORKDIR/image.bin"
+submit -v -i "$WORKDIR/image.bin" || fail "verify after reopening the session"
+
+kill "$DAEMON_PID"
+wait "$DAEMON_PID" || fail "the daemon did not shut down cleanly"
+[ "$(tail -n 1 "$WORKDIR/daemon.log")" = "Closing serial port." ] || fail "the reopened port was not closed on the daemon's output"
+
+echo "PASS"
@@ -0,0 +1,52 @@
+#!/bin/bash
+#
+# Writes, verifies and reads back a random image on picoflash-emu, both
+# serially and pipelined, and checks that a wrong image fails verification.
+#
+
+source "$(dirname "$0")/common.sh"
+
+random_file "$WORKDIR/image.bin" 524288
+random_file "$WORKDIR/other.bin" 524288
+start_emulator --chip 040
+
+for mode in "" "-p"; do
+    picoflash -w -i "$WORKDIR/image.bin" $mode || fail "write $mode"
+    grep -q "All done" "$WORKDIR/out.log" || fail "write $mode did not finish"
+    picoflash -v -i "$WORKDIR/image.bin" $mode || fail "verify $mode"
+    picoflash -r -o "$WORKDIR/dump.bin" $mode || fail "read $mode"
+    cmp "$WORKDIR/image.bin" "$WORKDIR/dump.bin" || fail "read $mode differs from the image"
+done
+
+# partial reads only return the selected bytes and reject ranges beyond the chip
+picoflash -r -b 3 -o "$WORKDIR/bank.bin" || fail "read of a bank"
+cmp "$WORKDIR/bank.bin" <(tail -c +$((3 * 16384 + 1)) "$WORKDIR/image.bin" | head -c 16384) || fail "bank 3 differs"
+picoflash -r --range 0x3FF8+40 -o "$WORKDIR/range.bin" || fail "read of a byte range"
+cmp "$WORKDIR/range.bin" <(tail -c +$((0x3FF8 + 1)) "$WORKDIR/image.bin" | head -c 40) || fail "byte range differs"
+for range in "-b 32" "--banks 31-32" "--banks 262144-262145" "--range 0x7FFF0+17" "--range 0x100000000+16"; do
+    picoflash_fails -r $range -o "$WORKDIR/range.bin" || fail "read $range was accepted"
+done
+
+random_file "$WORKDIR/small.bin" 4096
+
+# partial writes only touch the selected sectors and reject offsets beyond the chip
+picoflash -w --offset 0x7E000 -i "$WORKDIR/small.bin" || fail "write at an offset"
+picoflash -v --offset 0x7E000 -i "$WORKDIR/small.bin" || fail "verify at an offset"
+! grep -q "FAIL" "$WORKDIR/out.log" || fail "verify at an offset failed"
+for offset in 0x80000 0x100000000; do
+    picoflash_fails -w --offset $offset -i "$WORKDIR/small.bin" || fail "write at offset $offset was accepted"
+done
+
+# manifests place files at banks or addresses and reject targets beyond the chip
+printf 'bank=1 small.bin\noffset=0x7F000 small.bin\n' > "$WORKDIR/manifest.txt"
+picoflash -w -m "$WORKDIR/manifest.txt" || fail "write of a manifest"
+picoflash -v -m "$WORKDIR/manifest.txt" || fail "verify of a manifest"
+for target in "bank=32" "bank=262144" "offset=0x80000" "offset=0x100000000"; do
+    echo "$target small.bin" > "$WORKDIR/manifest.txt"
+    picoflash_fails -w -m "$WORKDIR/manifest.txt" || fail "manifest with $target was accepted"
+done
+
+picoflash -v -i "$WORKDIR/other.bin" || fail "verify of a wrong image"
+grep -q "FAIL" "$WORKDIR/out.log" || fail "a wrong image passed verification"
+
+echo "PASS"
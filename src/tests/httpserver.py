@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+#
+# Serves a directory over HTTP for the picoflash tests. The server binds to
+# a free port on the loopback interface and writes the port to a file once
+# it accepts connections. Conditional requests are answered with 304 based
+# on the modification time of the files. Requests are logged to stderr.
+#
+# usage: httpserver.py <directory> <portfile> [--throttle <bytes/s>]
+#
+
+import argparse
+import functools
+import http.server
+import os
+import time
+
+parser = argparse.ArgumentParser()
+parser.add_argument('directory')
+parser.add_argument('portfile')
+parser.add_argument('--throttle', type=int, default=0, help='transfer rate in bytes per second')
+args = parser.parse_args()
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+    def copyfile(self, source, outputfile):
+        if args.throttle <= 0:
+            return super().copyfile(source, outputfile)
+        chunk = max(1, args.throttle // 20)
+        while True:
+            data = source.read(chunk)
+            if not data:
+                return
+            outputfile.write(data)
+            outputfile.flush()
+            time.sleep(len(data) / args.throttle)
+
+server = http.server.ThreadingHTTPServer(('127.0.0.1', 0),
+                                         functools.partial(Handler, directory=args.directory))
+with open(args.portfile + '.tmp', 'w') as f:
+    f.write(str(server.server_address[1]))
+os.rename(args.portfile + '.tmp', args.portfile)
+try:
+    server.serve_forever()
+except (BrokenPipeError, ConnectionResetError):
+    pass
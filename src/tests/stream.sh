@@ -0,0 +1,39 @@
+#!/bin/bash
+#
+# Streams images from a local HTTP server into picoflash-emu (--stream):
+# a short image is padded and verified, whereas an oversized image and a
+# missing file are rejected before the chip is erased. A failing sector
+# write ends the download rather than waiting for it to complete.
+#
+
+source "$(dirname "$0")/common.sh"
+
+start_http_server --throttle 262144
+random_file "$WORKDIR/www/short.bin" 200000
+random_file "$WORKDIR/www/large.bin" 600000
+random_file "$WORKDIR/www/full.bin" 524288
+
+# a short image is written as it arrives and padded with zeros
+start_emulator --chip 040 --verbose
+picoflash -w --stream --no-cache -i "$URL/short.bin" || fail "streaming a short image"
+grep -q "PASS" "$WORKDIR/out.log" || fail "verification of the streamed image"
+picoflash -r -o "$WORKDIR/dump.bin" || fail "read back"
+cmp -n 200000 "$WORKDIR/www/short.bin" "$WORKDIR/dump.bin" || fail "streamed data differs"
+
+# images that do not fit or do not exist leave the chip alone
+erases=$(grep -c "ERASEALL" "$WORKDIR/emu.log")
+picoflash_fails -w --stream --no-cache -i "$URL/large.bin" || fail "an oversized image was accepted"
+grep -q "File size too large" "$WORKDIR/out.log" || fail "no size error for an oversized image"
+picoflash_fails -w --stream --no-cache -i "$URL/missing.bin" || fail "a missing image was accepted"
+[ "$(grep -c "ERASEALL" "$WORKDIR/emu.log")" -eq "$erases" ] || fail "the chip was erased for a rejected image"
+
+# a sector write that is not answered (sector 0x23 with this seed) aborts the
+# download of the image, which takes two seconds in full
+stop_process "$EMU_PID"
+start_emulator --chip 040 --drop-rate 0.05 --seed 1
+start=$(date +%s%N)
+picoflash_fails -w --stream --no-cache --timeout 100 -i "$URL/full.bin" || fail "a failing write passed"
+elapsed=$(( ($(date +%s%N) - start) / 1000000 ))
+[ "$elapsed" -lt 1500 ] || fail "the download was not aborted ($elapsed ms)"
+
+echo "PASS"
@@ -0,0 +1,43 @@
+#!/bin/bash
+#
+# Writes an image from a local HTTP server to picoflash-emu several times:
+# the image is downloaded once, revalidated with If-Modified-Since after
+# that, downloaded again once it changes, and served from the cache when the
+# server is gone or --offline is given.
+#
+
+source "$(dirname "$0")/common.sh"
+
+export XDG_CACHE_HOME="$WORKDIR/cache"
+start_emulator --chip 040
+start_http_server
+random_file "$WORKDIR/www/image.bin" 524288
+
+# the first write downloads the image, the second one only revalidates it
+picoflash -w -i "$URL/image.bin" || fail "first write"
+grep -q "Retrieving" "$WORKDIR/out.log" || fail "the image was not downloaded"
+picoflash -w -i "$URL/image.bin" || fail "second write"
+grep -q "not modified" "$WORKDIR/out.log" || fail "the cached image was not revalidated"
+grep -q '" 304 ' "$WORKDIR/http.log" || fail "the server did not answer 304"
+grep -q "PASS" "$WORKDIR/out.log" || fail "verification of the cached image"
+
+# a changed image is downloaded again
+random_file "$WORKDIR/www/image.bin" 524288
+touch -d "+1 hour" "$WORKDIR/www/image.bin"
+picoflash -w -i "$URL/image.bin" || fail "write of the changed image"
+grep -q "Retrieving" "$WORKDIR/out.log" || fail "the changed image was not downloaded"
+picoflash -r -o "$WORKDIR/dump.bin" || fail "read back"
+cmp "$WORKDIR/www/image.bin" "$WORKDIR/dump.bin" || fail "the chip does not hold the changed image"
+
+# without the server, the cached copy is used
+stop_process "$HTTP_PID"
+picoflash -v -i "$URL/image.bin" || fail "verify without the server"
+grep -q "using cached copy" "$WORKDIR/out.log" || fail "no fallback to the cached copy"
+picoflash -v --offline -i "$URL/image.bin" || fail "verify offline"
+grep -q "offline" "$WORKDIR/out.log" || fail "the cached copy was not used offline"
+grep -q "PASS" "$WORKDIR/out.log" || fail "verification of the cached copy"
+
+# only cached images are available offline
+picoflash_fails -v --offline -i "$URL/other.bin" || fail "an uncached image was available offline"
+
+echo "PASS"
@@ -0,0 +1,38 @@
+#!/bin/bash
+#
+# Writes, verifies and reads back an image on picoflash-emu with a window of
+# commands in flight (--window), over a link with latency, and checks the
+# fallback to one command at a time when the emulator drops replies.
+#
+
+source "$(dirname "$0")/common.sh"
+
+random_file "$WORKDIR/image.bin" 524288
+start_emulator --chip 040 --link-latency 500
+
+for options in "--window 2" "--window 4 -p" "--window 16"; do
+    picoflash -w -i "$WORKDIR/image.bin" $options || fail "write $options"
+    grep -q "PASS" "$WORKDIR/out.log" || fail "verification after write $options"
+    ! grep -q "FAIL" "$WORKDIR/out.log" || fail "verification after write $options"
+    picoflash -v -i "$WORKDIR/image.bin" $options || fail "verify $options"
+    ! grep -q "FAIL" "$WORKDIR/out.log" || fail "verify $options"
+    picoflash -r -o "$WORKDIR/dump.bin" $options || fail "read $options"
+    cmp "$WORKDIR/image.bin" "$WORKDIR/dump.bin" || fail "read $options differs from the image"
+done
+
+# with these seeds, a single reply within the window is lost, after which
+# the remaining commands are sent one at a time
+random_file "$WORKDIR/image.bin" 524288
+stop_process "$EMU_PID"
+start_emulator --chip 040 --link-latency 500 --drop-rate 0.02 --seed 3
+picoflash -w -i "$WORKDIR/image.bin" --window 4 --timeout 200 || fail "write with a lost reply"
+grep -q "did not keep up" "$WORKDIR/out.log" || fail "no fallback after a lost reply during the write"
+! grep -q "FAIL" "$WORKDIR/out.log" || fail "verification after a write with a lost reply"
+
+stop_process "$EMU_PID"
+start_emulator --chip 040 --image "$WORKDIR/image.bin" --link-latency 500 --drop-rate 0.02 --seed 5
+picoflash -r -o "$WORKDIR/dump.bin" --window 4 --timeout 200 || fail "read with a lost reply"
+grep -q "did not keep up" "$WORKDIR/out.log" || fail "no fallback after a lost reply during the read"
+cmp "$WORKDIR/image.bin" "$WORKDIR/dump.bin" || fail "read with a lost reply differs from the image"
+
+echo "PASS"
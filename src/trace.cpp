@@ -0,0 +1,190 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "trace.h"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "eventlog.h"
+
+Tracer* Tracer::active = nullptr;
+
+/**
+ * Constructor for the Tracer class.
+ */
+Tracer::Tracer() :
+    start(std::chrono::steady_clock::now()),
+    pid(getpid()) {}
+
+/**
+ * Destructor for the Tracer class; deactivates the tracer if it is active.
+ */
+Tracer::~Tracer() {
+    if(active == this) {
+        active = nullptr;
+    }
+}
+
+/**
+ * Names the calling thread in the trace, if tracing is enabled.
+ * @param name Name of the thread.
+ */
+void Tracer::name_thread(const std::string& name) {
+    Tracer* tracer = active;
+    if(!tracer) {
+        return;
+    }
+    std::string event = "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + std::to_string(tracer->pid)
+                        + ",\"tid\":" + std::to_string(get_tid()) + ",\"args\":{\"name\":" + JsonEvent::quote(name) + "}}";
+    std::lock_guard<std::mutex> lock(tracer->mtx);
+    tracer->events.push_back(std::move(event));
+}
+
+/**
+ * Records a completed span of the calling thread.
+ * @param name Name of the span.
+ * @param category Category of the span, e.g. "flasher" or "serial".
+ * @param begin Start of the span.
+ * @param end End of the span.
+ * @param args Arguments of the span as comma-separated JSON key/value pairs.
+ */
+void Tracer::add_span(const char* name, const char* category, std::chrono::steady_clock::time_point begin,
+                      std::chrono::steady_clock::time_point end, const std::string& args) {
+    // timestamps are in microseconds; fractions keep short commands visible
+    char times[64];
+    snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f",
+             std::chrono::duration<double, std::micro>(begin - this->start).count(),
+             std::chrono::duration<double, std::micro>(end - begin).count());
+
+    std::string event = std::string("{\"name\":\"") + name + "\",\"cat\":\"" + category + "\",\"ph\":\"X\","
+                        + times + ",\"pid\":" + std::to_string(this->pid) + ",\"tid\":" + std::to_string(get_tid());
+    if(!args.empty()) {
+        event += ",\"args\":{" + args + "}";
+    }
+    event += "}";
+
+    std::lock_guard<std::mutex> lock(this->mtx);
+    this->events.push_back(std::move(event));
+}
+
+/**
+ * Records a completed span that may overlap with other spans of the
+ * calling thread, e.g. a command in flight. It is shown on a track of
+ * its own.
+ * @param name Name of the span.
+ * @param category Category of the span.
+ * @param begin Start of the span.
+ * @param end End of the span.
+ * @param args Arguments of the span as comma-separated JSON key/value pairs.
+ */
+void Tracer::add_async_span(const char* name, const char* category, std::chrono::steady_clock::time_point begin,
+                            std::chrono::steady_clock::time_point end, const std::string& args) {
+    std::string common = std::string("\"name\":\"") + name + "\",\"cat\":\"" + category + "\",\"pid\":"
+                         + std::to_string(this->pid) + ",\"tid\":" + std::to_string(get_tid());
+
+    std::lock_guard<std::mutex> lock(this->mtx);
+    std::string id = std::to_string(++this->nrasync);
+    char ts[32];
+    snprintf(ts, sizeof(ts), "%.3f", std::chrono::duration<double, std::micro>(begin - this->start).count());
+    this->events.push_back("{" + common + ",\"ph\":\"b\",\"id\":" + id + ",\"ts\":" + ts
+                           + (args.empty() ? "" : ",\"args\":{" + args + "}") + "}");
+    snprintf(ts, sizeof(ts), "%.3f", std::chrono::duration<double, std::micro>(end - this->start).count());
+    this->events.push_back("{" + common + ",\"ph\":\"e\",\"id\":" + id + ",\"ts\":" + ts + "}");
+}
+
+/**
+ * Writes the trace to a file.
+ * @param filename Name of the file to write.
+ */
+void Tracer::write(const std::string& filename) {
+    std::ofstream outfile(filename);
+    if(!outfile) {
+        throw std::runtime_error("Error opening file.");
+    }
+
+    std::lock_guard<std::mutex> lock(this->mtx);
+    outfile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+    for(size_t i=0; i<this->events.size(); i++) {
+        outfile << this->events[i] << (i + 1 < this->events.size() ? "," : "") << std::endl;
+    }
+    outfile << "]}" << std::endl;
+}
+
+/**
+ * Gets the kernel thread ID of the calling thread.
+ * @return Thread ID.
+ */
+int Tracer::get_tid() {
+    return syscall(SYS_gettid);
+}
+
+/**
+ * Constructor for the TraceSpan class; starts the span.
+ * @param name Name of the span.
+ * @param category Category of the span.
+ */
+TraceSpan::TraceSpan(const char* name, const char* category) :
+    tracer(Tracer::get_active()),
+    name(name),
+    category(category) {
+    if(this->tracer) {
+        this->begin = std::chrono::steady_clock::now();
+    }
+}
+
+/**
+ * Adds an integer argument to the span.
+ * @param key Name of the argument.
+ * @param value Value of the argument.
+ * @return This span.
+ */
+TraceSpan& TraceSpan::arg(const char* key, uint64_t value) {
+    if(this->tracer) {
+        this->args += std::string(this->args.empty() ? "" : ",") + "\"" + key + "\":" + std::to_string(value);
+    }
+    return *this;
+}
+
+/**
+ * Adds a string argument to the span.
+ * @param key Name of the argument.
+ * @param value Value of the argument.
+ * @return This span.
+ */
+TraceSpan& TraceSpan::arg(const char* key, const std::string& value) {
+    if(this->tracer) {
+        this->args += std::string(this->args.empty() ? "" : ",") + "\"" + key + "\":" + JsonEvent::quote(value);
+    }
+    return *this;
+}
+
+/**
+ * Destructor for the TraceSpan class; ends and records the span.
+ */
+TraceSpan::~TraceSpan() {
+    if(this->tracer) {
+        this->tracer->add_span(this->name, this->category, this->begin, std::chrono::steady_clock::now(), this->args);
+    }
+}
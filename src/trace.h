@@ -0,0 +1,162 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Recorder of a timeline of the session in the Chrome trace event format,
+ * which can be opened in Perfetto or chrome://tracing. Spans are recorded
+ * from any thread into a single process-wide tracer; while no tracer is
+ * active, a span costs a single pointer comparison.
+ */
+class Tracer {
+private:
+    static Tracer* active;                          // process-wide tracer, if any
+
+    std::mutex mtx;                                 // serializes spans from different threads
+    std::vector<std::string> events;                // recorded events as JSON objects
+    std::chrono::steady_clock::time_point start;    // origin of all timestamps
+    int pid;                                        // process ID of the session
+    uint64_t nrasync = 0;                           // number of asynchronous spans, used as their ID
+
+public:
+    /**
+     * Constructor for the Tracer class.
+     */
+    Tracer();
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    /**
+     * Destructor for the Tracer class; deactivates the tracer if it is active.
+     */
+    ~Tracer();
+
+    /**
+     * Makes this the process-wide tracer that receives all spans.
+     */
+    void activate() {
+        active = this;
+    }
+
+    /**
+     * Gets the process-wide tracer.
+     * @return Active tracer, or nullptr if tracing is disabled.
+     */
+    static Tracer* get_active() {
+        return active;
+    }
+
+    /**
+     * Names the calling thread in the trace, if tracing is enabled.
+     * @param name Name of the thread.
+     */
+    static void name_thread(const std::string& name);
+
+    /**
+     * Records a completed span of the calling thread.
+     * @param name Name of the span.
+     * @param category Category of the span, e.g. "flasher" or "serial".
+     * @param begin Start of the span.
+     * @param end End of the span.
+     * @param args Arguments of the span as comma-separated JSON key/value pairs.
+     */
+    void add_span(const char* name, const char* category, std::chrono::steady_clock::time_point begin,
+                  std::chrono::steady_clock::time_point end, const std::string& args);
+
+    /**
+     * Records a completed span that may overlap with other spans of the
+     * calling thread, e.g. a command in flight. It is shown on a track of
+     * its own.
+     * @param name Name of the span.
+     * @param category Category of the span.
+     * @param begin Start of the span.
+     * @param end End of the span.
+     * @param args Arguments of the span as comma-separated JSON key/value pairs.
+     */
+    void add_async_span(const char* name, const char* category, std::chrono::steady_clock::time_point begin,
+                        std::chrono::steady_clock::time_point end, const std::string& args);
+
+    /**
+     * Writes the trace to a file.
+     * @param filename Name of the file to write.
+     */
+    void write(const std::string& filename);
+
+private:
+    /**
+     * Gets the kernel thread ID of the calling thread.
+     * @return Thread ID.
+     */
+    static int get_tid();
+};
+
+/**
+ * Span of the timeline that lasts from construction until destruction of
+ * this object, e.g. the body of a function.
+ */
+class TraceSpan {
+private:
+    Tracer* tracer;                                 // tracer to record the span in, if any
+    const char* name;                               // name of the span
+    const char* category;                           // category of the span
+    std::chrono::steady_clock::time_point begin;    // start of the span
+    std::string args;                               // arguments as JSON key/value pairs
+
+public:
+    /**
+     * Constructor for the TraceSpan class; starts the span.
+     * @param name Name of the span.
+     * @param category Category of the span.
+     */
+    TraceSpan(const char* name, const char* category);
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    /**
+     * Adds an integer argument to the span.
+     * @param key Name of the argument.
+     * @param value Value of the argument.
+     * @return This span.
+     */
+    TraceSpan& arg(const char* key, uint64_t value);
+
+    /**
+     * Adds a string argument to the span.
+     * @param key Name of the argument.
+     * @param value Value of the argument.
+     * @return This span.
+     */
+    TraceSpan& arg(const char* key, const std::string& value);
+
+    /**
+     * Destructor for the TraceSpan class; ends and records the span.
+     */
+    ~TraceSpan();
+};
@@ -0,0 +1,363 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "urlcache.h"
+#include "flasher.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+    // download in progress, handed to the write callback
+    struct Download {
+        std::vector<uint8_t>* data = nullptr;
+        CURL* curl = nullptr;       // transfer, to query the announced size
+    };
+}
+
+CacheMode UrlCache::mode = CacheMode::ENABLED;
+
+/**
+ * Constructor for the UrlCache class.
+ * @param directory Root directory of the cache.
+ */
+UrlCache::UrlCache(const std::string& directory) :
+    directory(directory) {}
+
+/**
+ * Gets the default cache directory, following the XDG base directory
+ * specification.
+ * @return Path to the cache directory.
+ */
+std::string UrlCache::get_default_directory() {
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    if(xdg && xdg[0] == '/') {
+        return std::string(xdg) + "/picoflash";
+    }
+    const char* home = std::getenv("HOME");
+    return std::string(home ? home : "/tmp") + "/.cache/picoflash";
+}
+
+/**
+ * Retrieves the image at a URL. A cached copy is served when the server
+ * reports that it has not been modified, when offline, or when the
+ * server cannot be reached.
+ * @param url URL of the image.
+ * @param data Receives the image.
+ * @param out Stream to write progress to.
+ * @throws std::runtime_error if the image can neither be downloaded nor
+ *         served from the cache.
+ */
+void UrlCache::fetch(const std::string& url, std::vector<uint8_t>& data, std::ostream& out) {
+    CacheEntry entry;
+    bool cached = UrlCache::mode != CacheMode::DISABLED && this->load(url, entry, data);
+
+    if(UrlCache::mode == CacheMode::OFFLINE) {
+        if(!cached) {
+            throw std::runtime_error("Error: " + url + " is not cached and downloads are disabled (offline).");
+        }
+        out << "Using cached " << TEXTBLUE << url << TEXTWHITE << " (" << std::dec << data.size() << " bytes, offline)" << std::endl;
+        return;
+    }
+
+    std::vector<uint8_t> downloaded;
+    long status;
+    try {
+        status = this->download(url, entry, downloaded);
+    } catch(const std::exception& e) {
+        if(!cached) {
+            throw;
+        }
+        out << TEXTRED << "Warning" << TEXTWHITE << ": " << e.what() << "; using cached copy." << std::endl;
+        out << "Using cached " << TEXTBLUE << url << TEXTWHITE << " (" << std::dec << data.size() << " bytes)" << std::endl;
+        return;
+    }
+
+    if(status == 304 && cached) {
+        out << "Using cached " << TEXTBLUE << url << TEXTWHITE << " (" << std::dec << data.size() << " bytes, not modified)" << std::endl;
+        return;
+    }
+    if(status >= 400) {
+        throw std::runtime_error("Error retrieving " + url + ": HTTP status " + std::to_string(status) + ".");
+    }
+    if(downloaded.empty()) {
+        throw std::runtime_error("Error retrieving file.");
+    }
+
+    data.swap(downloaded);
+    out << "Retrieving " << TEXTBLUE << url << TEXTWHITE << " (" << std::dec << data.size() << " bytes)" << std::endl;
+
+    // a failure to cache must not fail the operation itself
+    if(UrlCache::mode != CacheMode::DISABLED) {
+        try {
+            entry.url = url;
+            this->store(entry, data);
+        } catch(const std::exception& e) {
+            out << TEXTRED << "Warning" << TEXTWHITE << ": Cannot cache image: " << e.what() << std::endl;
+        }
+    }
+}
+
+/**
+ * Calculates the SHA-256 checksum of the given data.
+ * @param data Data to calculate the checksum for.
+ * @param size Size of the data in bytes.
+ * @return SHA-256 checksum as hexadecimal string.
+ */
+std::string UrlCache::calculate_sha256(const void* data, size_t size) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if(EVP_Digest(data, size, digest, &length, EVP_sha256(), nullptr) != 1) {
+        throw std::runtime_error("Failed to calculate SHA-256 digest");
+    }
+
+    std::ostringstream str;
+    for(unsigned int i=0; i<length; i++) {
+        str << std::hex << std::setw(2) << std::setfill('0') << (int)digest[i];
+    }
+    return str.str();
+}
+
+/**
+ * Downloads a URL, conditionally on the validators of a cached copy.
+ * @param url URL to download.
+ * @param entry Validators of the cached copy, if any; receives the validators of the response.
+ * @param data Receives the image if it has been modified.
+ * @return HTTP status code.
+ */
+long UrlCache::download(const std::string& url, CacheEntry& entry, std::vector<uint8_t>& data) {
+    CURL* curl = curl_easy_init();
+    if(!curl) {
+        throw std::runtime_error("Failed to initialize CURL");
+    }
+
+    struct curl_slist* headers = nullptr;
+    if(!entry.etag.empty()) {
+        headers = curl_slist_append(headers, ("If-None-Match: " + entry.etag).c_str());
+    }
+    if(!entry.last_modified.empty()) {
+        headers = curl_slist_append(headers, ("If-Modified-Since: " + entry.last_modified).c_str());
+    }
+
+    CacheEntry validators;
+    Download download = {&data, curl};
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &UrlCache::write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &download);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &UrlCache::header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &validators);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+
+    CURLcode res = curl_easy_perform(curl);
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+
+    if(res != CURLE_OK) {
+        throw std::runtime_error(std::string(curl_easy_strerror(res)));
+    }
+
+    // a new version comes with its own validators
+    if(status != 304) {
+        entry.etag = validators.etag;
+        entry.last_modified = validators.last_modified;
+    }
+    return status;
+}
+
+/**
+ * Loads the cache entry of a URL together with its image.
+ * @param url URL of the image.
+ * @param entry Receives the cache entry.
+ * @param data Receives the cached image.
+ * @return True if a valid copy is cached, false otherwise.
+ */
+bool UrlCache::load(const std::string& url, CacheEntry& entry, std::vector<uint8_t>& data) {
+    std::string key = calculate_sha256(url.data(), url.size());
+    std::ifstream index(this->directory + "/index/" + key);
+    if(!index) {
+        return false;
+    }
+
+    CacheEntry cached;
+    std::string line;
+    while(std::getline(index, line)) {
+        size_t pos = line.find('=');
+        if(pos == std::string::npos) {
+            continue;
+        }
+        std::string field = line.substr(0, pos);
+        std::string value = line.substr(pos + 1);
+        if(field == "url") {
+            cached.url = value;
+        } else if(field == "sha256") {
+            cached.sha256 = value;
+        } else if(field == "etag") {
+            cached.etag = value;
+        } else if(field == "last_modified") {
+            cached.last_modified = value;
+        }
+    }
+    if(cached.url != url || cached.sha256.empty()) {
+        return false;
+    }
+
+    std::ifstream object(this->directory + "/objects/" + cached.sha256, std::ios::binary);
+    if(!object) {
+        return false;
+    }
+    object.seekg(0, std::ios::end);
+    std::vector<uint8_t> contents(object.tellg());
+    object.seekg(0, std::ios::beg);
+    if(!object.read(reinterpret_cast<char*>(contents.data()), contents.size())) {
+        return false;
+    }
+
+    // the name of the object is its checksum; anything else is a damaged copy
+    if(calculate_sha256(contents.data(), contents.size()) != cached.sha256) {
+        return false;
+    }
+
+    entry = cached;
+    data.swap(contents);
+    return true;
+}
+
+/**
+ * Stores an image and its cache entry.
+ * @param entry Cache entry; its checksum is filled in.
+ * @param data Image to store.
+ */
+void UrlCache::store(CacheEntry& entry, const std::vector<uint8_t>& data) {
+    std::filesystem::create_directories(this->directory + "/objects");
+    std::filesystem::create_directories(this->directory + "/index");
+
+    // identical images downloaded from different URLs share their object
+    std::string previous = entry.sha256;
+    entry.sha256 = calculate_sha256(data.data(), data.size());
+    std::string object = this->directory + "/objects/" + entry.sha256;
+    if(!std::filesystem::exists(object)) {
+        write_atomic(object, data.data(), data.size());
+    }
+
+    std::ostringstream index;
+    index << "url=" << entry.url << "\n"
+          << "sha256=" << entry.sha256 << "\n"
+          << "etag=" << entry.etag << "\n"
+          << "last_modified=" << entry.last_modified << "\n";
+    std::string contents = index.str();
+    write_atomic(this->directory + "/index/" + calculate_sha256(entry.url.data(), entry.url.size()), contents.data(), contents.size());
+
+    // drop the superseded version unless another URL still refers to it
+    if(previous.empty() || previous == entry.sha256) {
+        return;
+    }
+    for(const auto& file : std::filesystem::directory_iterator(this->directory + "/index")) {
+        std::ifstream other(file.path());
+        std::string line;
+        while(std::getline(other, line)) {
+            if(line == "sha256=" + previous) {
+                return;
+            }
+        }
+    }
+    std::filesystem::remove(this->directory + "/objects/" + previous);
+}
+
+/**
+ * Writes a file atomically by renaming a temporary file.
+ * @param path Path of the file.
+ * @param data Pointer to the contents.
+ * @param size Size of the contents in bytes.
+ */
+void UrlCache::write_atomic(const std::string& path, const void* data, size_t size) {
+    std::string tmp = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream outfile(tmp, std::ios::binary);
+        if(!outfile.write(reinterpret_cast<const char*>(data), size)) {
+            throw std::runtime_error("Error writing " + tmp);
+        }
+    }
+    std::filesystem::rename(tmp, path);
+}
+
+/**
+ * Header callback function of CURL, collects the validators.
+ * @param buffer Pointer to the header line.
+ * @param size Size of a character.
+ * @param nitems Number of characters.
+ * @param userdata Cache entry receiving the validators.
+ */
+size_t UrlCache::header_callback(char* buffer, size_t size, size_t nitems, void* userdata) {
+    size_t total_size = size * nitems;
+    CacheEntry* entry = reinterpret_cast<CacheEntry*>(userdata);
+    std::string line(buffer, total_size);
+
+    size_t pos = line.find(':');
+    if(pos != std::string::npos) {
+        std::string field = line.substr(0, pos);
+        std::transform(field.begin(), field.end(), field.begin(), ::tolower);
+        std::string value = line.substr(pos + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t\r\n") + 1);
+
+        if(field == "etag") {
+            entry->etag = value;
+        } else if(field == "last-modified") {
+            entry->last_modified = value;
+        }
+    } else if(line.compare(0, 5, "HTTP/") == 0) {
+        // a new response starts after a redirect
+        *entry = CacheEntry();
+    }
+    return total_size;
+}
+
+/**
+ * Write callback function of CURL
+ * @param ptr Pointer to the data to write.
+ * @param size Size of the data to write.
+ * @param nmemb Number of members to write.
+ * @param userdata Download receiving the data.
+ */
+size_t UrlCache::write_callback(void* ptr, size_t size, size_t nmemb, void* userdata) {
+    size_t total_size = size * nmemb;
+    Download* download = reinterpret_cast<Download*>(userdata);
+
+    // allocate the announced size once, but never more than the largest chip
+    // holds, such that a bogus Content-Length cannot exhaust the memory
+    if(download->data->empty()) {
+        curl_off_t length = -1;
+        curl_easy_getinfo(download->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+        if(length > 0) {
+            download->data->reserve(std::min((size_t)length, Flasher::get_rom_size(0xBFB7)));
+        }
+    }
+    download->data->insert(download->data->end(), reinterpret_cast<uint8_t*>(ptr), reinterpret_cast<uint8_t*>(ptr) + total_size);
+    return total_size;
+}
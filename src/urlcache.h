@@ -0,0 +1,149 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+enum class CacheMode {
+    ENABLED,    // revalidate cached images with the server
+    OFFLINE,    // only serve cached images
+    DISABLED    // always download, do not store
+};
+
+// Cached download of a URL
+struct CacheEntry {
+    std::string url;            // URL of the image
+    std::string sha256;         // SHA-256 of the image, names the cached object
+    std::string etag;           // ETag returned by the server
+    std::string last_modified;  // Last-Modified returned by the server
+};
+
+class UrlCache {
+private:
+    std::string directory;      // root directory of the cache
+    static CacheMode mode;      // process-wide cache mode
+
+public:
+    /**
+     * Constructor for the UrlCache class.
+     * @param directory Root directory of the cache.
+     */
+    UrlCache(const std::string& directory = get_default_directory());
+
+    /**
+     * Sets the process-wide cache mode.
+     * @param mode Cache mode.
+     */
+    static void set_mode(CacheMode mode) {
+        UrlCache::mode = mode;
+    }
+
+    /**
+     * Gets the process-wide cache mode.
+     * @return Cache mode.
+     */
+    static CacheMode get_mode() {
+        return UrlCache::mode;
+    }
+
+    /**
+     * Gets the default cache directory, following the XDG base directory
+     * specification.
+     * @return Path to the cache directory.
+     */
+    static std::string get_default_directory();
+
+    /**
+     * Retrieves the image at a URL. A cached copy is served when the server
+     * reports that it has not been modified, when offline, or when the
+     * server cannot be reached.
+     * @param url URL of the image.
+     * @param data Receives the image.
+     * @param out Stream to write progress to.
+     * @throws std::runtime_error if the image can neither be downloaded nor
+     *         served from the cache.
+     */
+    void fetch(const std::string& url, std::vector<uint8_t>& data, std::ostream& out = std::cout);
+
+    /**
+     * Calculates the SHA-256 checksum of the given data.
+     * @param data Data to calculate the checksum for.
+     * @param size Size of the data in bytes.
+     * @return SHA-256 checksum as hexadecimal string.
+     */
+    static std::string calculate_sha256(const void* data, size_t size);
+
+private:
+    /**
+     * Downloads a URL, conditionally on the validators of a cached copy.
+     * @param url URL to download.
+     * @param entry Validators of the cached copy, if any; receives the validators of the response.
+     * @param data Receives the image if it has been modified.
+     * @return HTTP status code.
+     */
+    long download(const std::string& url, CacheEntry& entry, std::vector<uint8_t>& data);
+
+    /**
+     * Loads the cache entry of a URL together with its image.
+     * @param url URL of the image.
+     * @param entry Receives the cache entry.
+     * @param data Receives the cached image.
+     * @return True if a valid copy is cached, false otherwise.
+     */
+    bool load(const std::string& url, CacheEntry& entry, std::vector<uint8_t>& data);
+
+    /**
+     * Stores an image and its cache entry.
+     * @param entry Cache entry; its checksum is filled in.
+     * @param data Image to store.
+     */
+    void store(CacheEntry& entry, const std::vector<uint8_t>& data);
+
+    /**
+     * Writes a file atomically by renaming a temporary file.
+     * @param path Path of the file.
+     * @param data Pointer to the contents.
+     * @param size Size of the contents in bytes.
+     */
+    static void write_atomic(const std::string& path, const void* data, size_t size);
+
+    /**
+     * Header callback function of CURL, collects the validators.
+     * @param buffer Pointer to the header line.
+     * @param size Size of a character.
+     * @param nitems Number of characters.
+     * @param userdata Cache entry receiving the validators.
+     */
+    static size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata);
+
+    /**
+     * Write callback function of CURL
+     * @param ptr Pointer to the data to write.
+     * @param size Size of the data to write.
+     * @param nmemb Number of members to write.
+     * @param userdata Download receiving the data.
+     */
+    static size_t write_callback(void* ptr, size_t size, size_t nmemb, void* userdata);
+};
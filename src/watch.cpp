@@ -0,0 +1,162 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#include "watch.h"
+
+#include <ctime>
+#include <sstream>
+#include <thread>
+
+/**
+ * Constructor for the Watch class; prepares the image for every chip size.
+ * @param image Image to write; empty when dumping.
+ * @param options Job run on every programmer.
+ */
+Watch::Watch(const std::vector<uint8_t>& image, const WatchOptions& options) :
+    options(options) {
+
+    if(options.operation != WatchOperation::WRITE) {
+        return;
+    }
+
+    // pad the image and calculate its checksums once, rather than for every chip
+    for(uint16_t devid = 0xBFB5; devid <= 0xBFB7; devid++) {
+        size_t romsize = Flasher::get_rom_size(devid);
+        if(image.size() > romsize) {
+            continue;
+        }
+        WatchImage& prepared = this->images[romsize];
+        prepared.data = image;
+        prepared.data.resize(romsize, options.pad_ff ? 0xFF : 0);
+        prepared.crcs = Flasher::calculate_sector_crcs(prepared.data);
+    }
+
+    if(this->images.empty()) {
+        throw std::runtime_error("Error: File size too large.");
+    }
+}
+
+/**
+ * Runs the job on every programmer that is plugged in, until stop is set.
+ * @param stop Flag that ends the loop, e.g. set from a signal handler.
+ */
+void Watch::run(const volatile sig_atomic_t& stop) {
+    SerialPort sp;
+    sp.start_monitor();
+    std::cout << "Waiting for programmers, press Ctrl+C to stop." << std::endl;
+
+    while(!stop) {
+        serial_port_info info;
+        if(!sp.wait_for_device(info, 250)) {
+            continue;
+        }
+
+        // every programmer is handled by its own thread, such that several can be swapped at once
+        std::lock_guard<std::mutex> lock(this->mtx);
+        if(!this->busy.insert(info.device_path).second) {
+            continue;
+        }
+        unsigned int job = ++this->nrjobs;
+        std::thread([this, info, job]() {
+            this->run_device(info, job);
+            std::lock_guard<std::mutex> lock(this->mtx);
+            this->busy.erase(info.device_path);
+            this->cv.notify_all();
+        }).detach();
+    }
+
+    std::unique_lock<std::mutex> lock(this->mtx);
+    this->cv.wait(lock, [this] { return this->busy.empty(); });
+    std::cout << std::dec << this->nrpass << " of " << this->nrjobs << " jobs passed." << std::endl;
+}
+
+/**
+ * Runs the job on a single programmer and logs the result.
+ * @param info Serial port of the programmer.
+ * @param job Sequence number of the job.
+ */
+void Watch::run_device(const serial_port_info& info, unsigned int job) {
+    std::ostringstream log;
+    std::ostringstream message;
+    bool pass = false;
+    uint16_t devid = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        Flasher flasher(info.device_path, log, this->options.transport);
+        flasher.set_pipelined(this->options.pipelined);
+        devid = flasher.read_chip_id();
+        size_t romsize;
+        try {
+            romsize = Flasher::get_rom_size(devid);
+        } catch(const std::logic_error&) {
+            throw std::runtime_error("No recognised chip.");
+        }
+
+        if(this->options.operation == WatchOperation::WRITE) {
+            auto image = this->images.find(romsize);
+            if(image == this->images.end()) {
+                throw std::runtime_error("Image does not fit on the chip.");
+            }
+            flasher.erase_chip();
+            flasher.write_chip(image->second.data, this->options.skip_blank, &image->second.crcs);
+            pass = flasher.verify_chip(image->second.data);
+            if(!pass) {
+                message << "Verification failed.";
+            }
+        } else {
+            // insert the sequence number before the extension of the output file
+            std::ostringstream filename;
+            size_t dot = this->options.output.rfind('.');
+            filename << this->options.output.substr(0, dot) << "_" << std::setw(4) << std::setfill('0') << job
+                     << (dot == std::string::npos ? "" : this->options.output.substr(dot));
+
+            flasher.dump_chip(filename.str(), romsize);
+            message << filename.str();
+            pass = true;
+        }
+    } catch(const std::exception& e) {
+        message << e.what();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    char timestamp[32];
+    std::time_t now = std::time(nullptr);
+    std::tm local;
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime_r(&now, &local));
+
+    std::lock_guard<std::mutex> lock(this->mtx);
+    if(pass) {
+        this->nrpass++;
+    } else {
+        std::cout << log.str();
+    }
+    std::cout << timestamp << " #" << std::dec << job << " " << info.device_path
+              << " serial " << (info.serial.empty() ? "-" : info.serial)
+              << " chip 0x" << std::hex << std::uppercase << devid << std::dec << " ["
+              << (pass ? TEXTGREEN "PASS" : TEXTRED "FAIL") << TEXTWHITE << "] "
+              << std::fixed << std::setprecision(2) << std::chrono::duration<double>(stop - start).count()
+              << "s" << std::defaultfloat;
+    if(!message.str().empty()) {
+        std::cout << " - " << message.str();
+    }
+    std::cout << std::endl;
+}
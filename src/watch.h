@@ -0,0 +1,88 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+
+#pragma once
+
+#include <csignal>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "flasher.h"
+#include "serialport.h"
+
+enum class WatchOperation {
+    WRITE,
+    DUMP
+};
+
+// Job run on every programmer that is plugged in
+struct WatchOptions {
+    WatchOperation operation = WatchOperation::WRITE;
+    std::string output;         // file name of dumps; a sequence number is appended
+    bool skip_blank = false;    // do not transfer blank sectors
+    bool pad_ff = false;        // pad short images with 0xFF
+    bool pipelined = false;     // use the pipelined flash engine
+    SerialConfig transport;     // settings of the serial transport
+};
+
+// Image padded to the size of a chip, including its sector checksums
+struct WatchImage {
+    std::vector<uint8_t> data;      // padded image
+    std::vector<uint16_t> crcs;     // CRC16 checksum per sector
+};
+
+class Watch {
+private:
+    WatchOptions options;                   // job run on every programmer
+    std::map<size_t, WatchImage> images;    // prepared image per chip size
+
+    std::mutex mtx;                         // guards the members below and the console
+    std::condition_variable cv;             // signalled when a job is done
+    std::set<std::string> busy;             // devices running a job
+    unsigned int nrjobs = 0;                // number of started jobs
+    unsigned int nrpass = 0;                // number of passed jobs
+
+public:
+    /**
+     * Constructor for the Watch class; prepares the image for every chip size.
+     * @param image Image to write; empty when dumping.
+     * @param options Job run on every programmer.
+     */
+    Watch(const std::vector<uint8_t>& image, const WatchOptions& options);
+
+    /**
+     * Runs the job on every programmer that is plugged in, until stop is set.
+     * @param stop Flag that ends the loop, e.g. set from a signal handler.
+     */
+    void run(const volatile sig_atomic_t& stop);
+
+private:
+    /**
+     * Runs the job on a single programmer and logs the result.
+     * @param info Serial port of the programmer.
+     * @param job Sequence number of the job.
+     */
+    void run_device(const serial_port_info& info, unsigned int job);
+};
@@ -0,0 +1,90 @@
+/**************************************************************************
+ *                                                                        *
+ *   Author: Ivo Filot <ivo@ivofilot.nl>                                  *
+ *                                                                        *
+ *   PICOFLASH is free software:                                          *
+ *   you can redistribute it and/or modify it under the terms of the      *
+ *   GNU General Public License as published by the Free Software         *
+ *   Foundation, either version 3 of the License, or (at your option)     *
+ *   any later version.                                                   *
+ *                                                                        *
+ *   PICOFLASH is distributed in the hope that it will be useful,         *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <optional>
+
+/**
+ * Bounded blocking queue used to hand work between the threads of the
+ * flashing pipeline.
+ */
+template <typename T>
+class WorkQueue {
+private:
+    std::mutex mtx;
+    std::condition_variable cv_push;
+    std::condition_variable cv_pop;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+
+public:
+    /**
+     * Constructor for the WorkQueue class.
+     * @param capacity Maximum number of items held by the queue.
+     */
+    WorkQueue(size_t capacity) : capacity(capacity) {}
+
+    /**
+     * Adds an item to the queue, blocking while the queue is full.
+     * @param item Item to add.
+     * @return False if the queue has been closed, true otherwise.
+     */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        this->cv_push.wait(lock, [this] { return this->closed || this->items.size() < this->capacity; });
+        if(this->closed) {
+            return false;
+        }
+        this->items.push_back(std::move(item));
+        this->cv_pop.notify_one();
+        return true;
+    }
+
+    /**
+     * Removes an item from the queue, blocking while the queue is empty.
+     * @return Item, or nothing if the queue is closed and drained.
+     */
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(this->mtx);
+        this->cv_pop.wait(lock, [this] { return this->closed || !this->items.empty(); });
+        if(this->items.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(this->items.front());
+        this->items.pop_front();
+        this->cv_push.notify_one();
+        return item;
+    }
+
+    /**
+     * Closes the queue; remaining items can still be popped.
+     */
+    void close() {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        this->closed = true;
+        this->cv_push.notify_all();
+        this->cv_pop.notify_all();
+    }
+};